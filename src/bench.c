@@ -0,0 +1,464 @@
+/*
+ * bench.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ *
+ * Measures how quickly the interactive viewer responds. Runs terminote2 on a pseudo
+ * terminal against a notebook of synthetic notes, types a script of keys at it, and
+ * reports how long each key took to draw and how many bytes it sent to the terminal.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <curses.h>
+#include <term.h>
+
+#define MAX_SCRIPT_STEPS 256
+#define MAX_KEY_SIZE 64
+#define MAX_NAMES 64
+
+/* The script run when none is given */
+static const char *defaultScript = "down*200 pgdn*100 end home goto:50% up*100 pgup*50 "
+        "z right*100 left*100 z c c d a d a resize:100x30 down*50 resize:80x24 "
+        "search:ERROR n*50 N*50 e w";
+
+/* Named keys, and the terminfo capability for what the terminal sends for them */
+static const struct {
+    const char *name;
+    const char *capability;
+} namedKeys[] = {
+    { "up", "kcuu1" }, { "down", "kcud1" }, { "left", "kcub1" }, { "right", "kcuf1" },
+    { "pgup", "kpp" }, { "pgdn", "knp" }, { "home", "khome" }, { "end", "kend" },
+};
+
+/* One step of the script: keys to type, or a new size for the terminal, repeat times */
+typedef struct {
+    char name[MAX_KEY_SIZE];
+    char keys[MAX_KEY_SIZE];
+    int resizeCols;
+    int resizeRows;
+    int repeat;
+} STEP;
+
+/* How long one key took and how much it drew */
+typedef struct {
+    int name;
+    double ms;
+    long bytes;
+} RESULT;
+
+/* Options */
+static const char *binary = "./terminote2";
+static const char *home = NULL;
+static int numNotes = 3;
+static int linesPerNote = 200000;
+static int screenCols = 80;
+static int screenRows = 24;
+static int settleMs = 20;
+static int firstByteMs = 1000;
+static bool verbose = false;
+
+/* The viewer's side of the pseudo terminal */
+static int master = -1;
+static pid_t child = -1;
+
+/* Returns the time in milliseconds */
+static double bench_now() {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Prints how to use the benchmark and exits */
+static void bench_usage() {
+    fprintf( stderr, "Usage: terminote2-bench [-x binary] [-H home | -n notes -l lines] "
+            "[-g COLSxROWS] [-w settle ms] [-t first byte ms] [-v] [script]\n\n"
+            "Runs terminote2 on a pseudo terminal, types the script at it and reports how\n"
+            "long each key took to draw and how many bytes it sent to the terminal.\n"
+            "Without -H a notebook of synthetic notes is made in a temporary directory.\n\n"
+            "The script is a list of steps, each optionally followed by *N to repeat it:\n"
+            " up down left right pgup pgdn home end   the named keys\n"
+            " goto:TEXT      types g, TEXT and Enter\n"
+            " search:TEXT    types /, TEXT and Enter\n"
+            " resize:COLSxROWS   resizes the terminal\n"
+            " anything else  is typed as it is, eg d, a, z or n\n\n"
+            "The default script is:\n %s\n", defaultScript );
+    exit( 1 );
+}
+
+/* Parses the script into steps. Returns the number of steps. */
+static int bench_parse( char *script, STEP *steps ) {
+    int n = 0;
+    for ( char *tok = strtok( script, " \t\n" ); tok; tok = strtok( NULL, " \t\n" ) ) {
+        if ( n == MAX_SCRIPT_STEPS ) {
+            fprintf( stderr, "The script has more than %d steps\n", MAX_SCRIPT_STEPS );
+            exit( 1 );
+        }
+
+        STEP *step = &steps[n++];
+        memset( step, 0, sizeof( *step ) );
+        step->repeat = 1;
+
+        char *star = strrchr( tok, '*' );
+        if ( star && star != tok && star[1] ) {
+            *star = '\0';
+            step->repeat = atoi( star + 1 );
+            if ( step->repeat < 1 ) {
+                fprintf( stderr, "Bad repeat count in %s*%s\n", tok, star + 1 );
+                exit( 1 );
+            }
+        }
+        if ( strlen( tok ) >= MAX_KEY_SIZE - 2 ) {
+            fprintf( stderr, "Script step too long: %s\n", tok );
+            exit( 1 );
+        }
+        strcpy( step->name, tok );
+
+        if ( strncmp( tok, "goto:", 5 ) == 0 ) {
+            snprintf( step->keys, MAX_KEY_SIZE, "g%s\r", tok + 5 );
+            strcpy( step->name, "goto" );
+        } else if ( strncmp( tok, "search:", 7 ) == 0 ) {
+            snprintf( step->keys, MAX_KEY_SIZE, "/%s\r", tok + 7 );
+            strcpy( step->name, "search" );
+        } else if ( strncmp( tok, "resize:", 7 ) == 0 ) {
+            if ( sscanf( tok + 7, "%dx%d", &step->resizeCols, &step->resizeRows ) != 2
+                    || step->resizeCols < 1 || step->resizeRows < 1 ) {
+                fprintf( stderr, "Bad size in %s\n", tok );
+                exit( 1 );
+            }
+            strcpy( step->name, "resize" );
+        } else {
+            strcpy( step->keys, tok );
+            for ( size_t i = 0; i < sizeof( namedKeys ) / sizeof( namedKeys[0] ); i++ ) {
+                if ( strcmp( tok, namedKeys[i].name ) != 0 )
+                    continue;
+                char *seq = tigetstr( ( char * ) namedKeys[i].capability );
+                if ( !seq || seq == ( char * ) -1 || strlen( seq ) >= MAX_KEY_SIZE ) {
+                    fprintf( stderr, "The terminal has no %s key\n", tok );
+                    exit( 1 );
+                }
+                strcpy( step->keys, seq );
+            }
+        }
+    }
+    return n;
+}
+
+/* Writes a line of synthetic text for line number i to fp. Most lines are log lines, with
+ * some JSON, compiler output, long lines that wrap, tabs and wide characters mixed in. */
+static void bench_writeLine( FILE *fp, long i ) {
+    static const char *levels[] = { "INFO", "DEBUG", "WARN", "ERROR", "INFO", "TRACE" };
+    int kind = rand() % 20;
+
+    if ( kind < 12 ) {
+        fprintf( fp, "2026-10-19 %02ld:%02ld:%02ld.%03d %s worker-%d: "
+                "processed request %ld in %d ms\n", i / 3600 % 24, i / 60 % 60, i % 60, rand() % 1000, levels[rand() % 6],
+                rand() % 16, i, rand() % 500 );
+    } else if ( kind < 15 ) {
+        fprintf( fp, "{\"id\": %ld, \"name\": \"item %ld\", \"ok\": %s, \"score\": %d.%d, "
+                "\"tags\": [\"a\", \"b\"], \"parent\": null}\n", i, i,
+                rand() % 2 ? "true" : "false", rand() % 100, rand() % 10 );
+    } else if ( kind < 17 ) {
+        fprintf( fp, "src/module%d.c:%d:%d: warning: unused variable 'x%ld'\n", rand() % 50,
+                rand() % 2000, rand() % 80, i );
+    } else if ( kind < 19 ) {
+        int words = 50 + rand() % 400;
+        for ( int w = 0; w < words; w++ )
+            fprintf( fp, "word%d ", rand() % 1000 );
+        fputc( '\n', fp );
+    } else {
+        fprintf( fp, "\tcaf\xc3\xa9 na\xc3\xafve \xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e %ld\n", i );
+    }
+}
+
+/* Makes a notebook of synthetic notes in a temporary directory and points HOME at it */
+static char *bench_makeNotes() {
+    static char dir[] = "/tmp/terminote-bench-XXXXXX";
+    if ( !mkdtemp( dir ) ) {
+        perror( "Unable to make a temporary directory" );
+        exit( 1 );
+    }
+    setenv( "HOME", dir, 1 );
+
+    srand( 1 );
+    for ( int note = 0; note < numNotes; note++ ) {
+        int fds[2];
+        if ( pipe( fds ) != 0 ) {
+            perror( "Unable to make a pipe" );
+            exit( 1 );
+        }
+
+        pid_t pid = fork();
+        if ( pid == 0 ) {
+            /* It says when it makes the data file, which isn't worth showing */
+            int devNull = open( "/dev/null", O_WRONLY );
+            dup2( fds[0], STDIN_FILENO );
+            dup2( devNull, STDOUT_FILENO );
+            dup2( devNull, STDERR_FILENO );
+            close( devNull );
+            close( fds[0] );
+            close( fds[1] );
+            execl( binary, binary, ( char * ) NULL );
+            perror( binary );
+            _exit( 1 );
+        }
+
+        close( fds[0] );
+        FILE *fp = fdopen( fds[1], "w" );
+        for ( long i = 0; i < linesPerNote; i++ )
+            bench_writeLine( fp, i );
+        fclose( fp );
+
+        int status;
+        if ( pid < 0 || waitpid( pid, &status, 0 ) != pid || !WIFEXITED( status )
+                || WEXITSTATUS( status ) != 0 ) {
+            fprintf( stderr, "Unable to add note %d with %s\n", note + 1, binary );
+            exit( 1 );
+        }
+    }
+    return dir;
+}
+
+/* Removes the temporary notebook */
+static void bench_removeNotes( const char *dir ) {
+    DIR *d = opendir( dir );
+    if ( !d )
+        return;
+
+    struct dirent *entry;
+    char file[4096];
+    while ( ( entry = readdir( d ) ) ) {
+        if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+            continue;
+        snprintf( file, sizeof( file ), "%s/%s", dir, entry->d_name );
+        unlink( file );
+    }
+    closedir( d );
+    rmdir( dir );
+}
+
+/* Reads what the viewer draws until it has been quiet for settle ms, waiting up to first
+ * ms for it to start. Sets last to when the last byte arrived. Returns the bytes read. */
+static long bench_drain( int first, int settle, double *last ) {
+    char buffer[65536];
+    long bytes = 0;
+    int timeout = first;
+
+    for ( ;; ) {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        int ready = poll( &pfd, 1, timeout );
+        if ( ready < 0 && errno == EINTR )
+            continue;
+        if ( ready <= 0 )
+            break;
+
+        ssize_t n = read( master, buffer, sizeof( buffer ) );
+        if ( n <= 0 )
+            break;
+        bytes += n;
+        *last = bench_now();
+        timeout = settle;
+    }
+    return bytes;
+}
+
+/* Runs one step of the script and returns how long it took and how much it drew */
+static RESULT bench_step( STEP *step ) {
+    RESULT result = { 0, 0, 0 };
+    double start = bench_now(), last = start;
+
+    if ( step->resizeCols ) {
+        struct winsize size = { step->resizeRows, step->resizeCols, 0, 0 };
+        ioctl( master, TIOCSWINSZ, &size );
+        kill( child, SIGWINCH );
+    } else if ( write( master, step->keys, strlen( step->keys ) ) < 0 ) {
+        perror( "Unable to send keys" );
+        exit( 1 );
+    }
+
+    result.bytes = bench_drain( firstByteMs, settleMs, &last );
+    result.ms = last - start;
+    return result;
+}
+
+/* Compares two latencies for qsort */
+static int bench_compare( const void *a, const void *b ) {
+    double x = *( const double * ) a, y = *( const double * ) b;
+    return ( x > y ) - ( x < y );
+}
+
+/* Prints the count, bytes and latencies of the results for each kind of step */
+static void bench_report( RESULT *results, int numResults, char names[][MAX_KEY_SIZE],
+        int numNames ) {
+    double *ms = malloc( ( numResults + 1 ) * sizeof(double) );
+
+    printf( "%-12s %8s %12s %10s %10s %10s %10s\n", "step", "count", "bytes/key", "mean ms",
+            "p50 ms", "p95 ms", "max ms" );
+    for ( int name = 0; name < numNames; name++ ) {
+        int count = 0;
+        long bytes = 0;
+        double total = 0;
+        for ( int i = 0; i < numResults; i++ ) {
+            if ( results[i].name != name )
+                continue;
+            ms[count++] = results[i].ms;
+            bytes += results[i].bytes;
+            total += results[i].ms;
+        }
+        if ( count == 0 )
+            continue;
+
+        qsort( ms, count, sizeof(double), bench_compare );
+        printf( "%-12s %8d %12.1f %10.3f %10.3f %10.3f %10.3f\n", names[name], count,
+                ( double ) bytes / count, total / count, ms[count / 2],
+                ms[( int ) ( count * 0.95 )], ms[count - 1] );
+    }
+    free( ms );
+}
+
+int main( int argc, char **argv ) {
+    int opt;
+    while ( ( opt = getopt( argc, argv, "x:H:n:l:g:w:t:vh" ) ) != -1 ) {
+        switch ( opt ) {
+        case 'x':
+            binary = optarg;
+            break;
+        case 'H':
+            home = optarg;
+            break;
+        case 'n':
+            numNotes = atoi( optarg );
+            break;
+        case 'l':
+            linesPerNote = atoi( optarg );
+            break;
+        case 'g':
+            if ( sscanf( optarg, "%dx%d", &screenCols, &screenRows ) != 2 )
+                bench_usage();
+            break;
+        case 'w':
+            settleMs = atoi( optarg );
+            break;
+        case 't':
+            firstByteMs = atoi( optarg );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            bench_usage();
+        }
+    }
+    if ( numNotes < 1 || linesPerNote < 1 || screenCols < 1 || screenRows < 3 || settleMs < 1 )
+        bench_usage();
+
+    /* Join the rest of the arguments into the script */
+    char script[8192] = "";
+    for ( int i = optind; i < argc; i++ ) {
+        strncat( script, argv[i], sizeof( script ) - strlen( script ) - 2 );
+        strcat( script, " " );
+    }
+    if ( !*script )
+        snprintf( script, sizeof( script ), "%s", defaultScript );
+
+    /* Look up what the terminal sends for the named keys */
+    const char *term = getenv( "TERM" );
+    if ( !term || !*term || strcmp( term, "dumb" ) == 0 )
+        setenv( "TERM", "xterm", 1 );
+    int err;
+    if ( setupterm( NULL, STDOUT_FILENO, &err ) != OK ) {
+        fprintf( stderr, "Unable to find the terminal %s\n", getenv( "TERM" ) );
+        return 1;
+    }
+
+    static STEP steps[MAX_SCRIPT_STEPS];
+    int numSteps = bench_parse( script, steps );
+
+    char *tmpHome = NULL;
+    if ( home ) {
+        setenv( "HOME", home, 1 );
+    } else {
+        double start = bench_now();
+        tmpHome = bench_makeNotes();
+        printf( "Made %d notes of %d lines in %.0f ms\n", numNotes, linesPerNote,
+                bench_now() - start );
+    }
+
+    /* Start the viewer on a pseudo terminal */
+    struct winsize size = { screenRows, screenCols, 0, 0 };
+    double start = bench_now(), last = start;
+    child = forkpty( &master, NULL, NULL, &size );
+    if ( child < 0 ) {
+        perror( "Unable to start the viewer" );
+        return 1;
+    } else if ( child == 0 ) {
+        execl( binary, binary, ( char * ) NULL );
+        perror( binary );
+        _exit( 1 );
+    }
+
+    /* Let it load everything before typing, it redraws the progress while loading */
+    struct pollfd pfd = { master, POLLIN, 0 };
+    poll( &pfd, 1, 10000 );
+    double firstPaint = bench_now() - start;
+    long bytes = bench_drain( 0, settleMs > 500 ? settleMs : 500, &last );
+    printf( "Startup: %.1f ms to first paint, %.1f ms until idle, %ld bytes\n\n", firstPaint,
+            last - start, bytes );
+
+    /* Run the script, keeping one result per key */
+    int numResults = 0, numNames = 0;
+    for ( int i = 0; i < numSteps; i++ )
+        numResults += steps[i].repeat;
+    RESULT *results = malloc( numResults * sizeof(RESULT) );
+    char names[MAX_NAMES][MAX_KEY_SIZE];
+
+    numResults = 0;
+    for ( int i = 0; i < numSteps; i++ ) {
+        int name = 0;
+        while ( name < numNames && strcmp( names[name], steps[i].name ) != 0 )
+            name++;
+        if ( name == numNames && numNames < MAX_NAMES )
+            strcpy( names[numNames++], steps[i].name );
+
+        for ( int r = 0; r < steps[i].repeat; r++ ) {
+            RESULT result = bench_step( &steps[i] );
+            result.name = name;
+            results[numResults++] = result;
+            if ( verbose )
+                printf( "%-12s %8ld bytes %10.3f ms\n", steps[i].name, result.bytes, result.ms );
+        }
+    }
+    if ( verbose )
+        printf( "\n" );
+    bench_report( results, numResults, names, numNames );
+    free( results );
+
+    /* Quit, and make sure it has gone before removing its notes */
+    if ( write( master, "q", 1 ) == 1 ) {
+        for ( int i = 0; i < 100 && waitpid( child, NULL, WNOHANG ) == 0; i++ )
+            bench_drain( 100, 100, &last );
+    }
+    if ( waitpid( child, NULL, WNOHANG ) == 0 ) {
+        kill( child, SIGTERM );
+        waitpid( child, NULL, 0 );
+    }
+    close( master );
+
+    if ( tmpHome )
+        bench_removeNotes( tmpHome );
+    return 0;
+}
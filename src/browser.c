@@ -0,0 +1,342 @@
+/*
+ * browser.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "browser.h"
+#include "helperFunctions.h"
+#include "linkedList.h"
+
+static const char *sortNames[NUM_SORTS] = { "number", "newest", "path" };
+
+/* Returns the first line of msg, without the rest of the body */
+static const char *browser_firstLine( MESSAGE *msg ) {
+    return msg->first && msg->first->next ? msg->first->text : "";
+}
+
+/* Orders entries by note number */
+static int browser_byNumber( const void *a, const void *b ) {
+    const BROWSE_ENTRY *x = a, *y = b;
+    return x->msg->messageNum - y->msg->messageNum;
+}
+
+/* Orders entries newest first, then by note number */
+static int browser_byNewest( const void *a, const void *b ) {
+    const BROWSE_ENTRY *x = a, *y = b;
+    if ( x->time != y->time )
+        return x->time < y->time ? 1 : -1;
+    return browser_byNumber( a, b );
+}
+
+/* Orders entries by path, then by note number */
+static int browser_byPath( const void *a, const void *b ) {
+    const BROWSE_ENTRY *x = a, *y = b;
+    int cmp = strcmp( x->msg->path, y->msg->path );
+    return cmp ? cmp : browser_byNumber( a, b );
+}
+
+/* Returns true if the entry's number, time, path or first line contain the filter */
+static bool browser_matches( BROWSER *b, BROWSE_ENTRY *entry ) {
+    if ( !*b->filter )
+        return true;
+
+    char number[16];
+    snprintf( number, sizeof( number ), "%d", entry->msg->messageNum );
+    return strstr( number, b->filter ) || strstr( entry->msg->time, b->filter )
+            || strstr( entry->msg->path, b->filter )
+            || strstr( browser_firstLine( entry->msg ), b->filter );
+}
+
+/* Returns the selected note, or NULL if no notes are shown */
+static MESSAGE *browser_selectedNote( BROWSER *b ) {
+    return b->numShown ? b->entries[b->shown[b->selected]].msg : NULL;
+}
+
+/* Lists the notes that match the fuzzy search best, best first, and selects the best */
+static void browser_rank( BROWSER *b ) {
+    FUZZY_QUERY query;
+    b->numShown = 0;
+    b->selected = 0;
+    if ( !fuzzy_compile( &query, b->fuzzy ) )
+        return;
+
+    if ( !b->notes ) {
+        b->notes = malloc( ( b->numEntries + 1 ) * sizeof(MESSAGE *) );
+        b->entryOf = malloc( ( b->numEntries + 1 ) * sizeof(int) );
+        b->ranked = malloc( BROWSER_FUZZY_RESULTS * sizeof(FUZZY_RESULT) );
+        if ( !b->notes || !b->entryOf || !b->ranked ) {
+            fprintf( stderr, "Failed to allocate memory in browser_rank\n" );
+            abort();
+        }
+
+        /* The notes were numbered from 1 in list order when the browser started */
+        for ( int i = 0; i < b->numEntries; i++ )
+            b->notes[b->entries[i].msg->messageNum - 1] = b->entries[i].msg;
+        fuzzy_index( &b->index, b->notes, b->numEntries );
+    }
+
+    /* The entries may have been sorted since last time */
+    for ( int i = 0; i < b->numEntries; i++ )
+        b->entryOf[b->entries[i].msg->messageNum - 1] = i;
+
+    b->numShown = fuzzy_rank( &b->index, &query, BROWSER_FUZZY_RESULTS, b->ranked );
+    for ( int i = 0; i < b->numShown; i++ )
+        b->shown[i] = b->entryOf[b->ranked[i].note];
+}
+
+/* Rebuilds the list of shown notes from the sort and filter, selecting the note selected
+ * if it's still shown and otherwise the first. A fuzzy search lists its best notes instead. */
+static void browser_refresh( BROWSER *b, MESSAGE *selected ) {
+    if ( *b->fuzzy ) {
+        browser_rank( b );
+        return;
+    }
+
+    b->numShown = 0;
+    b->selected = 0;
+    for ( int i = 0; i < b->numEntries; i++ ) {
+        if ( !browser_matches( b, &b->entries[i] ) )
+            continue;
+        if ( b->entries[i].msg == selected )
+            b->selected = b->numShown;
+        b->shown[b->numShown++] = i;
+    }
+}
+
+/* Sorts the entries by the current sort order */
+static void browser_sort( BROWSER *b ) {
+    MESSAGE *selected = browser_selectedNote( b );
+
+    /* The times are only needed to sort by them, so don't parse them until then */
+    if ( b->sort == SORT_NEWEST && !b->timesParsed ) {
+        for ( int i = 0; i < b->numEntries; i++ )
+            b->entries[i].time = parseNoteTime( b->entries[i].msg->time );
+        b->timesParsed = true;
+    }
+
+    int (*compare)( const void *, const void * ) = browser_byNumber;
+    if ( b->sort == SORT_NEWEST )
+        compare = browser_byNewest;
+    else if ( b->sort == SORT_PATH )
+        compare = browser_byPath;
+    qsort( b->entries, b->numEntries, sizeof(BROWSE_ENTRY), compare );
+
+    /* The shown indexes point at the old order */
+    browser_refresh( b, selected );
+}
+
+/* Keeps the selected row on screen */
+static void browser_reveal( BROWSER *b ) {
+    int listRows = b->rows - 2;
+
+    if ( b->selected >= b->numShown )
+        b->selected = b->numShown - 1;
+    if ( b->selected < 0 )
+        b->selected = 0;
+
+    if ( b->selected < b->top )
+        b->top = b->selected;
+    else if ( b->selected >= b->top + listRows )
+        b->top = b->selected - listRows + 1;
+    if ( b->top > b->numShown - listRows )
+        b->top = b->numShown - listRows;
+    if ( b->top < 0 )
+        b->top = 0;
+}
+
+/* Draws the title bar, the rows of the list that are on screen and the bottom line.
+ * prompt is shown on the bottom line, followed by text, while a filter or fuzzy search is
+ * being typed. The notes a fuzzy search found show the line that matched best. */
+static void browser_draw( BROWSER *b, const char *prompt, const char *text ) {
+    int listRows = b->rows - 2;
+    char line[512];
+
+    werase( b->win );
+
+    wattron( b->win, A_REVERSE );
+    if ( *b->fuzzy )
+        snprintf( line, sizeof( line ), " %d best of %d notes for \"%s\"", b->numShown,
+                b->numEntries, b->fuzzy );
+    else
+        snprintf( line, sizeof( line ), " %d of %d notes, sorted by %s", b->numShown,
+                b->numEntries, sortNames[b->sort] );
+    mvwprintw( b->win, 0, 0, "%-*.*s", b->cols, b->cols, line );
+    wattroff( b->win, A_REVERSE );
+
+    for ( int row = 0; row < listRows && b->top + row < b->numShown; row++ ) {
+        int i = b->top + row;
+        MESSAGE *msg = b->entries[b->shown[i]].msg;
+        const char *first = browser_firstLine( msg );
+        if ( *b->fuzzy && b->ranked[i].line )
+            first = b->ranked[i].line->text;
+        snprintf( line, sizeof( line ), "%6d  %.24s  %-20.20s  %s", msg->messageNum, msg->time,
+                msg->path, first );
+
+        if ( i == b->selected )
+            wattron( b->win, A_REVERSE );
+        mvwprintw( b->win, row + 1, 0, "%-*.*s", b->cols, b->cols, line );
+        if ( i == b->selected )
+            wattroff( b->win, A_REVERSE );
+    }
+
+    if ( prompt )
+        mvwprintw( b->win, b->rows - 1, 0, "%s%s", prompt, text );
+    else
+        mvwprintw( b->win, b->rows - 1, 0, "%.*s", b->cols,
+                " <Enter> open  </> filter  <f> fuzzy search  <s> sort  <q> back" );
+
+    wnoutrefresh( b->win );
+    doupdate();
+}
+
+/* Reads text, the filter or the fuzzy search, a key at a time after prompt, refiltering or
+ * reranking the list as it is typed. Only one of them is used at a time, so the other is
+ * cleared. */
+static void browser_readFilter( BROWSER *b, char *text, const char *prompt ) {
+    int len = strlen( text );
+
+    if ( text == b->fuzzy && *b->filter ) {
+        b->filter[0] = '\0';
+        browser_refresh( b, browser_selectedNote( b ) );
+    } else if ( text == b->filter && *b->fuzzy ) {
+        b->fuzzy[0] = '\0';
+        browser_refresh( b, browser_selectedNote( b ) );
+    }
+
+    for ( ;; ) {
+        browser_reveal( b );
+        browser_draw( b, prompt, text );
+
+        int ch = wgetch( b->win );
+        if ( ch == '\r' || ch == '\n' || ch == KEY_ENTER )
+            return;
+
+        if ( ch == 27 || ch == 7 ) {
+            /* Escape or Cntrl-G clears the filter */
+            len = 0;
+            text[0] = '\0';
+        } else if ( ch == KEY_BACKSPACE || ch == 127 || ch == 8 ) {
+            if ( len == 0 )
+                continue;
+            text[--len] = '\0';
+        } else if ( isprint( ch ) && len < MAX_FILTER_SIZE - 1 ) {
+            text[len++] = ch;
+            text[len] = '\0';
+        } else {
+            continue;
+        }
+
+        browser_refresh( b, browser_selectedNote( b ) );
+        if ( ch == 27 || ch == 7 )
+            return;
+    }
+}
+
+/* Lists the notes after root in a window covering the whole screen and lets the user pick one.
+ * current is selected to begin with. With fuzzy set it starts by reading a fuzzy search.
+ * Returns the chosen note, or NULL if they backed out. */
+MESSAGE *browser_run( MESSAGE *root, MESSAGE *current, bool fuzzy ) {
+    BROWSER b;
+    memset( &b, 0, sizeof( b ) );
+    list_refreshNumbers( root );
+
+    b.entries = malloc( ( root->totalMessages + 1 ) * sizeof(BROWSE_ENTRY) );
+    b.shown = malloc( ( root->totalMessages + 1 ) * sizeof(int) );
+    if ( !b.entries || !b.shown ) {
+        fprintf( stderr, "Failed to allocate memory in browser_run\n" );
+        abort();
+    }
+
+    for ( MESSAGE *msg = root->next; msg; msg = msg->next ) {
+        b.entries[b.numEntries].msg = msg;
+        b.entries[b.numEntries].time = 0;
+        if ( msg == current )
+            b.selected = b.numEntries;
+        b.shown[b.numEntries] = b.numEntries;
+        b.numEntries++;
+    }
+    b.numShown = b.numEntries;
+
+    getmaxyx( stdscr, b.rows, b.cols );
+    b.win = newwin( b.rows, b.cols, 0, 0 );
+    keypad( b.win, true );
+
+    if ( fuzzy )
+        browser_readFilter( &b, b.fuzzy, "Fuzzy: " );
+
+    MESSAGE *chosen = NULL;
+    bool keepGoing = true;
+    while ( keepGoing ) {
+        int listRows = b.rows - 2;
+        browser_reveal( &b );
+        browser_draw( &b, NULL, NULL );
+
+        switch ( wgetch( b.win ) ) {
+        case KEY_UP:
+            b.selected--;
+            break;
+
+        case KEY_DOWN:
+            b.selected++;
+            break;
+
+        case KEY_PPAGE:
+            b.selected -= listRows;
+            break;
+
+        case KEY_NPAGE:
+        case ' ':
+            b.selected += listRows;
+            break;
+
+        case KEY_HOME:
+            b.selected = 0;
+            break;
+
+        case KEY_END:
+            b.selected = b.numShown - 1;
+            break;
+
+        case '/':
+            browser_readFilter( &b, b.filter, "Filter: " );
+            break;
+
+        case 'f':
+            browser_readFilter( &b, b.fuzzy, "Fuzzy: " );
+            break;
+
+        case 's':
+            b.sort = ( b.sort + 1 ) % NUM_SORTS;
+            browser_sort( &b );
+            break;
+
+        case '\r':
+        case '\n':
+        case KEY_ENTER:
+            if ( b.numShown )
+                chosen = b.entries[b.shown[b.selected]].msg;
+            keepGoing = false;
+            break;
+
+        case 'q':
+        case 27:
+            keepGoing = false;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    delwin( b.win );
+    if ( b.notes )
+        fuzzy_freeIndex( &b.index );
+    free( b.notes );
+    free( b.entryOf );
+    free( b.ranked );
+    free( b.entries );
+    free( b.shown );
+    return chosen;
+}
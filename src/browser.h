@@ -0,0 +1,70 @@
+/*
+ * browser.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef BROWSER_H_
+#define BROWSER_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "structures.h"
+#include "fuzzy.h"
+
+#define MAX_FILTER_SIZE 128
+
+/* How many of the best notes a fuzzy search lists */
+#define BROWSER_FUZZY_RESULTS 200
+
+/* Orders the browser can list notes in */
+enum {
+    SORT_NUMBER, SORT_NEWEST, SORT_PATH, NUM_SORTS
+};
+
+/* A note in the browser. Only the note's metadata and first line are used. */
+typedef struct {
+    MESSAGE *msg;
+    time_t time;
+} BROWSE_ENTRY;
+
+/* A scrollable list of notes. Only the rows on screen are ever drawn. */
+typedef struct {
+    BROWSE_ENTRY *entries;
+    int numEntries;
+
+    /* Indexes into entries of the notes that pass the filter, in sorted order */
+    int *shown;
+    int numShown;
+
+    int sort;
+    bool timesParsed;
+    char filter[MAX_FILTER_SIZE];
+
+    /* While fuzzy is set the notes that match it best are listed instead, best first, and
+     * ranked holds their scores and best lines in the same order as shown. The index is
+     * built over the notes in list order the first time it's needed. */
+    char fuzzy[MAX_FILTER_SIZE];
+    FUZZY_RESULT *ranked;
+    FUZZY_INDEX index;
+    MESSAGE **notes;
+    int *entryOf;
+
+    /* Selected row and first row on screen, both indexes into shown */
+    int selected;
+    int top;
+
+    WINDOW *win;
+    int rows;
+    int cols;
+} BROWSER;
+
+/* Lists the notes after root in a window covering the whole screen and lets the user pick one.
+ * current is selected to begin with. With fuzzy set it starts by reading a fuzzy search.
+ * Returns the chosen note, or NULL if they backed out. */
+MESSAGE *browser_run( MESSAGE *root, MESSAGE *current, bool fuzzy );
+
+#endif /* BROWSER_H_ */
@@ -12,6 +12,7 @@
 #define DEBUG 0
 
 extern char *path;
-const char *dataFile;
+extern const char *dataFile;
+extern const char *notebookDir;
 
 #endif /* DEFINES_H_ */
@@ -0,0 +1,155 @@
+/*
+ * event.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "event.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Posted events are written down this pipe, one byte each, to wake up the poll */
+static int eventPipe[2] = { -1, -1 };
+
+/* Events that have been read from the pipe but not yet handed out */
+static bool pending[NUM_EVENTS];
+
+/* When each timer goes off, in milliseconds, or -1 if it isn't set */
+static double timers[NUM_TIMERS];
+
+/* Another descriptor to wait on, and the event to return when it is readable */
+static int watchFd = -1;
+static int watchEvent;
+
+/* Set once the terminal has gone away, after which only events and timers are waited for */
+static bool hungUp = false;
+
+/* Returns the time in milliseconds */
+static double event_now() {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Sets up the pipe that background threads and signal handlers use to wake the UI */
+void event_init() {
+    if ( pipe( eventPipe ) != 0 ) {
+        fprintf( stderr, "Unable to create the event pipe\n" );
+        exit( 1 );
+    }
+
+    /* Posting must never block, and a full pipe already means the UI will wake up */
+    for ( int i = 0; i < 2; i++ ) {
+        fcntl( eventPipe[i], F_SETFL, fcntl( eventPipe[i], F_GETFL ) | O_NONBLOCK );
+        fcntl( eventPipe[i], F_SETFD, FD_CLOEXEC );
+    }
+    for ( int i = 0; i < NUM_TIMERS; i++ )
+        timers[i] = -1;
+}
+
+/* Wakes the UI with event. Safe to call from any thread or from a signal handler, and does
+ * nothing before event_init. */
+void event_post( int event ) {
+    if ( eventPipe[1] < 0 )
+        return;
+
+    int saved = errno;
+    unsigned char byte = event;
+    while ( write( eventPipe[1], &byte, 1 ) < 0 && errno == EINTR )
+        ;
+    errno = saved;
+}
+
+/* Sets timer to go off in ms milliseconds, or stops it if ms is negative */
+void event_setTimer( int timer, int ms ) {
+    timers[timer] = ms < 0 ? -1 : event_now() + ms;
+}
+
+/* Returns event whenever fd is readable, until fd is -1. Whoever handles the event must
+ * read what is waiting on fd, or it will keep being returned. */
+void event_watch( int fd, int event ) {
+    watchFd = fd;
+    watchEvent = event;
+}
+
+/* Moves everything posted so far from the pipe into pending */
+static void event_drain() {
+    unsigned char bytes[64];
+    ssize_t n;
+    while ( ( n = read( eventPipe[0], bytes, sizeof( bytes ) ) ) > 0 )
+        for ( ssize_t i = 0; i < n; i++ )
+            if ( bytes[i] < NUM_EVENTS )
+                pending[bytes[i]] = true;
+}
+
+/* Waits, without using any CPU, until a key is pressed in win, an event is posted or a
+ * timer goes off. Returns the event. Sets value to the key for EVENT_KEY and to the timer
+ * for EVENT_TIMER. EVENT_HANGUP is returned once if the terminal goes away. */
+int event_wait( WINDOW *win, int *value ) {
+    for ( ;; ) {
+        event_drain();
+        for ( int i = 0; i < NUM_EVENTS; i++ ) {
+            if ( pending[i] ) {
+                pending[i] = false;
+                return i;
+            }
+        }
+
+        /* Find the timer due next, handing it out if it's already gone off */
+        double now = event_now(), next = -1;
+        for ( int i = 0; i < NUM_TIMERS; i++ ) {
+            if ( timers[i] < 0 )
+                continue;
+            if ( timers[i] <= now ) {
+                timers[i] = -1;
+                *value = i;
+                return EVENT_TIMER;
+            }
+            if ( next < 0 || timers[i] < next )
+                next = timers[i];
+        }
+
+        /* ncurses may already have keys it read earlier, so ask it before waiting */
+        if ( !hungUp ) {
+            wtimeout( win, 0 );
+            int ch = wgetch( win );
+            wtimeout( win, -1 );
+            if ( ch != ERR ) {
+                *value = ch;
+                return EVENT_KEY;
+            }
+        }
+
+        struct pollfd fds[3] = { { eventPipe[0], POLLIN, 0 } };
+        int numFds = 1, keys = -1, watched = -1;
+        if ( !hungUp ) {
+            keys = numFds++;
+            fds[keys] = ( struct pollfd ) { STDIN_FILENO, POLLIN, 0 };
+        }
+        if ( watchFd >= 0 ) {
+            watched = numFds++;
+            fds[watched] = ( struct pollfd ) { watchFd, POLLIN, 0 };
+        }
+
+        if ( poll( fds, numFds, next < 0 ? -1 : ( int ) ( next - now ) + 1 ) < 0
+                && errno != EINTR ) {
+            fprintf( stderr, "Error waiting for input\n" );
+            exit( 1 );
+        }
+
+        /* The terminal has gone away, so there will be no more keys */
+        if ( keys >= 0 && ( fds[keys].revents & ( POLLHUP | POLLERR | POLLNVAL ) ) ) {
+            hungUp = true;
+            return EVENT_HANGUP;
+        }
+        if ( watched >= 0 && ( fds[watched].revents & POLLIN ) )
+            return watchEvent;
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * event.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdbool.h>
+
+#include "ncurses.h"
+
+/* What woke the UI up. Events posted more than once before the UI gets to them are only
+ * seen once. */
+enum {
+    EVENT_KEY, EVENT_RESIZE, EVENT_LOADER, EVENT_SEARCH, EVENT_SAVED, EVENT_TIMER, EVENT_HANGUP,
+    EVENT_FOLLOW, NUM_EVENTS
+};
+
+/* Timers the UI can set */
+enum {
+    TIMER_SPINNER, NUM_TIMERS
+};
+
+/* Sets up the pipe that background threads and signal handlers use to wake the UI */
+void event_init();
+
+/* Wakes the UI with event. Safe to call from any thread or from a signal handler, and does
+ * nothing before event_init. */
+void event_post( int event );
+
+/* Sets timer to go off in ms milliseconds, or stops it if ms is negative */
+void event_setTimer( int timer, int ms );
+
+/* Returns event whenever fd is readable, until fd is -1. Whoever handles the event must
+ * read what is waiting on fd, or it will keep being returned. */
+void event_watch( int fd, int event );
+
+/* Waits, without using any CPU, until a key is pressed in win, an event is posted or a
+ * timer goes off. Returns the event. Sets value to the key for EVENT_KEY and to the timer
+ * for EVENT_TIMER. EVENT_HANGUP is returned once if the terminal goes away. */
+int event_wait( WINDOW *win, int *value );
+
+#endif /* EVENT_H_ */
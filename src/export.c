@@ -0,0 +1,411 @@
+/*
+ * export.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "export.h"
+#include "store.h"
+#include "linkedList.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* How much is buffered for each file read or written */
+#define EXPORT_BUFFER_SIZE ( 1 << 20 )
+
+/* How much of a note body is copied at once */
+#define EXPORT_BLOCK_SIZE ( 1 << 16 )
+
+/* Writes len bytes of text to out, escaped for the format */
+typedef void (*EXPORT_WRITER)( FILE *out, const char *text, size_t len );
+
+/* A note to write to a file of its own, found by the scan of the data file */
+typedef struct {
+    long body;
+    long len;
+    int number;
+    long time;
+    bool written;
+} EXPORT_JOB;
+
+/* The notes to write into a directory tree, shared with the workers */
+typedef struct {
+    const char *dir;
+    int src;
+    EXPORT_JOB *jobs;
+    int numJobs;
+
+    pthread_mutex_t lock;
+    int next;
+    bool failed;
+} EXPORT_TREE_WORK;
+
+/* Returns the format to export to dest in: JSON Lines for .jsonl, .json or - (stdout), CSV
+ * for .csv, a directory tree for an existing directory or a path ending in /, and the
+ * text -l prints for anything else */
+int export_format( const char *dest ) {
+    size_t len = strlen( dest );
+    const char *dot = strrchr( dest, '.' );
+    struct stat st;
+
+    if ( !strcmp( dest, "-" ) || ( dot && ( !strcmp( dot, ".jsonl" ) || !strcmp( dot, ".json" ) ) ) )
+        return EXPORT_JSONL;
+    if ( dot && !strcmp( dot, ".csv" ) )
+        return EXPORT_CSV;
+    if ( ( len > 0 && dest[len - 1] == '/' ) || ( stat( dest, &st ) == 0 && S_ISDIR( st.st_mode ) ) )
+        return EXPORT_TREE;
+    return EXPORT_TEXT;
+}
+
+/* Writes text as it is */
+static void export_raw( FILE *out, const char *text, size_t len ) {
+    fwrite( text, 1, len, out );
+}
+
+/* Writes the len bytes of text to out escaped for the inside of a JSON string */
+void export_json( FILE *out, const char *text, size_t len ) {
+    size_t start = 0;
+    for ( size_t i = 0; i < len; i++ ) {
+        unsigned char c = text[i];
+        if ( c >= 0x20 && c != '"' && c != '\\' )
+            continue;
+
+        fwrite( text + start, 1, i - start, out );
+        start = i + 1;
+        switch ( c ) {
+        case '"':
+            fputs( "\\\"", out );
+            break;
+        case '\\':
+            fputs( "\\\\", out );
+            break;
+        case '\n':
+            fputs( "\\n", out );
+            break;
+        case '\t':
+            fputs( "\\t", out );
+            break;
+        case '\r':
+            fputs( "\\r", out );
+            break;
+        default:
+            fprintf( out, "\\u%04x", c );
+            break;
+        }
+    }
+    fwrite( text + start, 1, len - start, out );
+}
+
+/* Writes text escaped for the inside of a quoted CSV field */
+static void export_csv( FILE *out, const char *text, size_t len ) {
+    const char *end = text + len;
+    for ( const char *quote; ( quote = memchr( text, '"', end - text ) ); text = quote + 1 ) {
+        fwrite( text, 1, quote + 1 - text, out );
+        fputc( '"', out );
+    }
+    fwrite( text, 1, end - text, out );
+}
+
+/* Copies len bytes of the note body at offset in the data file open at src to out through
+ * write, a block at a time. The reads don't move src, so the records can be read through it
+ * at the same time and any number of threads can share it. Returns false if they couldn't
+ * be read. */
+static bool export_body( int src, long offset, long len, FILE *out, EXPORT_WRITER write,
+        char *block ) {
+    while ( len > 0 ) {
+        size_t n = len < EXPORT_BLOCK_SIZE ? len : EXPORT_BLOCK_SIZE;
+        ssize_t got = pread( src, block, n, offset );
+        if ( got <= 0 )
+            return false;
+        write( out, block, got );
+        offset += got;
+        len -= got;
+    }
+    return true;
+}
+
+/* Opens the data file for reading with a big buffer, reading its header. Sets end to where
+ * its committed records end. The bodies are read from the same open file, so a compaction
+ * that replaces the data file while we export can't mix up the two. */
+static FILE *export_openStore( bool *hasHeader, long *end ) {
+    STORE_HEADER header;
+    FILE *fp = fopen( path, "rb" );
+    if ( !fp ) {
+        fprintf( stderr, "Unable to open the data file at %s\n", path );
+        return NULL;
+    }
+    setvbuf( fp, NULL, _IOFBF, EXPORT_BUFFER_SIZE );
+
+    *hasHeader = store_readHeader( fp, &header );
+    *end = store_dataEnd( fp, *hasHeader ? &header : NULL );
+    return fp;
+}
+
+/* Writes each note to out, one after the other, in format. index walks the records while
+ * the notes are read from under it. Returns the number of notes written, or -1 if the data
+ * file is corrupt. */
+static int export_stream( FILE *index, bool hasHeader, long end, FILE *out, int format,
+        char *block ) {
+    EXPORT_WRITER write = format == EXPORT_JSONL ? export_json :
+                          format == EXPORT_CSV ? export_csv : export_raw;
+    RECORD rec;
+    int status, number = 0;
+
+    if ( format == EXPORT_CSV )
+        fputs( "number,id,timestamp,path,time,text\n", out );
+
+    while ( ( status = store_readRecord( index, &rec, end, hasHeader, NULL ) ) == STORE_OK ) {
+        if ( rec.flags & RECORD_DELETED )
+            continue;
+        number++;
+        if ( !hasHeader )
+            rec.id = number;
+
+        /* Every line ends in a newline, only the text format keeps the last one */
+        long len = format == EXPORT_TEXT || rec.numChars == 0 ? rec.numChars : rec.numChars - 1;
+        long timestamp = parseNoteTime( rec.time );
+
+        if ( format == EXPORT_JSONL ) {
+            fprintf( out, "{\"number\":%d,\"id\":%d,\"timestamp\":", number, rec.id );
+            if ( timestamp < 0 )
+                fputs( "null", out );
+            else
+                fprintf( out, "%ld", timestamp );
+            fputs( ",\"path\":\"", out );
+            write( out, rec.path, strlen( rec.path ) );
+            fputs( "\",\"time\":\"", out );
+            write( out, rec.time, strlen( rec.time ) );
+            fputs( "\",\"text\":\"", out );
+        } else if ( format == EXPORT_CSV ) {
+            fprintf( out, "%d,%d,", number, rec.id );
+            if ( timestamp >= 0 )
+                fprintf( out, "%ld", timestamp );
+            fputs( ",\"", out );
+            write( out, rec.path, strlen( rec.path ) );
+            fputs( "\",\"", out );
+            write( out, rec.time, strlen( rec.time ) );
+            fputs( "\",\"", out );
+        } else {
+            fprintf( out, "Note Number: %d\nPath: %s\nTime: %s\nMessage:\n", number, rec.path,
+                    rec.time );
+        }
+
+        if ( !export_body( fileno( index ), rec.body, len, out, write, block ) )
+            return -1;
+
+        fputs( format == EXPORT_JSONL ? "\"}\n" : format == EXPORT_CSV ? "\"\n" : "\n\n", out );
+    }
+    return status == STORE_CORRUPT ? -1 : number;
+}
+
+/* Makes the directory at dir if it isn't there already */
+static bool export_mkdir( const char *dir ) {
+    return mkdir( dir, 0755 ) == 0 || errno == EEXIST;
+}
+
+/* Puts the path of the job's file under dir in file, making the directories for it if make
+ * is set. Notes go in a directory for the year and one for the month they were written. */
+static void export_treePath( const char *dir, EXPORT_JOB *job, char *file, bool make ) {
+    struct tm tm;
+    time_t t = job->time;
+    int len = snprintf( file, PATH_MAX, "%s/undated", dir );
+    if ( job->time >= 0 && localtime_r( &t, &tm ) ) {
+        len = snprintf( file, PATH_MAX, "%s/%04d", dir, tm.tm_year + 1900 );
+        if ( make )
+            export_mkdir( file );
+        len += snprintf( file + len, PATH_MAX - len, "/%02d", tm.tm_mon + 1 );
+    }
+    if ( make )
+        export_mkdir( file );
+    snprintf( file + len, PATH_MAX - len, "/%06d.txt", job->number );
+}
+
+/* Removes the files the tree's jobs wrote, and the directories they were in if that
+ * leaves them empty */
+static void export_treeRemove( EXPORT_TREE_WORK *tree ) {
+    char file[PATH_MAX];
+    for ( int i = 0; i < tree->numJobs; i++ ) {
+        if ( !tree->jobs[i].written )
+            continue;
+        export_treePath( tree->dir, &tree->jobs[i], file, false );
+        unlink( file );
+
+        /* Only empty directories go, so the ones that had anything else are left */
+        size_t dirLen = strlen( tree->dir );
+        char *slash;
+        while ( ( slash = strrchr( file, '/' ) ) && ( size_t ) ( slash - file ) > dirLen ) {
+            *slash = '\0';
+            rmdir( file );
+        }
+    }
+}
+
+/* Writes the notes in the tree's jobs to files of their own until there are none left */
+static void *export_treeWork( void *arg ) {
+    EXPORT_TREE_WORK *tree = arg;
+    char *block = malloc( EXPORT_BLOCK_SIZE );
+    char file[PATH_MAX];
+
+    if ( !block ) {
+        tree->failed = true;
+        return NULL;
+    }
+
+    for ( ;; ) {
+        int i = takeJob( &tree->lock, &tree->next, 1 );
+        if ( i >= tree->numJobs )
+            break;
+        EXPORT_JOB *job = &tree->jobs[i];
+        export_treePath( tree->dir, job, file, true );
+
+        FILE *out = fopen( file, "w" );
+        if ( !out ) {
+            fprintf( stderr, "Unable to write %s: %s\n", file, strerror( errno ) );
+            tree->failed = true;
+            continue;
+        }
+        job->written = true;
+        setvbuf( out, NULL, _IOFBF, EXPORT_BUFFER_SIZE );
+        if ( !export_body( tree->src, job->body, job->len, out, export_raw, block ) )
+            tree->failed = true;
+        if ( fclose( out ) != 0 )
+            tree->failed = true;
+
+        /* The file was last changed when the note was written */
+        if ( job->time >= 0 ) {
+            struct timespec times[2] = { { job->time, 0 }, { job->time, 0 } };
+            utimensat( AT_FDCWD, file, times, 0 );
+        }
+    }
+
+    free( block );
+    return NULL;
+}
+
+/* Writes each note of the data file to a file of its own under dir. The records are scanned
+ * first, without their bodies, then a thread per core writes the files, all reading the one
+ * open data file. If that fails, the files that were written are removed again. Returns the
+ * number of notes written, or -1 on failure. */
+static int export_tree( FILE *index, bool hasHeader, long end, const char *dir ) {
+    EXPORT_TREE_WORK tree;
+    memset( &tree, 0, sizeof( tree ) );
+    tree.dir = dir;
+    tree.src = fileno( index );
+    pthread_mutex_init( &tree.lock, NULL );
+
+    /* dir itself only goes again on failure if we made it */
+    bool made = mkdir( dir, 0755 ) == 0;
+    if ( !made && errno != EEXIST ) {
+        fprintf( stderr, "Unable to make %s: %s\n", dir, strerror( errno ) );
+        return -1;
+    }
+
+    RECORD rec;
+    int status, size = 0;
+    while ( ( status = store_readRecord( index, &rec, end, hasHeader, NULL ) ) == STORE_OK ) {
+        if ( rec.flags & RECORD_DELETED )
+            continue;
+        if ( tree.numJobs == size ) {
+            size = size ? size * 2 : 1024;
+            tree.jobs = realloc( tree.jobs, size * sizeof(EXPORT_JOB) );
+            if ( !tree.jobs ) {
+                fprintf( stderr, "Failed to allocate memory in export_tree\n" );
+                exit( 1 );
+            }
+        }
+
+        EXPORT_JOB *job = &tree.jobs[tree.numJobs++];
+        job->body = rec.body;
+        job->len = rec.numChars > 0 ? rec.numChars - 1 : 0;
+        job->number = tree.numJobs;
+        job->time = parseNoteTime( rec.time );
+    }
+
+    if ( status == STORE_CORRUPT ) {
+        if ( made )
+            rmdir( dir );
+        free( tree.jobs );
+        return -1;
+    }
+
+    runOnCores( export_treeWork, &tree, tree.numJobs );
+
+    if ( tree.failed ) {
+        export_treeRemove( &tree );
+        if ( made )
+            rmdir( dir );
+    }
+    free( tree.jobs );
+    pthread_mutex_destroy( &tree.lock );
+    return tree.failed ? -1 : tree.numJobs;
+}
+
+/* Exports every note in the data file at path to dest, in the format export_format picks.
+ * The records are streamed straight from the data file, so the notes are never loaded
+ * and only one block of a note is held at a time. A directory tree gets a file per note,
+ * written by a thread per core. A file is written beside dest and only renamed over it
+ * once it's complete. Returns false if something couldn't be written. */
+bool export_notes( const char *dest ) {
+    int format = export_format( dest ), count;
+    bool hasHeader, toStdout = !strcmp( dest, "-" );
+    long end;
+
+    FILE *index = export_openStore( &hasHeader, &end );
+    if ( !index )
+        return false;
+
+    if ( format == EXPORT_TREE ) {
+        /* Don't leave a trailing / to be doubled up when the file names are added */
+        char *dir = strdup( dest );
+        for ( size_t len = strlen( dir ); len > 1 && dir[len - 1] == '/'; len-- )
+            dir[len - 1] = '\0';
+        count = export_tree( index, hasHeader, end, dir );
+        free( dir );
+    } else {
+        char *temp = NULL;
+        FILE *out = stdout;
+        if ( !toStdout ) {
+            temp = malloc( strlen( dest ) + 8 );
+            sprintf( temp, "%s.XXXXXX", dest );
+            int fd = mkstemp( temp );
+            out = fd < 0 ? NULL : fdopen( fd, "w" );
+        }
+        char *block = malloc( EXPORT_BLOCK_SIZE );
+        if ( !out || !block ) {
+            fprintf( stderr, "Unable to write %s: %s\n", dest, strerror( errno ) );
+            exit( 1 );
+        }
+        setvbuf( out, NULL, _IOFBF, EXPORT_BUFFER_SIZE );
+
+        count = export_stream( index, hasHeader, end, out, format, block );
+        if ( ( toStdout ? fflush( out ) : fclose( out ) ) != 0 )
+            count = -1;
+
+        /* mkstemp makes it private, so give it the mode fopen would have */
+        mode_t mask = umask( 0 );
+        umask( mask );
+        if ( temp && ( count < 0 || chmod( temp, 0666 & ~mask ) != 0
+                || rename( temp, dest ) != 0 ) ) {
+            unlink( temp );
+            count = -1;
+        }
+        free( temp );
+        free( block );
+    }
+    fclose( index );
+
+    if ( count < 0 ) {
+        fprintf( stderr, "Failed to export the notes to %s\n", dest );
+        return false;
+    }
+    if ( !toStdout )
+        printf( "Exported %d notes to %s\n", count, dest );
+    return true;
+}
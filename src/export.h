@@ -0,0 +1,33 @@
+/*
+ * export.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef EXPORT_H_
+#define EXPORT_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Formats the notes can be exported in */
+enum {
+    EXPORT_JSONL, EXPORT_CSV, EXPORT_TEXT, EXPORT_TREE
+};
+
+/* Returns the format to export to dest in: JSON Lines for .jsonl, .json or - (stdout), CSV
+ * for .csv, a directory tree for an existing directory or a path ending in /, and the
+ * text -l prints for anything else */
+int export_format( const char *dest );
+
+/* Writes the len bytes of text to out escaped for the inside of a JSON string */
+void export_json( FILE *out, const char *text, size_t len );
+
+/* Exports every note in the data file at path to dest, in the format export_format picks.
+ * The records are streamed straight from the data file, so the notes are never loaded
+ * and only one block of a note is held at a time. A directory tree gets a file per note,
+ * written by a thread per core. Returns false if something couldn't be written. */
+bool export_notes( const char *dest );
+
+#endif /* EXPORT_H_ */
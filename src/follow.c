@@ -0,0 +1,154 @@
+/*
+ * follow.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "follow.h"
+#include "linkedList.h"
+#include "store.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/* Starts following from what the list rooted at root was loaded from */
+void follow_init( FOLLOW *follow, MESSAGE *root ) {
+    follow->fd = -1;
+    follow->generation = root->generation;
+    follow->end = root->dataEnd;
+    follow->nextId = root->nextId;
+}
+
+/* Starts watching the data file for changes with inotify. Returns false if it can't be
+ * watched, which is always the case off Linux. */
+bool follow_watch( FOLLOW *follow ) {
+    if ( follow->fd >= 0 )
+        return true;
+
+#ifdef __linux__
+    /* Rewrites rename a new file over the data file, so watch the directory it's in */
+    char *slash = strrchr( path, '/' );
+    char *dir = slash && slash != path ? strndup( path, slash - path ) : strdup( "/" );
+    if ( !dir )
+        return false;
+
+    follow->fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( follow->fd >= 0
+            && inotify_add_watch( follow->fd, dir,
+                    IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0 ) {
+        close( follow->fd );
+        follow->fd = -1;
+    }
+    free( dir );
+#endif
+    return follow->fd >= 0;
+}
+
+/* Stops watching the data file */
+void follow_stop( FOLLOW *follow ) {
+    if ( follow->fd >= 0 )
+        close( follow->fd );
+    follow->fd = -1;
+}
+
+/* Waits until the data file changes, or ms milliseconds pass if ms isn't negative */
+void follow_wait( FOLLOW *follow, int ms ) {
+    struct pollfd fds = { follow->fd, POLLIN, 0 };
+    do {
+        if ( poll( &fds, 1, ms ) <= 0 )
+            return;
+    } while ( !follow_changed( follow ) );
+}
+
+/* Reads the changes the watch has seen without blocking. Returns true if any of them were
+ * to the data file. */
+bool follow_changed( FOLLOW *follow ) {
+#ifndef __linux__
+    ( void ) follow;
+    return false;
+#else
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char *slash = strrchr( path, '/' );
+    const char *name = slash ? slash + 1 : path;
+    bool changed = false;
+    ssize_t n;
+
+    while ( ( n = read( follow->fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+        for ( char *p = buffer; p < buffer + n; ) {
+            struct inotify_event *event = ( struct inotify_event * ) p;
+            if ( event->len && strcmp( event->name, name ) == 0 )
+                changed = true;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+#endif
+}
+
+/* Adds the notes written to the data file since we last looked to the end of the list
+ * rooted at root. Only the new records are read, unless the file has been rewritten, when
+ * the record headers are skimmed for ids we haven't seen. Returns the first new note, or
+ * NULL if there are none. */
+MESSAGE *follow_read( FOLLOW *follow, MESSAGE *root ) {
+    STORE_HEADER header;
+    RECORD rec;
+    MESSAGE *first = NULL, *tail = root->tail ? root->tail : root;
+    char *buffer = NULL;
+    int status, from = follow->nextId;
+
+    FILE *fp = fopen( path, "rb" );
+    if ( !fp )
+        return NULL;
+
+    /* Files without a header are only ever rewritten, never appended to */
+    if ( !store_readHeader( fp, &header ) ) {
+        fclose( fp );
+        return NULL;
+    }
+
+    /* Anything past dataEnd is still being written, we'll be told when it's done */
+    long end = store_dataEnd( fp, &header );
+    if ( header.generation == follow->generation && end >= follow->end )
+        fseek( fp, follow->end, SEEK_SET );
+
+    while ( ( status = store_readRecord( fp, &rec, end, true, NULL ) ) == STORE_OK ) {
+        if ( rec.id < from || ( rec.flags & RECORD_DELETED ) )
+            continue;
+
+        /* Go back for the body now we know we want it */
+        long next = ftell( fp );
+        fseek( fp, rec.offset, SEEK_SET );
+        if ( ( status = store_readRecord( fp, &rec, end, true, &buffer ) ) != STORE_OK )
+            break;
+        fseek( fp, next, SEEK_SET );
+
+        tail = list_addRecord( tail, &rec, buffer );
+        free( buffer );
+        if ( !first )
+            first = tail;
+        if ( rec.id >= follow->nextId )
+            follow->nextId = rec.id + 1;
+        if ( rec.id >= root->nextId )
+            root->nextId = rec.id + 1;
+    }
+    fclose( fp );
+
+    if ( first )
+        root->tail = tail;
+
+    /* Try a bad record again next time, the notes before it won't be added twice */
+    if ( status == STORE_EOF ) {
+        follow->generation = header.generation;
+        follow->end = end;
+        if ( header.nextId > follow->nextId )
+            follow->nextId = header.nextId;
+    }
+    return first;
+}
@@ -0,0 +1,52 @@
+/*
+ * follow.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef FOLLOW_H_
+#define FOLLOW_H_
+
+#include <stdbool.h>
+
+#include "structures.h"
+
+/* Follows the data file at path like tail -f, picking up the notes other terminotes add
+ * to it without loading it again */
+typedef struct {
+    /* inotify descriptor watching the data file's directory, -1 when not watching */
+    int fd;
+
+    /* How much of the data file we have: its generation, where its records ended and the
+     * first id we hadn't seen. Records past end are new, and once the file has been
+     * rewritten so are those with an id of at least nextId. */
+    int generation;
+    long end;
+    int nextId;
+} FOLLOW;
+
+/* Starts following from what the list rooted at root was loaded from */
+void follow_init( FOLLOW *follow, MESSAGE *root );
+
+/* Starts watching the data file for changes with inotify. Returns false if it can't be
+ * watched, which is always the case off Linux. */
+bool follow_watch( FOLLOW *follow );
+
+/* Stops watching the data file */
+void follow_stop( FOLLOW *follow );
+
+/* Waits until the data file changes, or ms milliseconds pass if ms isn't negative */
+void follow_wait( FOLLOW *follow, int ms );
+
+/* Reads the changes the watch has seen without blocking. Returns true if any of them were
+ * to the data file. */
+bool follow_changed( FOLLOW *follow );
+
+/* Adds the notes written to the data file since we last looked to the end of the list
+ * rooted at root. Only the new records are read, unless the file has been rewritten, when
+ * the record headers are skimmed for ids we haven't seen. Returns the first new note, or
+ * NULL if there are none. */
+MESSAGE *follow_read( FOLLOW *follow, MESSAGE *root );
+
+#endif /* FOLLOW_H_ */
@@ -0,0 +1,415 @@
+/*
+ * fuzzy.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fuzzy.h"
+#include "helperFunctions.h"
+
+/* Points for each byte of a term that matched, less twice that for each typo */
+#define FUZZY_CHAR_SCORE 16
+
+/* Points for a note written now, which halve at FUZZY_RECENCY_AGE seconds old, a third at
+ * twice that and so on */
+#define FUZZY_RECENCY_SCORE 32
+#define FUZZY_RECENCY_AGE ( 7 * 24 * 60 * 60 )
+
+/* Points for a note written in the current directory */
+#define FUZZY_CWD_SCORE 16
+
+/* Notes are handed to the workers this many at a time */
+#define FUZZY_CHUNK 1024
+
+/* Set on every signature that has been worked out, so none of them are 0 */
+#define FUZZY_SIGNED ( 1ULL << 63 )
+
+/* The bit of a signature each byte sets: one for each letter, ignoring case, and each
+ * digit, with the other bytes sharing the rest */
+static uint64_t fuzzyBits[256];
+static pthread_once_t fuzzyOnce = PTHREAD_ONCE_INIT;
+
+/* The best k notes a worker, or the whole search, has found so far. The worst of them is
+ * at the top of the heap, so it's the one a better note replaces. */
+typedef struct {
+    FUZZY_RESULT *results;
+    int numResults;
+    int size;
+} FUZZY_HEAP;
+
+/* A search shared with the workers */
+typedef struct {
+    FUZZY_INDEX *index;
+    FUZZY_QUERY *query;
+
+    pthread_mutex_t lock;
+
+    /* The first note of the next chunk for a worker to take */
+    int next;
+
+    /* Every worker's best notes, merged as they finish */
+    FUZZY_HEAP best;
+} FUZZY_WORK;
+
+/* Fills in fuzzyBits */
+static void fuzzy_initBits( void ) {
+    for ( int c = 0; c < 256; c++ ) {
+        int bit;
+        if ( c >= 'a' && c <= 'z' )
+            bit = c - 'a';
+        else if ( c >= 'A' && c <= 'Z' )
+            bit = c - 'A';
+        else if ( c >= '0' && c <= '9' )
+            bit = 26 + c - '0';
+        else if ( c >= 0x80 )
+            bit = 62;
+        else
+            bit = 36 + c % 26;
+        fuzzyBits[c] = 1ULL << bit;
+    }
+}
+
+/* Returns c in lower case, leaving anything but ASCII letters alone */
+static unsigned char fuzzy_lower( unsigned char c ) {
+    return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+/* Sets up term to find the len bytes at text */
+static void fuzzy_addTerm( FUZZY_TERM *term, const char *text, int len ) {
+    if ( len > FUZZY_MAX_TERM )
+        len = FUZZY_MAX_TERM;
+
+    memset( term, 0, sizeof(FUZZY_TERM) );
+    term->length = len;
+
+    /* Short terms must match exactly, or almost anything would match them */
+    term->maxErrors = len <= 3 ? 0 : len <= 6 ? 1 : FUZZY_MAX_ERRORS;
+
+    for ( int i = 0; i < len; i++ ) {
+        unsigned char c = fuzzy_lower( text[i] );
+        term->text[i] = c;
+        term->masks[c] |= 1ULL << i;
+        if ( c >= 'a' && c <= 'z' )
+            term->masks[c + 'A' - 'a'] |= 1ULL << i;
+    }
+}
+
+/* Splits text into the terms of query. Returns false if there are none. */
+bool fuzzy_compile( FUZZY_QUERY *query, const char *text ) {
+    pthread_once( &fuzzyOnce, fuzzy_initBits );
+
+    query->numTerms = 0;
+    while ( *text && query->numTerms < FUZZY_MAX_TERMS ) {
+        while ( *text == ' ' || *text == '\t' )
+            text++;
+        int len = strcspn( text, " \t" );
+        if ( len > 0 )
+            fuzzy_addTerm( &query->terms[query->numTerms++], text, len );
+        text += len;
+    }
+
+    query->now = time( NULL );
+    if ( !getcwd( query->cwd, sizeof( query->cwd ) ) )
+        query->cwd[0] = '\0';
+    return query->numTerms > 0;
+}
+
+/* Sets up index to search the numNotes notes, which it doesn't copy */
+void fuzzy_index( FUZZY_INDEX *index, MESSAGE **notes, int numNotes ) {
+    pthread_once( &fuzzyOnce, fuzzy_initBits );
+
+    index->notes = notes;
+    index->numNotes = numNotes;
+    index->signatures = calloc( numNotes ? numNotes : 1, sizeof(uint64_t) );
+    if ( !index->signatures ) {
+        fprintf( stderr, "Failed to allocate memory in fuzzy_index\n" );
+        exit( 1 );
+    }
+}
+
+/* Frees the signatures of index */
+void fuzzy_freeIndex( FUZZY_INDEX *index ) {
+    free( index->signatures );
+    index->signatures = NULL;
+    index->numNotes = 0;
+}
+
+/* Returns the signature of msg, the bits of every character in its lines */
+static uint64_t fuzzy_signature( MESSAGE *msg ) {
+    uint64_t signature = FUZZY_SIGNED;
+    for ( LINE *line = msg->first; line && line->next; line = line->next ) {
+        const unsigned char *s = ( const unsigned char * ) line->text, *end = s + line->lSize;
+        for ( ; s < end; s++ )
+            signature |= fuzzyBits[*s];
+    }
+    return signature;
+}
+
+/* Returns the fewest typos a text with the given signature could contain term with: one
+ * for each of its characters that aren't in the text at all */
+static int fuzzy_leastErrors( FUZZY_TERM *term, uint64_t signature ) {
+    int errors = 0;
+    for ( int i = 0; i < term->length; i++ )
+        if ( !( signature & fuzzyBits[term->text[i]] ) )
+            errors++;
+    return errors;
+}
+
+/* Returns the fewest typos, insertions, deletions, substitutions or swaps of neighbouring
+ * bytes, that term is found with anywhere in the len bytes at text, or more than its
+ * maxErrors if it isn't. Bit i of r[d] is set when the first i + 1 bytes of term end here
+ * with d typos, and every r[d] is moved on a byte at a time with a few shifts, ands and ors
+ * (Wu and Manber, with Hyyro's swaps). */
+static int fuzzy_match( FUZZY_TERM *term, const char *text, int len ) {
+    const unsigned char *s = ( const unsigned char * ) text, *end = s + len;
+    uint64_t r[FUZZY_MAX_ERRORS + 1], before[FUZZY_MAX_ERRORS + 1], lastMask = 0;
+    uint64_t found = 1ULL << ( term->length - 1 );
+    int maxErrors = term->maxErrors, best = maxErrors + 1;
+
+    /* before is r as it was a byte back, which a swap carries on from */
+    for ( int d = 0; d <= maxErrors; d++ )
+        r[d] = before[d] = ( 1ULL << d ) - 1;
+
+    for ( ; s < end; s++ ) {
+        uint64_t mask = term->masks[*s];
+        uint64_t last = r[0], lastBefore = before[0];
+        before[0] = r[0];
+        r[0] = ( ( r[0] << 1 ) | 1 ) & mask;
+
+        /* Only fewer typos than the best so far are worth following */
+        for ( int d = 1; d < best; d++ ) {
+            uint64_t old = r[d];
+            uint64_t swap = ( ( ( lastBefore << 1 ) | 1 ) << 1 ) & ( mask << 1 ) & lastMask;
+            r[d] = ( ( ( old << 1 ) | 1 ) & mask ) | last | ( last << 1 ) | ( r[d - 1] << 1 )
+                    | swap | ( ( 1ULL << d ) - 1 );
+            lastBefore = before[d];
+            before[d] = old;
+            last = old;
+        }
+        lastMask = mask;
+
+        for ( int d = 0; d < best; d++ ) {
+            if ( r[d] & found ) {
+                if ( d == 0 )
+                    return 0;
+                best = d;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+/* Returns the points term scores when found with errors typos */
+static int fuzzy_termScore( FUZZY_TERM *term, int errors ) {
+    return FUZZY_CHAR_SCORE * ( term->length - 2 * errors );
+}
+
+/* Returns the points msg scores for being recent */
+static int fuzzy_recency( FUZZY_QUERY *query, MESSAGE *msg ) {
+    time_t written = parseNoteTime( msg->time );
+    if ( written <= 0 )
+        return 0;
+
+    long age = query->now > written ? query->now - written : 0;
+    return FUZZY_RECENCY_SCORE * ( long long ) FUZZY_RECENCY_AGE / ( FUZZY_RECENCY_AGE + age );
+}
+
+/* Scores note i of index against query, setting *best to the line that matched best.
+ * Returns 0 if none of the terms are in the note, or it can't score more than atLeast. */
+static int fuzzy_score( FUZZY_INDEX *index, FUZZY_QUERY *query, int i, int atLeast,
+        LINE **best ) {
+    MESSAGE *msg = index->notes[i];
+    if ( !index->signatures[i] )
+        index->signatures[i] = fuzzy_signature( msg );
+    uint64_t signature = index->signatures[i];
+
+    /* Work out the most the note could score, from the path, which is short, and what the
+     * signature says about the body. Only the terms the signature allows are looked for. */
+    int errors[FUZZY_MAX_TERMS];
+    int most = FUZZY_RECENCY_SCORE, score = 0;
+    bool any = false;
+
+    for ( int t = 0; t < query->numTerms; t++ ) {
+        FUZZY_TERM *term = &query->terms[t];
+        int pathErrors = fuzzy_match( term, msg->path, strlen( msg->path ) );
+        if ( pathErrors <= term->maxErrors ) {
+            score += fuzzy_termScore( term, pathErrors ) / 2;
+            any = true;
+        }
+
+        int least = fuzzy_leastErrors( term, signature );
+        errors[t] = least <= term->maxErrors ? term->maxErrors + 1 : -1;
+        if ( errors[t] >= 0 )
+            most += fuzzy_termScore( term, least );
+    }
+    if ( query->cwd[0] && !strcmp( msg->path, query->cwd ) )
+        score += FUZZY_CWD_SCORE;
+
+    if ( score + most < atLeast )
+        return 0;
+
+    /* The best line is the one with the highest score for the terms it contains */
+    int bestLine = 0;
+    *best = NULL;
+    for ( LINE *line = msg->first; line && line->next; line = line->next ) {
+        int lineScore = 0;
+        for ( int t = 0; t < query->numTerms; t++ ) {
+            if ( errors[t] < 0 )
+                continue;
+            FUZZY_TERM *term = &query->terms[t];
+            int e = fuzzy_match( term, line->text, line->lSize );
+            if ( e > term->maxErrors )
+                continue;
+            lineScore += fuzzy_termScore( term, e );
+            if ( e < errors[t] )
+                errors[t] = e;
+        }
+        if ( lineScore > bestLine ) {
+            bestLine = lineScore;
+            *best = line;
+        }
+    }
+
+    for ( int t = 0; t < query->numTerms; t++ ) {
+        if ( errors[t] >= 0 && errors[t] <= query->terms[t].maxErrors ) {
+            score += fuzzy_termScore( &query->terms[t], errors[t] );
+            any = true;
+        }
+    }
+    if ( !any || score + FUZZY_RECENCY_SCORE < atLeast )
+        return 0;
+
+    return score + fuzzy_recency( query, msg );
+}
+
+/* Returns true if a ranks above b: it scores more, or the same and is the newer note */
+static bool fuzzy_better( FUZZY_RESULT *a, FUZZY_RESULT *b ) {
+    return a->score > b->score || ( a->score == b->score && a->note > b->note );
+}
+
+/* Sets up heap to hold the best size results */
+static void fuzzy_heapInit( FUZZY_HEAP *heap, int size ) {
+    heap->size = size;
+    heap->numResults = 0;
+    heap->results = malloc( size * sizeof(FUZZY_RESULT) );
+    if ( !heap->results ) {
+        fprintf( stderr, "Failed to allocate memory in fuzzy_heapInit\n" );
+        exit( 1 );
+    }
+}
+
+/* Returns the score a note must beat to get into heap */
+static int fuzzy_heapMin( FUZZY_HEAP *heap ) {
+    return heap->numResults < heap->size ? 1 : heap->results[0].score;
+}
+
+/* Moves the result at i down the heap until the ones below it rank above it */
+static void fuzzy_siftDown( FUZZY_HEAP *heap, int i ) {
+    FUZZY_RESULT *r = heap->results;
+    for ( ;; ) {
+        int worst = i, left = 2 * i + 1, right = left + 1;
+        if ( left < heap->numResults && fuzzy_better( &r[worst], &r[left] ) )
+            worst = left;
+        if ( right < heap->numResults && fuzzy_better( &r[worst], &r[right] ) )
+            worst = right;
+        if ( worst == i )
+            return;
+
+        FUZZY_RESULT tmp = r[i];
+        r[i] = r[worst];
+        r[worst] = tmp;
+        i = worst;
+    }
+}
+
+/* Adds result to heap if it's one of the best size seen, pushing out the worst */
+static void fuzzy_heapAdd( FUZZY_HEAP *heap, FUZZY_RESULT *result ) {
+    FUZZY_RESULT *r = heap->results;
+
+    if ( heap->numResults < heap->size ) {
+        int i = heap->numResults++;
+        while ( i > 0 && fuzzy_better( &r[( i - 1 ) / 2], result ) ) {
+            r[i] = r[( i - 1 ) / 2];
+            i = ( i - 1 ) / 2;
+        }
+        r[i] = *result;
+    } else if ( fuzzy_better( result, &r[0] ) ) {
+        r[0] = *result;
+        fuzzy_siftDown( heap, 0 );
+    }
+}
+
+/* Scores chunks of notes until there are none left, keeping the best of them in a heap of
+ * its own, then merges them into the search's */
+static void *fuzzy_work( void *arg ) {
+    FUZZY_WORK *work = arg;
+    FUZZY_HEAP heap;
+    fuzzy_heapInit( &heap, work->best.size );
+
+    for ( ;; ) {
+        int start = takeJob( &work->lock, &work->next, FUZZY_CHUNK );
+        if ( start >= work->index->numNotes )
+            break;
+
+        int end = start + FUZZY_CHUNK;
+        if ( end > work->index->numNotes )
+            end = work->index->numNotes;
+        for ( int i = start; i < end; i++ ) {
+            FUZZY_RESULT result;
+            result.note = i;
+            result.score = fuzzy_score( work->index, work->query, i, fuzzy_heapMin( &heap ),
+                    &result.line );
+            if ( result.score > 0 )
+                fuzzy_heapAdd( &heap, &result );
+        }
+    }
+
+    pthread_mutex_lock( &work->lock );
+    for ( int i = 0; i < heap.numResults; i++ )
+        fuzzy_heapAdd( &work->best, &heap.results[i] );
+    pthread_mutex_unlock( &work->lock );
+
+    free( heap.results );
+    return NULL;
+}
+
+/* Orders results best first */
+static int fuzzy_compareResults( const void *a, const void *b ) {
+    FUZZY_RESULT *x = ( FUZZY_RESULT * ) a, *y = ( FUZZY_RESULT * ) b;
+    return fuzzy_better( x, y ) ? -1 : fuzzy_better( y, x ) ? 1 : 0;
+}
+
+/* Scores every note of index against query and puts the best k in results, best first.
+ * Each term is found with bit-parallel approximate matching, and scores more the longer it
+ * is and the fewer typos it took. Terms in the note's path, notes written in the current
+ * directory and recent notes score extra. The notes are shared out among a thread per core,
+ * each keeping its best k in a heap. Returns how many results there are. */
+int fuzzy_rank( FUZZY_INDEX *index, FUZZY_QUERY *query, int k, FUZZY_RESULT *results ) {
+    if ( k <= 0 )
+        return 0;
+
+    FUZZY_WORK work;
+    memset( &work, 0, sizeof( work ) );
+    work.index = index;
+    work.query = query;
+    pthread_mutex_init( &work.lock, NULL );
+    fuzzy_heapInit( &work.best, k );
+
+    runOnCores( fuzzy_work, &work, ( index->numNotes + FUZZY_CHUNK - 1 ) / FUZZY_CHUNK );
+
+    int count = work.best.numResults;
+    qsort( work.best.results, count, sizeof(FUZZY_RESULT), fuzzy_compareResults );
+    memcpy( results, work.best.results, count * sizeof(FUZZY_RESULT) );
+
+    free( work.best.results );
+    pthread_mutex_destroy( &work.lock );
+    return count;
+}
@@ -0,0 +1,78 @@
+/*
+ * fuzzy.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef FUZZY_H_
+#define FUZZY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "structures.h"
+
+/* A term longer than this is cut short, so it fits in the bits of a word */
+#define FUZZY_MAX_TERM 64
+#define FUZZY_MAX_TERMS 16
+#define FUZZY_MAX_ERRORS 2
+
+/* How many notes -F prints when it isn't told */
+#define FUZZY_DEFAULT_RESULTS 10
+
+/* A word of the query and the tables to find it with: masks[c] has bit i set if character
+ * i of the term is c, ignoring case */
+typedef struct {
+    unsigned char text[FUZZY_MAX_TERM];
+    int length;
+    int maxErrors;
+    uint64_t masks[256];
+} FUZZY_TERM;
+
+/* What the user half remembers: the words to look for, each allowed a few typos, and what
+ * the notes' recency and path are scored against */
+typedef struct {
+    FUZZY_TERM terms[FUZZY_MAX_TERMS];
+    int numTerms;
+    time_t now;
+    char cwd[MAX_PATH_SIZE];
+} FUZZY_QUERY;
+
+/* A note the query found: its index in the notes searched, how well it matched, and the
+ * line that matched best, which is NULL if only the path did */
+typedef struct {
+    int note;
+    int score;
+    LINE *line;
+} FUZZY_RESULT;
+
+/* Notes to search, with a signature of the characters each one contains. A note whose
+ * signature lacks too many of a term's characters can't contain it, so most notes are
+ * passed over without reading them. Signatures are worked out the first time they are
+ * needed and kept for later searches, so the notes mustn't change while it's in use. A
+ * signature of 0 hasn't been worked out yet. */
+typedef struct {
+    MESSAGE **notes;
+    uint64_t *signatures;
+    int numNotes;
+} FUZZY_INDEX;
+
+/* Splits text into the terms of query. Returns false if there are none. */
+bool fuzzy_compile( FUZZY_QUERY *query, const char *text );
+
+/* Sets up index to search the numNotes notes, which it doesn't copy */
+void fuzzy_index( FUZZY_INDEX *index, MESSAGE **notes, int numNotes );
+
+/* Frees the signatures of index */
+void fuzzy_freeIndex( FUZZY_INDEX *index );
+
+/* Scores every note of index against query and puts the best k in results, best first.
+ * Each term is found with bit-parallel approximate matching, and scores more the longer it
+ * is and the fewer typos it took. Terms in the note's path, notes written in the current
+ * directory and recent notes score extra. The notes are shared out among a thread per core,
+ * each keeping its best k in a heap. Returns how many results there are. */
+int fuzzy_rank( FUZZY_INDEX *index, FUZZY_QUERY *query, int k, FUZZY_RESULT *results );
+
+#endif /* FUZZY_H_ */
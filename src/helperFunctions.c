@@ -18,6 +18,8 @@
 
 #include "helperFunctions.h"
 
+#include <unistd.h> // sysconf
+
 /* Returns a pointer to a string containing the current time */
 char *current_time() {
     time_t t;
@@ -70,6 +72,45 @@ bool isInteger( char *str ) {
     return true;
 }
 
+/* Parses a date in the form YYYY-MM-DD or YYYY-MM-DD HH:MM[:SS] as local time.
+ * Returns -1 if str isn't a date. */
+time_t parseDate( char *str ) {
+    struct tm tm;
+    memset( &tm, 0, sizeof( tm ) );
+
+    int n = sscanf( str, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon,
+            &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec );
+    if ( n < 3 || n == 4 )
+        return -1;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime( &tm );
+}
+
+/* Parses a time stored by list_setTime, ie in the format ctime() produces.
+ * Returns -1 if str can't be parsed. */
+time_t parseNoteTime( char *str ) {
+    static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month[4];
+    struct tm tm;
+    memset( &tm, 0, sizeof( tm ) );
+
+    if ( sscanf( str, "%*s %3s %d %d:%d:%d %d", month, &tm.tm_mday,
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &tm.tm_year ) != 6 )
+        return -1;
+
+    char *m = strstr( months, month );
+    if ( !m )
+        return -1;
+
+    tm.tm_mon = ( m - months ) / 3;
+    tm.tm_year -= 1900;
+    tm.tm_isdst = -1;
+    return mktime( &tm );
+}
+
 /* Gets the path of users home directory and concatenates it with the data filename*/
 void getDataPath() {
     char *homeDir;
@@ -81,3 +122,33 @@ void getDataPath() {
     }
 }
 
+
+/* Runs work( arg ) on a thread per core, this thread included, but no more threads than
+ * there are jobs, and waits for them all to finish. work shares the jobs out itself,
+ * taking them with takeJob. */
+void runOnCores( void *(*work)( void * ), void *arg, int jobs ) {
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    int numThreads = cores > 1 ? cores - 1 : 0;
+    if ( numThreads > jobs - 1 )
+        numThreads = jobs > 1 ? jobs - 1 : 0;
+
+    pthread_t *threads = malloc( ( numThreads ? numThreads : 1 ) * sizeof(pthread_t) );
+    int started = 0;
+    while ( started < numThreads
+            && pthread_create( &threads[started], NULL, work, arg ) == 0 )
+        started++;
+    work( arg );
+    for ( int i = 0; i < started; i++ )
+        pthread_join( threads[i], NULL );
+    free( threads );
+}
+
+/* Returns the next of the jobs shared out by runOnCores, moving next on by step under
+ * lock. It's past the last job once they have all been taken. */
+int takeJob( pthread_mutex_t *lock, int *next, int step ) {
+    pthread_mutex_lock( lock );
+    int job = *next;
+    *next += step;
+    pthread_mutex_unlock( lock );
+    return job;
+}
@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include <string.h> //strstr
 #include <ctype.h> // tolower
@@ -65,4 +66,21 @@ void stringToLower( char str[], char newString[], int len );
 /* Determines if str is an integer *.
  * Returns true if is false if it's not. */bool isInteger( char *str );
 
+/* Parses a date in the form YYYY-MM-DD or YYYY-MM-DD HH:MM[:SS] as local time.
+ * Returns -1 if str isn't a date. */
+time_t parseDate( char *str );
+
+/* Parses a time stored by list_setTime, ie in the format ctime() produces.
+ * Returns -1 if str can't be parsed. */
+time_t parseNoteTime( char *str );
+
+/* Runs work( arg ) on a thread per core, this thread included, but no more threads than
+ * there are jobs, and waits for them all to finish. work shares the jobs out itself,
+ * taking them with takeJob. */
+void runOnCores( void *(*work)( void * ), void *arg, int jobs );
+
+/* Returns the next of the jobs shared out by runOnCores, moving next on by step under
+ * lock. It's past the last job once they have all been taken. */
+int takeJob( pthread_mutex_t *lock, int *next, int step );
+
 #endif /* HELPERFUNCTIONS_H_ */
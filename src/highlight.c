@@ -0,0 +1,250 @@
+/*
+ * highlight.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "highlight.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Words that mark the level of a log line */
+static const struct {
+    const char *word;
+    int kind;
+} levels[] = {
+    { "FATAL", HL_ERROR }, { "PANIC", HL_ERROR }, { "CRITICAL", HL_ERROR },
+    { "CRIT", HL_ERROR }, { "ERROR", HL_ERROR }, { "ERR", HL_ERROR },
+    { "SEVERE", HL_ERROR }, { "WARNING", HL_WARNING }, { "WARN", HL_WARNING },
+    { "INFO", HL_INFO }, { "NOTICE", HL_INFO }, { "NOTE", HL_INFO },
+    { "DEBUG", HL_DEBUG }, { "TRACE", HL_DEBUG },
+};
+
+/* The spans found so far in a line */
+typedef struct {
+    LINE_SPAN *spans;
+    int num;
+    int size;
+} SPANS;
+
+/* Adds the span from start up to end to found */
+static void highlight_add( SPANS *found, int start, int end, int kind ) {
+    if ( found->num == found->size ) {
+        found->size = found->size ? found->size * 2 : 8;
+        LINE_SPAN *bigger = realloc( found->spans, found->size * sizeof(LINE_SPAN) );
+        if ( !bigger ) {
+            fprintf( stderr, "Failed to allocate memory in highlight_add\n" );
+            abort();
+        }
+        found->spans = bigger;
+    }
+    found->spans[found->num].start = start;
+    found->spans[found->num].end = end;
+    found->spans[found->num].kind = kind;
+    found->num++;
+}
+
+/* Returns true if the line starts with prefix */
+static bool highlight_startsWith( LINE *line, const char *prefix ) {
+    int len = strlen( prefix );
+    return line->lSize >= len && memcmp( line->text, prefix, len ) == 0;
+}
+
+/* Returns true if msg looks like the output of diff or git, so lines starting with + and -
+ * are added and removed lines */
+bool highlight_isDiff( MESSAGE *msg ) {
+    LINE *first = msg->first;
+    return first
+            && ( highlight_startsWith( first, "diff " ) || highlight_startsWith( first, "--- " )
+                    || highlight_startsWith( first, "Index: " )
+                    || highlight_startsWith( first, "commit " )
+                    || highlight_startsWith( first, "@@ " ) );
+}
+
+/* Colours a whole line of a diff by what it does */
+static void highlight_diff( LINE *line, SPANS *found ) {
+    int kind = HL_NONE;
+    if ( highlight_startsWith( line, "+++ " ) || highlight_startsWith( line, "--- " )
+            || highlight_startsWith( line, "@@" ) || highlight_startsWith( line, "diff " )
+            || highlight_startsWith( line, "index " ) || highlight_startsWith( line, "commit " ) )
+        kind = HL_HUNK;
+    else if ( highlight_startsWith( line, "+" ) )
+        kind = HL_ADDED;
+    else if ( highlight_startsWith( line, "-" ) )
+        kind = HL_REMOVED;
+
+    if ( kind != HL_NONE )
+        highlight_add( found, 0, line->lSize, kind );
+}
+
+/* Picks out the strings, keys, numbers and literals of a line of JSON */
+static void highlight_json( LINE *line, SPANS *found ) {
+    const char *s = line->text;
+    int n = line->lSize;
+
+    for ( int i = 0; i < n; ) {
+        int j = i + 1;
+
+        if ( s[i] == '"' ) {
+            while ( j < n && s[j] != '"' )
+                j += s[j] == '\\' ? 2 : 1;
+            j = j < n ? j + 1 : n;
+
+            /* A string followed by a colon is a key */
+            int k = j;
+            while ( k < n && ( s[k] == ' ' || s[k] == '\t' ) )
+                k++;
+            highlight_add( found, i, j, k < n && s[k] == ':' ? HL_KEY : HL_STRING );
+        } else if ( isdigit( ( unsigned char ) s[i] )
+                || ( s[i] == '-' && j < n && isdigit( ( unsigned char ) s[j] ) ) ) {
+            while ( j < n && ( isdigit( ( unsigned char ) s[j] )
+                    || ( s[j] && strchr( ".eE+-", s[j] ) ) ) )
+                j++;
+            highlight_add( found, i, j, HL_NUMBER );
+        } else if ( isalpha( ( unsigned char ) s[i] ) ) {
+            while ( j < n && isalpha( ( unsigned char ) s[j] ) )
+                j++;
+            if ( ( j - i == 4 && ( !memcmp( s + i, "true", 4 ) || !memcmp( s + i, "null", 4 ) ) )
+                    || ( j - i == 5 && !memcmp( s + i, "false", 5 ) ) )
+                highlight_add( found, i, j, HL_LITERAL );
+        }
+        i = j;
+    }
+}
+
+/* Returns the kind of log level the word at s of len bytes is, or HL_NONE. Words in capitals
+ * count anywhere, others only when followed by a colon or a ], as in "error:" or "[warn]". */
+static int highlight_level( const char *s, int len, char next ) {
+    char word[16];
+    bool upper = true;
+
+    if ( len >= ( int ) sizeof( word ) )
+        return HL_NONE;
+    for ( int i = 0; i < len; i++ ) {
+        upper = upper && isupper( ( unsigned char ) s[i] );
+        word[i] = toupper( ( unsigned char ) s[i] );
+    }
+    word[len] = '\0';
+
+    if ( !upper && next != ':' && next != ']' )
+        return HL_NONE;
+    for ( size_t i = 0; i < sizeof( levels ) / sizeof( levels[0] ); i++ )
+        if ( strcmp( word, levels[i].word ) == 0 )
+            return levels[i].kind;
+    return HL_NONE;
+}
+
+/* Returns true if c can be part of a file name */
+static bool highlight_isPathChar( char c ) {
+    return isalnum( ( unsigned char ) c ) || ( c && strchr( "_./-+~", c ) );
+}
+
+/* Returns true if the text at s of len bytes looks like a file name: it has a directory
+ * or an extension starting with a letter */
+static bool highlight_isPath( const char *s, int len ) {
+    if ( len <= 0 || ( len >= 2 && s[0] == '/' && s[1] == '/' ) )
+        return false;
+    for ( int i = len - 1; i >= 0; i-- ) {
+        if ( s[i] == '/' )
+            return true;
+        if ( s[i] == '.' )
+            return i + 1 < len && isalpha( ( unsigned char ) s[i + 1] );
+    }
+    return false;
+}
+
+/* Picks out the log levels and file:line references in a line of text */
+static void highlight_text( LINE *line, SPANS *found ) {
+    const char *s = line->text;
+    int n = line->lSize, lastEnd = 0;
+
+    for ( int i = 0; i < n; ) {
+        bool wordStart = i == 0 || !( isalnum( ( unsigned char ) s[i - 1] ) || s[i - 1] == '_' );
+
+        if ( wordStart && isalpha( ( unsigned char ) s[i] ) ) {
+            int j = i;
+            while ( j < n && isalpha( ( unsigned char ) s[j] ) )
+                j++;
+            int kind = highlight_level( s + i, j - i, j < n ? s[j] : '\0' );
+            if ( kind != HL_NONE && ( j == n || !isalnum( ( unsigned char ) s[j] ) ) ) {
+                highlight_add( found, i, j, kind );
+                i = lastEnd = j;
+                continue;
+            }
+        }
+
+        /* A colon followed by a number may end a file name, as in ui.c:120 or ui.c:120:8 */
+        if ( s[i] == ':' && i + 1 < n && isdigit( ( unsigned char ) s[i + 1] ) ) {
+            int start = i;
+            while ( start > lastEnd && highlight_isPathChar( s[start - 1] ) )
+                start--;
+
+            if ( highlight_isPath( s + start, i - start ) ) {
+                int j = i + 1;
+                while ( j < n && isdigit( ( unsigned char ) s[j] ) )
+                    j++;
+                if ( j + 1 < n && s[j] == ':' && isdigit( ( unsigned char ) s[j + 1] ) )
+                    for ( j++; j < n && isdigit( ( unsigned char ) s[j] ); j++ )
+                        ;
+                highlight_add( found, start, j, HL_LOCATION );
+                i = lastEnd = j;
+                continue;
+            }
+        }
+        i++;
+    }
+}
+
+/* Returns true if line looks like JSON: it starts with an object, a string, or an array of
+ * those. Log lines often start with a [ too, as in "[debug]" or "[2026-10-19 ...]". */
+static bool highlight_isJson( LINE *line ) {
+    const char *s = line->text;
+    int n = line->lSize, i = 0;
+
+    while ( i < n && ( s[i] == ' ' || s[i] == '\t' ) )
+        i++;
+    if ( i < n && s[i] == '[' )
+        for ( i++; i < n && ( s[i] == ' ' || s[i] == '\t' || s[i] == '[' ); i++ )
+            ;
+    return i == n || s[i] == '{' || s[i] == '"' || s[i] == ']';
+}
+
+/* Finds the tokens in line the first time it's called and caches them in the line.
+ * diff says whether the line is part of a diff. Each line is lexed on its own, so only
+ * the lines that are shown are ever looked at. Returns the number of spans. */
+int highlight_line( LINE *line, bool diff ) {
+    if ( line->numSpans >= 0 )
+        return line->numSpans;
+
+    SPANS found = { NULL, 0, 0 };
+    if ( diff )
+        highlight_diff( line, &found );
+    if ( found.num == 0 ) {
+        if ( highlight_isJson( line ) )
+            highlight_json( line, &found );
+        else
+            highlight_text( line, &found );
+    }
+
+    line->spans = found.spans;
+    line->numSpans = found.num;
+    return found.num;
+}
+
+/* Returns the index of the first span of line that ends after byte. highlight_line must
+ * have been called. */
+int highlight_find( LINE *line, int byte ) {
+    int lo = 0, hi = line->numSpans;
+    while ( lo < hi ) {
+        int mid = ( lo + hi ) / 2;
+        if ( line->spans[mid].end <= byte )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
@@ -0,0 +1,45 @@
+/*
+ * highlight.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef HIGHLIGHT_H_
+#define HIGHLIGHT_H_
+
+#include <stdbool.h>
+
+#include "structures.h"
+
+/* The kinds of token the highlighter picks out */
+enum {
+    HL_NONE,
+    HL_ERROR,
+    HL_WARNING,
+    HL_INFO,
+    HL_DEBUG,
+    HL_ADDED,
+    HL_REMOVED,
+    HL_HUNK,
+    HL_KEY,
+    HL_STRING,
+    HL_NUMBER,
+    HL_LITERAL,
+    HL_LOCATION,
+    HL_NUM_KINDS
+};
+
+/* Returns true if msg looks like the output of diff or git, so lines starting with + and -
+ * are added and removed lines */
+bool highlight_isDiff( MESSAGE *msg );
+
+/* Finds the tokens in line the first time it's called and caches them in the line.
+ * diff says whether the line is part of a diff. Returns the number of spans. */
+int highlight_line( LINE *line, bool diff );
+
+/* Returns the index of the first span of line that ends after byte. highlight_line must
+ * have been called. */
+int highlight_find( LINE *line, int byte );
+
+#endif /* HIGHLIGHT_H_ */
@@ -0,0 +1,1099 @@
+/*
+ * import.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "import.h"
+#include "linkedList.h"
+#include "store.h"
+#include "stats.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Files bigger than this are split into pieces of about this size, ending at a newline */
+#define IMPORT_CHUNK_SIZE ( 4 << 20 )
+
+/* How much of a JSON Lines or CSV file is read at once */
+#define IMPORT_READ_SIZE ( 1 << 20 )
+
+/* How big a batch of records grows before it is handed over to be written */
+#define IMPORT_BATCH_SIZE ( 4 << 20 )
+
+/* How many batches can be parsed ahead of the one being written */
+#define IMPORT_BATCHES 4
+
+/* A file being imported, mapped into memory */
+typedef struct {
+    char *path;
+    char time[MAX_TIME_SIZE];
+    char *data;
+    size_t size;
+} IMPORT_FILE;
+
+/* A piece of a file, and the lines a worker split it into */
+typedef struct {
+    IMPORT_FILE *file;
+    size_t start;
+    size_t end;
+    MESSAGE *scratch;
+    LINE_BUILDER build;
+} IMPORT_CHUNK;
+
+/* Everything being imported, shared with the workers */
+typedef struct {
+    char **paths;
+    int numPaths;
+    int pathsSize;
+
+    IMPORT_FILE *files;
+    int numFiles;
+
+    IMPORT_CHUNK *chunks;
+    int numChunks;
+    int chunksSize;
+
+    /* The next chunk for a worker to take */
+    pthread_mutex_t lock;
+    int next;
+} IMPORT;
+
+/* The fields of a note a JSON key or CSV column can hold */
+enum {
+    IMPORT_OTHER, IMPORT_TEXT, IMPORT_PATH, IMPORT_TIME, IMPORT_TIMESTAMP
+};
+
+/* The id, flags and numChars that start a record */
+#define IMPORT_RECORD_HEAD ( 2 * sizeof(int) + sizeof(long) )
+
+/* Records ready to be appended to the data file */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+} IMPORT_BATCH;
+
+/* The fields of a note read from a JSON Lines or CSV record. The text goes straight into
+ * the batch, so only where it ends is kept. */
+typedef struct {
+    char path[MAX_PATH_SIZE];
+    char time[MAX_TIME_SIZE];
+    double timestamp;
+    bool hasPath;
+    bool hasTime;
+    bool hasTimestamp;
+    size_t textLen;
+} IMPORT_NOTE;
+
+/* A JSON Lines or CSV file being imported. One thread parses it into batches of records
+ * while another appends them to the data file. */
+typedef struct {
+    const char *source;
+    int fd;
+    bool csv;
+
+    /* What has been read of the input but not yet parsed, from pos up to len */
+    char *input;
+    size_t pos;
+    size_t len;
+    size_t size;
+    bool eof;
+
+    /* The line of the input the record being parsed starts on */
+    long line;
+
+    /* Which column of a CSV file holds which field, -1 for none */
+    int textCol;
+    int pathCol;
+    int timeCol;
+    int stampCol;
+
+    /* Where notes without a path or time were added from, and when */
+    char cwd[MAX_PATH_SIZE];
+    char now[MAX_TIME_SIZE];
+    time_t started;
+
+    int nextId;
+    int count;
+
+    /* What the notes parsed so far add to the data file's statistics */
+    STORE_STATS stats;
+
+    /* The batches parsed are head, the batches written are tail. The parser fills the batch
+     * at head and waits while every batch is full. */
+    IMPORT_BATCH batches[IMPORT_BATCHES];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int head;
+    int tail;
+    bool done;
+    bool failed;
+    char error[256];
+} IMPORT_RECORDS;
+
+/* Writes t to dest in the format list_setTime uses */
+static void import_formatTime( time_t t, char *dest ) {
+    struct tm tm;
+    localtime_r( &t, &tm );
+    strftime( dest, MAX_TIME_SIZE, "%a %b %e %H:%M:%S %Y", &tm );
+}
+
+/* Adds path to the files to import */
+static void import_addPath( IMPORT *import, const char *path ) {
+    if ( import->numPaths == import->pathsSize ) {
+        import->pathsSize = import->pathsSize ? import->pathsSize * 2 : 64;
+        import->paths = realloc( import->paths, import->pathsSize * sizeof(char *) );
+        if ( !import->paths ) {
+            fprintf( stderr, "Failed to allocate memory in import_addPath\n" );
+            exit( 1 );
+        }
+    }
+    import->paths[import->numPaths++] = strdup( path );
+}
+
+/* Adds the file at path, or every file under it if it's a directory. Links inside
+ * directories are not followed, so a link back up can't send us round in circles. */
+static void import_addTree( IMPORT *import, const char *path, bool follow ) {
+    struct stat st;
+    if ( ( follow ? stat( path, &st ) : lstat( path, &st ) ) != 0 ) {
+        fprintf( stderr, "Unable to read %s: %s\n", path, strerror( errno ) );
+        return;
+    }
+
+    if ( S_ISREG( st.st_mode ) ) {
+        import_addPath( import, path );
+    } else if ( S_ISDIR( st.st_mode ) ) {
+        struct dirent **entries;
+        int n = scandir( path, &entries, NULL, alphasort );
+        if ( n < 0 ) {
+            fprintf( stderr, "Unable to read %s: %s\n", path, strerror( errno ) );
+            return;
+        }
+
+        for ( int i = 0; i < n; i++ ) {
+            char *name = entries[i]->d_name;
+            if ( strcmp( name, "." ) && strcmp( name, ".." ) ) {
+                size_t len = strlen( path ) + strlen( name ) + 2;
+                char *child = malloc( len );
+                snprintf( child, len, "%s%s%s", path,
+                        path[strlen( path ) - 1] == '/' ? "" : "/", name );
+                import_addTree( import, child, false );
+                free( child );
+            }
+            free( entries[i] );
+        }
+        free( entries );
+    }
+}
+
+/* Adds the files matched by pattern, which may be a path or a glob */
+static void import_addPattern( IMPORT *import, const char *pattern ) {
+    glob_t matches;
+    int result = glob( pattern, 0, NULL, &matches );
+
+    if ( result == 0 ) {
+        for ( size_t i = 0; i < matches.gl_pathc; i++ )
+            import_addTree( import, matches.gl_pathv[i], true );
+    } else if ( access( pattern, F_OK ) == 0 ) {
+        /* A file whose name only looks like a glob */
+        import_addTree( import, pattern, true );
+    } else {
+        fprintf( stderr, "No files match %s\n", pattern );
+    }
+    globfree( &matches );
+}
+
+/* Adds the piece of file from start up to end to the chunks to split */
+static void import_addChunk( IMPORT *import, IMPORT_FILE *file, size_t start, size_t end ) {
+    if ( import->numChunks == import->chunksSize ) {
+        import->chunksSize = import->chunksSize ? import->chunksSize * 2 : 64;
+        import->chunks = realloc( import->chunks, import->chunksSize * sizeof(IMPORT_CHUNK) );
+        if ( !import->chunks ) {
+            fprintf( stderr, "Failed to allocate memory in import_addChunk\n" );
+            exit( 1 );
+        }
+    }
+
+    IMPORT_CHUNK *chunk = &import->chunks[import->numChunks++];
+    chunk->file = file;
+    chunk->start = start;
+    chunk->end = end;
+    chunk->scratch = NULL;
+}
+
+/* Maps the file at path into memory and cuts it into chunks. Returns false if it can't
+ * be read. */
+static bool import_map( IMPORT *import, IMPORT_FILE *file, const char *path ) {
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    struct stat st;
+    if ( fd < 0 || fstat( fd, &st ) != 0 ) {
+        fprintf( stderr, "Unable to read %s: %s\n", path, strerror( errno ) );
+        if ( fd >= 0 )
+            close( fd );
+        return false;
+    }
+
+    file->size = st.st_size;
+    file->data = NULL;
+    if ( file->size > 0 ) {
+        file->data = mmap( NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( file->data == MAP_FAILED ) {
+            fprintf( stderr, "Unable to map %s: %s\n", path, strerror( errno ) );
+            close( fd );
+            return false;
+        }
+        madvise( file->data, file->size, MADV_SEQUENTIAL );
+    }
+    close( fd );
+
+    /* The note is where the file is, and when it was last written */
+    char *full = realpath( path, NULL );
+    file->path = full ? full : strdup( path );
+    import_formatTime( st.st_mtime, file->time );
+
+    /* Cut big files after a newline, so no line is split between two workers */
+    size_t start = 0;
+    do {
+        size_t end = start + IMPORT_CHUNK_SIZE;
+        if ( end >= file->size ) {
+            end = file->size;
+        } else {
+            char *newline = memchr( file->data + end, '\n', file->size - end );
+            end = newline ? ( size_t ) ( newline - file->data ) + 1 : file->size;
+        }
+        import_addChunk( import, file, start, end );
+        start = end;
+    } while ( start < file->size );
+
+    return true;
+}
+
+/* Splits chunks into lines until there are none left */
+static void *import_work( void *arg ) {
+    IMPORT *import = arg;
+
+    for ( ;; ) {
+        int i = takeJob( &import->lock, &import->next, 1 );
+        if ( i >= import->numChunks )
+            return NULL;
+
+        IMPORT_CHUNK *chunk = &import->chunks[i];
+        list_init( &chunk->scratch );
+        list_buildStart( &chunk->build, chunk->scratch );
+        list_buildText( &chunk->build, chunk->file->data + chunk->start,
+                chunk->end - chunk->start );
+    }
+}
+
+/* Adds each file matched by the paths or globs in patterns as a note at the end of the list
+ * rooted at msg. Directories are imported with everything under them. Each note takes its
+ * path from its file and its time from when the file was last changed. The files are
+ * mapped and their lines split by a thread per core, in pieces so big files are shared out
+ * too. Nothing is saved, the caller saves every note in one go. Patterns that match nothing
+ * are reported and skipped. Returns the number of notes added. */
+int import_files( MESSAGE *msg, char **patterns, int count ) {
+    IMPORT import;
+    memset( &import, 0, sizeof( import ) );
+    pthread_mutex_init( &import.lock, NULL );
+
+    for ( int i = 0; i < count; i++ )
+        import_addPattern( &import, patterns[i] );
+
+    import.files = calloc( import.numPaths ? import.numPaths : 1, sizeof(IMPORT_FILE) );
+    if ( !import.files ) {
+        fprintf( stderr, "Failed to allocate memory in import_files\n" );
+        exit( 1 );
+    }
+    for ( int i = 0; i < import.numPaths; i++ ) {
+        if ( import_map( &import, &import.files[import.numFiles], import.paths[i] ) )
+            import.numFiles++;
+        free( import.paths[i] );
+    }
+    free( import.paths );
+
+    runOnCores( import_work, &import, import.numChunks );
+
+    /* Put each file's chunks back together, in order, as a note */
+    IMPORT_CHUNK *chunk = import.chunks;
+    for ( int i = 0; i < import.numFiles; i++ ) {
+        IMPORT_FILE *file = &import.files[i];
+        MESSAGE *note = list_newTail( msg );
+        snprintf( note->path, MAX_PATH_SIZE, "%s", file->path );
+        snprintf( note->time, MAX_TIME_SIZE, "%s", file->time );
+
+        LINE_BUILDER build;
+        list_buildStart( &build, note );
+        for ( ; chunk < import.chunks + import.numChunks && chunk->file == file; chunk++ ) {
+            list_buildJoin( &build, &chunk->build );
+            list_buildFinish( &chunk->build );
+            list_destroy( &chunk->scratch );
+        }
+        list_buildFinish( &build );
+
+        if ( file->data )
+            munmap( file->data, file->size );
+        free( file->path );
+    }
+
+    free( import.chunks );
+    free( import.files );
+    pthread_mutex_destroy( &import.lock );
+    return import.numFiles;
+}
+
+/* Returns the field a JSON key or CSV column called name holds */
+static int import_field( const char *name ) {
+    if ( !strcasecmp( name, "text" ) || !strcasecmp( name, "body" ) )
+        return IMPORT_TEXT;
+    if ( !strcasecmp( name, "path" ) )
+        return IMPORT_PATH;
+    if ( !strcasecmp( name, "time" ) )
+        return IMPORT_TIME;
+    if ( !strcasecmp( name, "timestamp" ) )
+        return IMPORT_TIMESTAMP;
+    return IMPORT_OTHER;
+}
+
+/* Stops the import because of problem, with the record it was found in. Returns false so the
+ * parsers can pass it on. */
+static bool import_fail( IMPORT_RECORDS *rec, const char *problem ) {
+    pthread_mutex_lock( &rec->lock );
+    if ( !rec->failed )
+        snprintf( rec->error, sizeof( rec->error ), "Error in %s at line %ld: %s", rec->source,
+                rec->line, problem );
+    rec->failed = true;
+    pthread_cond_broadcast( &rec->changed );
+    pthread_mutex_unlock( &rec->lock );
+    return false;
+}
+
+/* Reads more of the input after what hasn't been parsed yet, which is moved to the start of
+ * the buffer first. Returns false at the end of the input. */
+static bool import_read( IMPORT_RECORDS *rec ) {
+    if ( rec->eof )
+        return false;
+
+    if ( rec->pos > 0 ) {
+        memmove( rec->input, rec->input + rec->pos, rec->len - rec->pos );
+        rec->len -= rec->pos;
+        rec->pos = 0;
+    }
+
+    if ( rec->size - rec->len < IMPORT_READ_SIZE ) {
+        rec->size = rec->size ? rec->size * 2 : 2 * IMPORT_READ_SIZE;
+        rec->input = realloc( rec->input, rec->size );
+        if ( !rec->input ) {
+            fprintf( stderr, "Failed to allocate memory in import_read\n" );
+            exit( 1 );
+        }
+    }
+
+    ssize_t n;
+    do {
+        n = read( rec->fd, rec->input + rec->len, rec->size - rec->len );
+    } while ( n < 0 && errno == EINTR );
+
+    if ( n <= 0 ) {
+        if ( n < 0 )
+            import_fail( rec, strerror( errno ) );
+        rec->eof = true;
+        return false;
+    }
+    rec->len += n;
+    return true;
+}
+
+/* Finds the next record of the input: a line of JSON, or a CSV row, which can carry on over
+ * several lines inside quotes. Points record at it, without its newline, and sets lines to
+ * how many lines of the input it covers. Returns false when there are none left. */
+static bool import_nextRecord( IMPORT_RECORDS *rec, char **record, size_t *len, int *lines ) {
+    size_t scanned = 0;
+    bool quoted = false;
+
+    *lines = 1;
+    for ( ;; ) {
+        char *from = rec->input + rec->pos + scanned, *end = rec->input + rec->len;
+        char *newline = NULL;
+
+        if ( !rec->csv ) {
+            newline = memchr( from, '\n', end - from );
+        } else {
+            for ( char *c = from; c < end && !newline; c++ ) {
+                if ( *c == '"' )
+                    quoted = !quoted;
+                else if ( *c == '\n' && quoted )
+                    ( *lines )++;
+                else if ( *c == '\n' )
+                    newline = c;
+            }
+        }
+
+        if ( newline ) {
+            *record = rec->input + rec->pos;
+            *len = newline - *record;
+            rec->pos += *len + 1;
+            return true;
+        }
+
+        scanned = rec->len - rec->pos;
+        if ( !import_read( rec ) ) {
+            if ( rec->pos == rec->len )
+                return false;
+
+            /* The last record doesn't end in a newline */
+            *record = rec->input + rec->pos;
+            *len = rec->len - rec->pos;
+            rec->pos = rec->len;
+            return true;
+        }
+    }
+}
+
+/* Makes room for len more bytes at the end of batch and returns where they go */
+static char *import_reserve( IMPORT_BATCH *batch, size_t len ) {
+    if ( batch->len + len > batch->size ) {
+        size_t size = batch->size ? batch->size : 2 * IMPORT_BATCH_SIZE;
+        while ( size < batch->len + len )
+            size *= 2;
+        batch->data = realloc( batch->data, size );
+        if ( !batch->data ) {
+            fprintf( stderr, "Failed to allocate %zu bytes in import_reserve\n", size );
+            exit( 1 );
+        }
+        batch->size = size;
+    }
+    return batch->data + batch->len;
+}
+
+/* Hands the batch being filled over to be written and moves on to the next one, waiting
+ * while they are all full. Returns false if the import has failed. */
+static bool import_flush( IMPORT_RECORDS *rec ) {
+    pthread_mutex_lock( &rec->lock );
+    rec->head++;
+    pthread_cond_broadcast( &rec->changed );
+    while ( rec->head - rec->tail >= IMPORT_BATCHES && !rec->failed )
+        pthread_cond_wait( &rec->changed, &rec->lock );
+    bool ok = !rec->failed;
+    pthread_mutex_unlock( &rec->lock );
+
+    rec->batches[rec->head % IMPORT_BATCHES].len = 0;
+    return ok;
+}
+
+/* Sets field of note to the len bytes at value, cutting it short if it doesn't fit */
+static void import_setField( IMPORT_NOTE *note, int field, const char *value, size_t len ) {
+    char number[64];
+    char *end;
+
+    switch ( field ) {
+    case IMPORT_PATH:
+        snprintf( note->path, MAX_PATH_SIZE, "%.*s", ( int ) len, value );
+        note->hasPath = len > 0;
+        break;
+    case IMPORT_TIME:
+        snprintf( note->time, MAX_TIME_SIZE, "%.*s", ( int ) len, value );
+        note->hasTime = len > 0;
+        break;
+    case IMPORT_TIMESTAMP:
+        snprintf( number, sizeof( number ), "%.*s", ( int ) len, value );
+        note->timestamp = strtod( number, &end );
+        note->hasTimestamp = len > 0 && *end == '\0';
+        break;
+    }
+}
+
+/* Adds the note, whose text has been parsed into the end of batch already, as a record.
+ * Notes keep the time they were written: terminote's own times are kept as they are, dates
+ * like 2013-07-01 12:00 and timestamps are put in the same format, and only notes with
+ * neither get the current time. */
+static void import_addNote( IMPORT_RECORDS *rec, IMPORT_BATCH *batch, IMPORT_NOTE *note ) {
+    char *record = batch->data + batch->len;
+    char *body = record + IMPORT_RECORD_HEAD;
+    long numChars = note->textLen;
+    char time[MAX_TIME_SIZE];
+    NOTE_STATS stats;
+    time_t t;
+
+    /* NULs end lines, just as they do for notes piped in */
+    for ( char *nul = body; ( nul = memchr( nul, '\0', body + numChars - nul ) ); )
+        *nul = '\n';
+
+    /* Every line ends in a newline, the last one included */
+    if ( numChars > 0 )
+        body[numChars++] = '\n';
+
+    if ( note->hasTime && ( t = parseDate( note->time ) ) >= 0 ) {
+        import_formatTime( t, time );
+    } else if ( note->hasTime ) {
+        memcpy( time, note->time, MAX_TIME_SIZE );
+        t = parseNoteTime( time );
+    } else if ( note->hasTimestamp ) {
+        t = ( time_t ) note->timestamp;
+        import_formatTime( t, time );
+    } else {
+        memcpy( time, rec->now, MAX_TIME_SIZE );
+        t = rec->started;
+    }
+
+    memset( &stats, 0, sizeof( stats ) );
+    stats_count( &stats, body, numChars );
+    stats.time = t;
+    stats_add( &rec->stats, &stats );
+
+    int id = rec->nextId++, flags = 0, len;
+    memcpy( record, &id, sizeof(int) );
+    memcpy( record + sizeof(int), &flags, sizeof(int) );
+    memcpy( record + 2 * sizeof(int), &numChars, sizeof(long) );
+
+    char *tail = body + numChars;
+    const char *strings[] = { note->hasPath ? note->path : rec->cwd, time };
+    for ( int i = 0; i < 2; i++ ) {
+        len = strlen( strings[i] ) + 1;
+        memcpy( tail, &len, sizeof(int) );
+        memcpy( tail + sizeof(int), strings[i], len );
+        tail += sizeof(int) + len;
+    }
+
+    batch->len = tail - batch->data;
+    rec->count++;
+}
+
+/* Skips the spaces at pos */
+static void import_jsonSpace( const char **pos, const char *end ) {
+    while ( *pos < end && ( **pos == ' ' || **pos == '\t' || **pos == '\r' || **pos == '\n' ) )
+        ( *pos )++;
+}
+
+/* Reads the four hex digits of a \u escape at pos into code. Returns false if they aren't. */
+static bool import_jsonHex( const char **pos, const char *end, unsigned *code ) {
+    if ( end - *pos < 4 )
+        return false;
+
+    *code = 0;
+    for ( int i = 0; i < 4; i++ ) {
+        char c = ( *pos )[i];
+        *code <<= 4;
+        if ( c >= '0' && c <= '9' )
+            *code |= c - '0';
+        else if ( c >= 'a' && c <= 'f' )
+            *code |= c - 'a' + 10;
+        else if ( c >= 'A' && c <= 'F' )
+            *code |= c - 'A' + 10;
+        else
+            return false;
+    }
+    *pos += 4;
+    return true;
+}
+
+/* Decodes the JSON string at pos, just after its opening quote, into out, keeping the first
+ * max bytes of it. Sets len to how many were kept and moves pos past the closing quote.
+ * Returns false if the string is malformed. */
+static bool import_jsonString( const char **pos, const char *end, char *out, size_t max,
+        size_t *len ) {
+    const char *p = *pos;
+    size_t n = 0;
+
+    while ( p < end ) {
+        /* Copy everything up to the next quote or escape in one go */
+        const char *run = p;
+        while ( p < end && *p != '"' && *p != '\\' )
+            p++;
+        size_t runLen = ( size_t ) ( p - run ) < max - n ? ( size_t ) ( p - run ) : max - n;
+        memcpy( out + n, run, runLen );
+        n += runLen;
+
+        if ( p == end )
+            return false;
+        if ( *p == '"' ) {
+            *pos = p + 1;
+            *len = n;
+            return true;
+        }
+
+        if ( ++p == end )
+            return false;
+        unsigned code;
+        switch ( *p++ ) {
+        case '"':
+        case '\\':
+        case '/':
+            code = p[-1];
+            break;
+        case 'b':
+            code = '\b';
+            break;
+        case 'f':
+            code = '\f';
+            break;
+        case 'n':
+            code = '\n';
+            break;
+        case 'r':
+            code = '\r';
+            break;
+        case 't':
+            code = '\t';
+            break;
+        case 'u':
+            if ( !import_jsonHex( &p, end, &code ) )
+                return false;
+
+            /* Characters outside the basic plane come as a pair of surrogates */
+            if ( code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' ) {
+                const char *low = p + 2;
+                unsigned second;
+                if ( import_jsonHex( &low, end, &second ) && second >= 0xdc00 && second < 0xe000 ) {
+                    code = 0x10000 + ( ( code - 0xd800 ) << 10 ) + ( second - 0xdc00 );
+                    p = low;
+                }
+            }
+            break;
+        default:
+            return false;
+        }
+
+        /* Write the character as UTF-8 */
+        char utf8[4];
+        size_t utf8Len;
+        if ( code < 0x80 ) {
+            utf8[0] = code;
+            utf8Len = 1;
+        } else if ( code < 0x800 ) {
+            utf8[0] = 0xc0 | code >> 6;
+            utf8[1] = 0x80 | ( code & 0x3f );
+            utf8Len = 2;
+        } else if ( code < 0x10000 ) {
+            utf8[0] = 0xe0 | code >> 12;
+            utf8[1] = 0x80 | ( ( code >> 6 ) & 0x3f );
+            utf8[2] = 0x80 | ( code & 0x3f );
+            utf8Len = 3;
+        } else {
+            utf8[0] = 0xf0 | code >> 18;
+            utf8[1] = 0x80 | ( ( code >> 12 ) & 0x3f );
+            utf8[2] = 0x80 | ( ( code >> 6 ) & 0x3f );
+            utf8[3] = 0x80 | ( code & 0x3f );
+            utf8Len = 4;
+        }
+        if ( n + utf8Len <= max ) {
+            memcpy( out + n, utf8, utf8Len );
+            n += utf8Len;
+        }
+    }
+    return false;
+}
+
+/* Skips the JSON value at pos, whatever it is. Returns false if it is malformed. */
+static bool import_jsonSkip( const char **pos, const char *end ) {
+    const char *p = *pos;
+    int depth = 0;
+
+    do {
+        if ( p == end ) {
+            return false;
+        } else if ( *p == '"' ) {
+            for ( p++; p < end && *p != '"'; p++ )
+                if ( *p == '\\' )
+                    p++;
+            if ( p >= end )
+                return false;
+            p++;
+        } else if ( *p == '{' || *p == '[' ) {
+            depth++;
+            p++;
+        } else if ( *p == '}' || *p == ']' ) {
+            if ( depth-- == 0 )
+                return false;
+            p++;
+        } else if ( depth == 0 ) {
+            /* A number, true, false or null */
+            const char *start = p;
+            while ( p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t'
+                    && *p != '\r' )
+                p++;
+            if ( p == start )
+                return false;
+        } else {
+            p++;
+        }
+    } while ( depth > 0 );
+
+    *pos = p;
+    return true;
+}
+
+/* Parses a line of JSON into a note at the end of batch. Blank lines are skipped. Returns
+ * false if the line is malformed. */
+static bool import_parseJson( IMPORT_RECORDS *rec, IMPORT_BATCH *batch, const char *line,
+        size_t len ) {
+    const char *pos = line, *end = line + len;
+    IMPORT_NOTE note;
+    memset( &note, 0, sizeof( note ) );
+
+    import_jsonSpace( &pos, end );
+    if ( pos == end )
+        return true;
+    if ( *pos++ != '{' )
+        return import_fail( rec, "expected a JSON object" );
+
+    /* The text can't be longer than the line, so it's decoded straight into the record */
+    char *body = import_reserve( batch, IMPORT_RECORD_HEAD + len + 1 + 2 * sizeof(int)
+            + MAX_PATH_SIZE + MAX_TIME_SIZE ) + IMPORT_RECORD_HEAD;
+
+    import_jsonSpace( &pos, end );
+    if ( pos < end && *pos == '}' ) {
+        pos++;
+    } else {
+        for ( ;; ) {
+            char key[32], value[256];
+            size_t keyLen, valueLen;
+
+            if ( pos == end || *pos++ != '"'
+                    || !import_jsonString( &pos, end, key, sizeof( key ) - 1, &keyLen ) )
+                return import_fail( rec, "expected a key" );
+            key[keyLen] = '\0';
+
+            import_jsonSpace( &pos, end );
+            if ( pos == end || *pos++ != ':' )
+                return import_fail( rec, "expected a colon after a key" );
+            import_jsonSpace( &pos, end );
+            if ( pos == end )
+                return import_fail( rec, "expected a value" );
+
+            int field = import_field( key );
+            const char *start = pos;
+            if ( *pos == '"' && field == IMPORT_TEXT ) {
+                pos++;
+                if ( !import_jsonString( &pos, end, body, len, &note.textLen ) )
+                    return import_fail( rec, "malformed string" );
+            } else if ( *pos == '"' && field != IMPORT_OTHER ) {
+                pos++;
+                if ( !import_jsonString( &pos, end, value, sizeof( value ), &valueLen ) )
+                    return import_fail( rec, "malformed string" );
+                import_setField( &note, field, value, valueLen );
+            } else if ( !import_jsonSkip( &pos, end ) ) {
+                return import_fail( rec, "malformed value" );
+            } else if ( field != IMPORT_TEXT && !( pos - start == 4 && !strncmp( start, "null", 4 ) ) ) {
+                /* A timestamp given as a number */
+                import_setField( &note, field, start, pos - start );
+            }
+
+            import_jsonSpace( &pos, end );
+            if ( pos < end && *pos == ',' ) {
+                pos++;
+                import_jsonSpace( &pos, end );
+            } else if ( pos < end && *pos == '}' ) {
+                pos++;
+                break;
+            } else {
+                return import_fail( rec, "expected a comma or a closing brace" );
+            }
+        }
+    }
+
+    import_jsonSpace( &pos, end );
+    if ( pos != end )
+        return import_fail( rec, "more than one object on the line" );
+
+    import_addNote( rec, batch, &note );
+    return true;
+}
+
+/* Reads the CSV field at pos into out, keeping the first max bytes of it, and moves pos past
+ * it and the comma after it. Sets last if it ended the row. Returns false if it's malformed. */
+static bool import_csvField( const char **pos, const char *end, char *out, size_t max,
+        size_t *len, bool *last ) {
+    const char *p = *pos;
+    size_t n = 0, runLen;
+
+    if ( p < end && *p == '"' ) {
+        /* Quoted, with any quotes inside doubled */
+        for ( p++;; p++ ) {
+            const char *quote = memchr( p, '"', end - p );
+            if ( !quote )
+                return false;
+            runLen = quote + 1 - p;
+            if ( quote + 1 == end || quote[1] != '"' )
+                runLen--;
+            runLen = runLen < max - n ? runLen : max - n;
+            memcpy( out + n, p, runLen );
+            n += runLen;
+
+            p = quote + 1;
+            if ( p == end || *p != '"' )
+                break;
+        }
+    } else {
+        const char *comma = memchr( p, ',', end - p );
+        if ( !comma )
+            comma = end;
+        runLen = ( size_t ) ( comma - p ) < max - n ? ( size_t ) ( comma - p ) : max - n;
+        memcpy( out + n, p, runLen );
+        n += runLen;
+        p = comma;
+    }
+
+    if ( p == end )
+        *last = true;
+    else if ( *p == ',' )
+        *last = false, p++;
+    else
+        return false;
+
+    *pos = p;
+    *len = n;
+    return true;
+}
+
+/* Reads the header row of a CSV file, finding which columns hold which field. Returns false
+ * if none of them holds the text. */
+static bool import_csvHeader( IMPORT_RECORDS *rec, const char *row, size_t len ) {
+    const char *pos = row, *end = row + len;
+    bool last = false;
+
+    for ( int col = 0; !last; col++ ) {
+        char name[32];
+        size_t nameLen;
+        if ( !import_csvField( &pos, end, name, sizeof( name ) - 1, &nameLen, &last ) )
+            return import_fail( rec, "malformed header" );
+        name[nameLen] = '\0';
+
+        switch ( import_field( name ) ) {
+        case IMPORT_TEXT:
+            rec->textCol = col;
+            break;
+        case IMPORT_PATH:
+            rec->pathCol = col;
+            break;
+        case IMPORT_TIME:
+            rec->timeCol = col;
+            break;
+        case IMPORT_TIMESTAMP:
+            rec->stampCol = col;
+            break;
+        }
+    }
+
+    if ( rec->textCol < 0 )
+        return import_fail( rec, "the header has no text column" );
+    return true;
+}
+
+/* Parses a CSV row into a note at the end of batch. Returns false if it is malformed. */
+static bool import_parseCsv( IMPORT_RECORDS *rec, IMPORT_BATCH *batch, const char *row,
+        size_t len ) {
+    const char *pos = row, *end = row + len;
+    bool last = false;
+    IMPORT_NOTE note;
+    memset( &note, 0, sizeof( note ) );
+
+    /* The text can't be longer than the row, so it's copied straight into the record */
+    char *body = import_reserve( batch, IMPORT_RECORD_HEAD + len + 1 + 2 * sizeof(int)
+            + MAX_PATH_SIZE + MAX_TIME_SIZE ) + IMPORT_RECORD_HEAD;
+
+    for ( int col = 0; !last; col++ ) {
+        char value[256];
+        size_t valueLen;
+        bool ok;
+
+        if ( col == rec->textCol ) {
+            ok = import_csvField( &pos, end, body, len, &note.textLen, &last );
+        } else {
+            ok = import_csvField( &pos, end, value, sizeof( value ), &valueLen, &last );
+            if ( ok )
+                import_setField( &note, col == rec->pathCol ? IMPORT_PATH :
+                                        col == rec->timeCol ? IMPORT_TIME :
+                                        col == rec->stampCol ? IMPORT_TIMESTAMP : IMPORT_OTHER,
+                        value, valueLen );
+        }
+        if ( !ok )
+            return import_fail( rec, "malformed field" );
+    }
+
+    import_addNote( rec, batch, &note );
+    return true;
+}
+
+/* Parses the input into batches of records until it runs out or something goes wrong */
+static void *import_parse( void *arg ) {
+    IMPORT_RECORDS *rec = arg;
+    char *record;
+    size_t len;
+    int lines;
+    bool ok = true;
+
+    rec->line = 1;
+    while ( ok && import_nextRecord( rec, &record, &len, &lines ) ) {
+        IMPORT_BATCH *batch = &rec->batches[rec->head % IMPORT_BATCHES];
+        if ( len > 0 && record[len - 1] == '\r' )
+            len--;
+
+        /* Blank lines are skipped */
+        if ( len > 0 && !rec->csv )
+            ok = import_parseJson( rec, batch, record, len );
+        else if ( len > 0 && rec->textCol < 0 )
+            ok = import_csvHeader( rec, record, len );
+        else if ( len > 0 )
+            ok = import_parseCsv( rec, batch, record, len );
+
+        if ( ok && batch->len >= IMPORT_BATCH_SIZE )
+            ok = import_flush( rec );
+        rec->line += lines;
+    }
+
+    pthread_mutex_lock( &rec->lock );
+    if ( rec->batches[rec->head % IMPORT_BATCHES].len > 0 )
+        rec->head++;
+    rec->done = true;
+    pthread_cond_broadcast( &rec->changed );
+    pthread_mutex_unlock( &rec->lock );
+    return NULL;
+}
+
+/* Opens the data file to append to, giving it a header first if it is missing, in the old
+ * format or shorter than ours. The writer lock must be held. */
+static FILE *import_openStore( STORE_HEADER *header ) {
+    FILE *fp = fopen( path, "r+b" );
+    if ( fp && store_readHeader( fp, header ) && store_headerCurrent( header ) )
+        return fp;
+    if ( fp )
+        fclose( fp );
+
+    MESSAGE *msg = NULL;
+    list_init( &msg );
+    list_load( msg );
+    bool ok = store_rewrite( msg );
+    list_destroy( &msg );
+
+    if ( ok && ( fp = fopen( path, "r+b" ) ) ) {
+        if ( store_readHeader( fp, header ) )
+            return fp;
+        fclose( fp );
+    }
+    fprintf( stderr, "Failed to save data file at: %s\n", path );
+    return NULL;
+}
+
+/* Adds every note in the JSON Lines or CSV file at source, or stdin if source is -, to the
+ * end of the data file. Files that start with { are JSON Lines, with a note per line, and
+ * anything else is CSV with a header row. The text, path, time and timestamp fields are
+ * used, as -o writes them, and each note keeps its time. The notes are never loaded: one
+ * thread parses the records straight into the data file's format while this one appends
+ * them, and they are committed together at the end, so a failed import adds nothing.
+ * Returns the number of notes added, or -1 on failure. */
+int import_records( const char *source ) {
+    IMPORT_RECORDS rec;
+    memset( &rec, 0, sizeof( rec ) );
+    rec.source = strcmp( source, "-" ) ? source : "stdin";
+    rec.fd = strcmp( source, "-" ) ? open( source, O_RDONLY | O_CLOEXEC ) : STDIN_FILENO;
+    if ( rec.fd < 0 ) {
+        fprintf( stderr, "Unable to read %s: %s\n", source, strerror( errno ) );
+        return -1;
+    }
+    posix_fadvise( rec.fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+    rec.textCol = rec.pathCol = rec.timeCol = rec.stampCol = -1;
+    pthread_mutex_init( &rec.lock, NULL );
+    pthread_cond_init( &rec.changed, NULL );
+
+    /* Notes without a path or a time were added from here, now */
+    char *cwd = getcwd( NULL, 0 );
+    snprintf( rec.cwd, MAX_PATH_SIZE, "%s", cwd ? cwd : "" );
+    free( cwd );
+    rec.started = time( NULL );
+    import_formatTime( rec.started, rec.now );
+    stats_init( &rec.stats );
+
+    /* Skip any byte order mark, then look at the first thing in the file to tell JSON from CSV */
+    if ( import_read( &rec ) && rec.len >= 3 && !memcmp( rec.input, "\xef\xbb\xbf", 3 ) )
+        rec.pos = 3;
+    size_t first = 0;
+    for ( ;; ) {
+        while ( rec.pos + first < rec.len && memchr( " \t\r\n", rec.input[rec.pos + first], 4 ) )
+            first++;
+        if ( rec.pos + first < rec.len || !import_read( &rec ) )
+            break;
+    }
+    rec.csv = rec.pos + first == rec.len || rec.input[rec.pos + first] != '{';
+
+    int lockFd = store_lock();
+    STORE_HEADER header;
+    FILE *fp = import_openStore( &header );
+    if ( !fp ) {
+        rec.failed = true;
+    } else {
+        rec.nextId = header.nextId;
+        fseek( fp, store_dataEnd( fp, &header ), SEEK_SET );
+
+        pthread_t parser;
+        if ( pthread_create( &parser, NULL, import_parse, &rec ) != 0 ) {
+            fprintf( stderr, "Unable to start a thread in import_records\n" );
+            exit( 1 );
+        }
+
+        /* Write each batch as it is parsed */
+        for ( ;; ) {
+            pthread_mutex_lock( &rec.lock );
+            while ( rec.tail == rec.head && !rec.done )
+                pthread_cond_wait( &rec.changed, &rec.lock );
+            bool finished = rec.tail == rec.head, failed = rec.failed;
+            pthread_mutex_unlock( &rec.lock );
+            if ( finished )
+                break;
+
+            IMPORT_BATCH *batch = &rec.batches[rec.tail % IMPORT_BATCHES];
+            bool ok = failed || fwrite( batch->data, 1, batch->len, fp ) == batch->len;
+
+            pthread_mutex_lock( &rec.lock );
+            if ( !ok && !rec.failed ) {
+                snprintf( rec.error, sizeof( rec.error ), "Unable to write the data file at %s: %s",
+                        path, strerror( errno ) );
+                rec.failed = true;
+            }
+            rec.tail++;
+            pthread_cond_broadcast( &rec.changed );
+            pthread_mutex_unlock( &rec.lock );
+        }
+        pthread_join( parser, NULL );
+
+        /* Only move dataEnd once every record is on disk, so readers never see half of them */
+        if ( !rec.failed && rec.count > 0 ) {
+            if ( fflush( fp ) == 0 ) {
+                header.dataEnd = ftell( fp );
+                header.nextId = rec.nextId;
+                header.commits++;
+                stats_merge( &header.stats, &rec.stats );
+                store_writeHeader( fp, &header );
+            } else {
+                snprintf( rec.error, sizeof( rec.error ), "Unable to write the data file at %s: %s",
+                        path, strerror( errno ) );
+                rec.failed = true;
+            }
+        }
+        if ( fclose( fp ) != 0 && !rec.failed ) {
+            snprintf( rec.error, sizeof( rec.error ), "Unable to write the data file at %s: %s",
+                    path, strerror( errno ) );
+            rec.failed = true;
+        }
+        if ( rec.failed )
+            fprintf( stderr, "%s\nNothing was imported\n", rec.error );
+    }
+    store_unlock( lockFd );
+
+    for ( int i = 0; i < IMPORT_BATCHES; i++ )
+        free( rec.batches[i].data );
+    free( rec.input );
+    if ( rec.fd != STDIN_FILENO )
+        close( rec.fd );
+    pthread_cond_destroy( &rec.changed );
+    pthread_mutex_destroy( &rec.lock );
+    return rec.failed ? -1 : rec.count;
+}
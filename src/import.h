@@ -0,0 +1,30 @@
+/*
+ * import.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef IMPORT_H_
+#define IMPORT_H_
+
+#include "structures.h"
+
+/* Adds each file matched by the paths or globs in patterns as a note at the end of the list
+ * rooted at msg. Directories are imported with everything under them. Each note takes its
+ * path from its file and its time from when the file was last changed. The files are
+ * mapped and their lines split by a thread per core, in pieces so big files are shared out
+ * too. Nothing is saved, the caller saves every note in one go. Patterns that match nothing
+ * are reported and skipped. Returns the number of notes added. */
+int import_files( MESSAGE *msg, char **patterns, int count );
+
+/* Adds every note in the JSON Lines or CSV file at source, or stdin if source is -, to the
+ * end of the data file. Files that start with { are JSON Lines, with a note per line, and
+ * anything else is CSV with a header row. The text, path, time and timestamp fields are
+ * used, as -o writes them, and each note keeps its time. The notes are never loaded: one
+ * thread parses the records straight into the data file's format while this one appends
+ * them, and they are committed together at the end, so a failed import adds nothing.
+ * Returns the number of notes added, or -1 on failure. */
+int import_records( const char *source );
+
+#endif /* IMPORT_H_ */
@@ -5,7 +5,7 @@
  *      Author: facetoe
  */
 
-
+#define _XOPEN_SOURCE 700 // For wcwidth
 #include "line.h"
 
 #define LINE_FIRST(msg) msg->first
@@ -23,6 +23,12 @@ LINE *line_getLine() {
     tmp->lNum = 0;
     tmp->lSize = 0;
     tmp->text = NULL;
+    tmp->width = 0;
+    tmp->layoutCols = 0;
+    tmp->rows = 1;
+    tmp->breaks = NULL;
+    tmp->numSpans = -1;
+    tmp->spans = NULL;
     tmp->next = NULL;
     tmp->prev = NULL;
 
@@ -79,6 +85,7 @@ void line_insertAfter( MESSAGE *msg, int nodeNum, char *str ) {
         newLine->lSize = strLen;
         msg->numChars += newLine->lSize + 1;
         msg->numLines++;
+        line_dropIndex( msg );
     }
 }
 
@@ -115,6 +122,7 @@ void line_insertBefore( MESSAGE *msg, int nodeNum, char *str ) {
         newLine->lSize = strLen;
         msg->numChars += newLine->lSize + 1;
         msg->numLines++;
+        line_dropIndex( msg );
     }
 }
 
@@ -145,7 +153,210 @@ void line_deleteNode( MESSAGE *msg, int nodeNum ) {
     msg->numChars -= nodeToBeDeleted->lSize + 1;
 
     /* Free the memory */
-    free( nodeToBeDeleted->text );
-    free( nodeToBeDeleted );
+    line_freeLine( nodeToBeDeleted );
+    line_dropIndex( msg );
+}
+
+/* Builds the line index of msg. The last LINE is an empty placeholder and isn't counted. */
+static void line_buildIndex( MESSAGE *msg ) {
+    int n = 0, size = 64;
+    LINE **index = malloc( size * sizeof(LINE *) );
+    if ( !index ) {
+        fprintf( stderr, "Failed to allocate memory in line_buildIndex\n" );
+        abort();
+    }
+
+    for ( LINE *tmp = msg->first; tmp && tmp->next; tmp = tmp->next ) {
+        if ( n == size ) {
+            size *= 2;
+            LINE **bigger = realloc( index, size * sizeof(LINE *) );
+            if ( !bigger ) {
+                fprintf( stderr, "Failed to allocate memory in line_buildIndex\n" );
+                abort();
+            }
+            index = bigger;
+        }
+        index[n++] = tmp;
+    }
+
+    msg->lineIndex = index;
+    msg->indexedLines = n;
+}
+
+/* Returns the number of lines in msg, building its line index if needed */
+int line_count( MESSAGE *msg ) {
+    if ( !msg->lineIndex )
+        line_buildIndex( msg );
+    return msg->indexedLines;
+}
+
+/* Returns line n of msg, counting from 0, or NULL if there is no such line */
+LINE *line_at( MESSAGE *msg, int n ) {
+    if ( n < 0 || n >= line_count( msg ) )
+        return NULL;
+    return msg->lineIndex[n];
+}
+
+/* Throws away the line index of msg, it is rebuilt the next time it's needed */
+void line_dropIndex( MESSAGE *msg ) {
+    free( msg->lineIndex );
+    msg->lineIndex = NULL;
+    msg->indexedLines = 0;
 }
 
+
+/* Frees a LINE and everything it holds */
+void line_freeLine( LINE *line ) {
+    free( line->text );
+    free( line->breaks );
+    free( line->spans );
+    free( line );
+}
+
+/* Decodes the UTF-8 character at s, which has len bytes left, when it starts in column col.
+ * Sets wc to the character to show and width to the columns it takes. Tabs, control
+ * characters and bad bytes are shown as spaces or '?'. Returns the bytes used. */
+int line_decode( const char *s, int len, int col, wchar_t *wc, int *width ) {
+    unsigned char c = s[0];
+    unsigned int cp;
+    int n;
+
+    if ( c == '\t' ) {
+        *wc = ' ';
+        *width = TAB_WIDTH - col % TAB_WIDTH;
+        return 1;
+    } else if ( c < 0x80 ) {
+        *wc = c < 0x20 || c == 0x7f ? '?' : c;
+        *width = 1;
+        return 1;
+    } else if ( ( c & 0xE0 ) == 0xC0 ) {
+        n = 2;
+        cp = c & 0x1F;
+    } else if ( ( c & 0xF0 ) == 0xE0 ) {
+        n = 3;
+        cp = c & 0x0F;
+    } else if ( ( c & 0xF8 ) == 0xF0 ) {
+        n = 4;
+        cp = c & 0x07;
+    } else {
+        goto invalid;
+    }
+
+    if ( n > len )
+        goto invalid;
+    for ( int i = 1; i < n; i++ ) {
+        if ( ( s[i] & 0xC0 ) != 0x80 )
+            goto invalid;
+        cp = ( cp << 6 ) | ( s[i] & 0x3F );
+    }
+
+    /* Overlong encodings, surrogates and anything past the end of Unicode */
+    if ( cp < ( n == 2 ? 0x80 : n == 3 ? 0x800 : 0x10000 ) || ( cp >= 0xD800 && cp <= 0xDFFF )
+            || cp > 0x10FFFF )
+        goto invalid;
+
+    /* Characters the locale can't print are shown as '?' */
+    int w = wcwidth( cp );
+    *wc = w < 0 ? '?' : ( wchar_t ) cp;
+    *width = w < 0 ? 1 : w;
+    return n;
+
+    invalid:
+    *wc = '?';
+    *width = 1;
+    return 1;
+}
+
+/* Works out how line is laid out on a screen cols wide: how many rows it takes and where
+ * each starts. The layout is cached until the width changes. Returns the number of rows. */
+int line_layout( LINE *line, int cols ) {
+    if ( line->layoutCols == cols )
+        return line->rows;
+
+    free( line->breaks );
+    line->breaks = NULL;
+
+    /* Once the width is known, a line that fits doesn't need walking again */
+    if ( line->layoutCols && line->width <= cols ) {
+        line->rows = 1;
+        line->layoutCols = cols;
+        return 1;
+    }
+
+    int col = 0, rowCol = 0, rows = 1, size = 0;
+    for ( int i = 0; i < line->lSize; ) {
+        wchar_t wc;
+        int width;
+        int n = line_decode( line->text + i, line->lSize - i, col, &wc, &width );
+
+        /* Start a new row when the character doesn't fit on this one */
+        if ( col + width - rowCol > cols && col > rowCol ) {
+            if ( rows >= size ) {
+                size = size ? size * 2 : 8;
+                LINE_BREAK *bigger = realloc( line->breaks, size * sizeof(LINE_BREAK) );
+                if ( !bigger ) {
+                    fprintf( stderr, "Failed to allocate memory in line_layout\n" );
+                    abort();
+                }
+                line->breaks = bigger;
+                line->breaks[0].byte = line->breaks[0].col = 0;
+            }
+            line->breaks[rows].byte = i;
+            line->breaks[rows].col = col;
+            rows++;
+            rowCol = col;
+        }
+
+        col += width;
+        i += n;
+    }
+
+    line->width = col;
+    line->rows = rows;
+    line->layoutCols = cols;
+    return rows;
+}
+
+/* Sets byte and col to where display row row of line starts. line_layout must have been called. */
+void line_rowStart( LINE *line, int row, int *byte, int *col ) {
+    if ( row <= 0 || !line->breaks ) {
+        *byte = *col = 0;
+    } else {
+        *byte = line->breaks[row].byte;
+        *col = line->breaks[row].col;
+    }
+}
+
+/* Returns the display row of line that byte is on. line_layout must have been called. */
+int line_rowOf( LINE *line, int byte ) {
+    int lo = 0, hi = line->rows - 1;
+    if ( !line->breaks )
+        return 0;
+
+    while ( lo < hi ) {
+        int mid = ( lo + hi + 1 ) / 2;
+        if ( line->breaks[mid].byte <= byte )
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Walks line from byte, which is in column col, until reaching toCol or toByte, whichever
+ * comes first. Sets byte and col to where it stopped. */
+void line_walk( LINE *line, int *byte, int *col, int toByte, int toCol ) {
+    int i = *byte, c = *col;
+
+    while ( i < line->lSize && i < toByte ) {
+        wchar_t wc;
+        int width;
+        int n = line_decode( line->text + i, line->lSize - i, c, &wc, &width );
+        if ( c + width > toCol )
+            break;
+        c += width;
+        i += n;
+    }
+    *byte = i;
+    *col = c;
+}
@@ -11,8 +11,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <wchar.h>
 #include "structures.h"
 
+#define TAB_WIDTH 8
+
 /* Allocates memory for a new LINE node and sets default values */
 LINE *line_getLine();
 
@@ -28,4 +31,35 @@ void line_insertBefore( MESSAGE *msg, int nodeNum, char *str );
 /* Deletes nodeNum */
 void line_deleteNode( MESSAGE *msg, int nodeNum );
 
+/* Returns the number of lines in msg, building its line index if needed */
+int line_count( MESSAGE *msg );
+
+/* Returns line n of msg, counting from 0, or NULL if there is no such line */
+LINE *line_at( MESSAGE *msg, int n );
+
+/* Throws away the line index of msg, it is rebuilt the next time it's needed */
+void line_dropIndex( MESSAGE *msg );
+
+/* Frees a LINE and everything it holds */
+void line_freeLine( LINE *line );
+
+/* Decodes the UTF-8 character at s, which has len bytes left, when it starts in column col.
+ * Sets wc to the character to show and width to the columns it takes. Tabs, control
+ * characters and bad bytes are shown as spaces or '?'. Returns the bytes used. */
+int line_decode( const char *s, int len, int col, wchar_t *wc, int *width );
+
+/* Works out how line is laid out on a screen cols wide: how many rows it takes and where
+ * each starts. The layout is cached until the width changes. Returns the number of rows. */
+int line_layout( LINE *line, int cols );
+
+/* Sets byte and col to where display row row of line starts. line_layout must have been called. */
+void line_rowStart( LINE *line, int row, int *byte, int *col );
+
+/* Returns the display row of line that byte is on. line_layout must have been called. */
+int line_rowOf( LINE *line, int byte );
+
+/* Walks line from byte, which is in column col, until reaching toCol or toByte, whichever
+ * comes first. Sets byte and col to where it stopped. */
+void line_walk( LINE *line, int *byte, int *col, int toByte, int toCol );
+
 #endif /* LINE_H_ */
@@ -6,7 +6,11 @@
  */
 
 #include "linkedList.h"
+#include "store.h"
+#include "stats.h"
+#include "line.h"
 #include <assert.h>
+#include <limits.h>
 
 
 
@@ -24,7 +28,16 @@ void list_init( MESSAGE **msg ) {
     tmp->numChars = 0;
     tmp->messageNum = 0;
     tmp->totalMessages = 0;
+    tmp->id = 0;
+    tmp->offset = -1;
+    tmp->nextId = 1;
+    tmp->generation = 0;
+    tmp->dataEnd = 0;
     tmp->hasChanged = false;
+    tmp->numbersChanged = false;
+    tmp->needsRewrite = false;
+    tmp->graveyard = NULL;
+    tmp->tail = NULL;
     tmp->first = NULL;
     tmp->last = NULL;
     tmp->next = NULL;
@@ -48,6 +61,12 @@ MESSAGE *list_getNode( MESSAGE *msg ) {
     tmp->numChars = 0;
     tmp->messageNum = 0;
     tmp->totalMessages = 0;
+    tmp->id = 0;
+    tmp->offset = -1;
+    tmp->deleted = false;
+    tmp->topLine = 0;
+    tmp->lineIndex = NULL;
+    tmp->indexedLines = 0;
     tmp->first = NULL;
     tmp->last = NULL;
     tmp->next = NULL;
@@ -57,14 +76,30 @@ MESSAGE *list_getNode( MESSAGE *msg ) {
     return tmp;
 }
 
+/* Allocates a new MESSAGE node, links it to the end of the list and gives it the next id */
+MESSAGE *list_newTail( MESSAGE *msg ) {
+    assert( msg != NULL );
+
+    MESSAGE *root = msg->root;
+    msg = root->tail ? root->tail : root;
+
+    msg->next = list_getNode( msg );
+    msg->next->prev = msg;
+    msg = msg->next;
+
+    msg->id = root->nextId++;
+    root->tail = msg;
+    return msg;
+}
+
 /* Get and store path information */
 void list_setPath( MESSAGE *msg ) {
     char *path = getcwd( NULL, 0 );
     if ( path == NULL ) {
         fprintf( stderr, "Unable to retrieve path\n" );
     } else {
-        size_t path_len = strlen( path );
-        strncpy( msg->path, path, path_len );
+        /* Truncate rather than overflow, the record checks reject paths longer than this */
+        snprintf( msg->path, MAX_PATH_SIZE, "%s", path );
         free( path );
     }
 }
@@ -76,8 +111,7 @@ void list_setTime( MESSAGE *msg ) {
         perror( "Unable to retrieve time\n" );
     } else {
         strip_newline( time );
-        size_t time_len = strlen( time );
-        strncpy( msg->time, time, time_len );
+        snprintf( msg->time, MAX_TIME_SIZE, "%s", time );
     }
 }
 
@@ -158,6 +192,10 @@ void list_insertString( MESSAGE *msg, char *str ) {
         totChars += lineLen + 1;
     }
 
+    /* An empty note still ends with the empty line */
+    if ( !msg->first )
+        msg->first = line;
+
     /* Update MESSAGE statistics for this message */
     msg->last = prev;
     msg->pageTop = msg->first;
@@ -165,30 +203,173 @@ void list_insertString( MESSAGE *msg, char *str ) {
 
     msg->numChars = totChars;
     msg->numLines = numLines;
+    msg->stats.lines = numLines;
+    msg->stats.bytes = totChars;
+    msg->stats.chars = stats_characters( str, s - str ) + ( lineLen > 0 );
+    msg->stats.time = -1;
     msg->messageNum = msg->root->totalMessages + 1;
     msg->root->totalMessages++;
     msg->root->numLines += numLines;
+    msg->root->numChars += totChars;
 }
 
-/* Appends message to the end of the list */
-void list_appendMessage( MESSAGE *msg, char *str ) {
+/* Starts building the lines of msg, which must not have any yet */
+void list_buildStart( LINE_BUILDER *build, MESSAGE *msg ) {
+    memset( build, 0, sizeof(LINE_BUILDER) );
+    build->msg = msg;
+    build->line = line_getLine();
+}
 
-    assert(msg != NULL);
+/* Adds the line of len bytes at text to the note being built */
+static void list_buildLine( LINE_BUILDER *build, const char *text, int len ) {
+    LINE *line = build->line;
+
+    /* insertLine expects the pointer to be at the end of the line */
+    insertLine( &line, ( char * ) text + len, len, ++build->numLines );
+    if ( build->numLines == 1 )
+        build->msg->first = line;
+
+    line->prev = build->prev;
+    line->next = line_getLine();
+    build->prev = line;
+    build->line = line->next;
+    build->numChars += len + 1;
+    build->characters += stats_characters( text, len ) + 1;
+}
 
-    MESSAGE *prev = NULL;
+/* Keeps the len bytes at text, the start of a line, until the rest of it arrives */
+static void list_buildKeep( LINE_BUILDER *build, const char *text, size_t len ) {
+    if ( build->partialLen + len > ( size_t ) build->partialSize ) {
+        size_t size = build->partialSize ? build->partialSize : 1024;
+        while ( size < build->partialLen + len )
+            size *= 2;
+        if ( size > INT_MAX ) {
+            fprintf( stderr, "A line is too long to store\n" );
+            exit( 1 );
+        }
 
-    /* Loop to the end of the message */
-    msg = msg->root;
+        char *bigger = realloc( build->partial, size );
+        if ( !bigger ) {
+            fprintf( stderr, "Failed to allocate %zu bytes in list_buildKeep\n", size );
+            exit( 1 );
+        }
+        build->partial = bigger;
+        build->partialSize = size;
+    }
+    memcpy( build->partial + build->partialLen, text, len );
+    build->partialLen += len;
+}
 
-    for ( ; msg->next; msg = msg->next )
-        ;
+/* Adds len bytes of text to the note. Newlines and NULs end lines. */
+void list_buildText( LINE_BUILDER *build, const char *text, size_t len ) {
+    const char *end = text + len;
+
+    while ( text < end ) {
+        const char *stop = memchr( text, '\n', end - text );
+        const char *nul = memchr( text, '\0', ( stop ? stop : end ) - text );
+        if ( nul )
+            stop = nul;
+
+        /* The rest of the line is still to come */
+        if ( !stop ) {
+            list_buildKeep( build, text, end - text );
+            return;
+        }
+
+        if ( build->partialLen ) {
+            list_buildKeep( build, text, stop - text );
+            list_buildLine( build, build->partial, build->partialLen );
+            build->partialLen = 0;
+        } else {
+            if ( stop - text > INT_MAX ) {
+                fprintf( stderr, "A line is too long to store\n" );
+                exit( 1 );
+            }
+            list_buildLine( build, text, stop - text );
+        }
+        text = stop + 1;
+    }
+}
+
+/* Moves the lines part has built, from the text that comes after ours, onto the end of
+ * the note being built, renumbering them to carry on from ours. Our text must end a line
+ * where part's starts. Anything part has kept aside is kept aside by us, and part can
+ * only be thrown away after. */
+void list_buildJoin( LINE_BUILDER *build, LINE_BUILDER *part ) {
+    if ( build->partialLen ) {
+        list_buildLine( build, build->partial, build->partialLen );
+        build->partialLen = 0;
+    }
+
+    if ( part->numLines ) {
+        LINE *first = part->msg->first;
+        for ( LINE *line = first; line != part->line; line = line->next )
+            line->lNum += build->numLines;
+
+        first->prev = build->prev;
+        if ( build->prev )
+            build->prev->next = first;
+        else
+            build->msg->first = first;
+        line_freeLine( build->line );
+
+        build->line = part->line;
+        build->prev = part->prev;
+        build->numLines += part->numLines;
+        build->numChars += part->numChars;
+        build->characters += part->characters;
+
+        /* The lines are ours now */
+        part->msg->first = NULL;
+        part->line = line_getLine();
+        part->prev = NULL;
+        part->numLines = 0;
+        part->numChars = 0;
+        part->characters = 0;
+    }
+
+    if ( part->partialLen )
+        list_buildKeep( build, part->partial, part->partialLen );
+    part->partialLen = 0;
+}
+
+/* Adds the last line, if it had no newline, and fills in the note's statistics */
+void list_buildFinish( LINE_BUILDER *build ) {
+    MESSAGE *msg = build->msg;
+
+    if ( build->partialLen )
+        list_buildLine( build, build->partial, build->partialLen );
+    free( build->partial );
+    build->partial = NULL;
+    build->partialLen = build->partialSize = 0;
+
+    /* A note with nothing in it still ends with the empty line */
+    if ( !msg->first )
+        msg->first = build->line;
+
+    msg->last = build->prev;
+    msg->pageTop = msg->first;
+    msg->currentLine = msg->first;
+
+    msg->numChars = build->numChars;
+    msg->numLines = build->numLines;
+    msg->stats.lines = build->numLines;
+    msg->stats.bytes = build->numChars;
+    msg->stats.chars = build->characters;
+    msg->stats.time = -1;
+    msg->messageNum = msg->root->totalMessages + 1;
+    msg->root->totalMessages++;
+    msg->root->numLines += build->numLines;
+    msg->root->numChars += build->numChars;
+}
+
+/* Appends message to the end of the list */
+void list_appendMessage( MESSAGE *msg, char *str ) {
 
-    prev = msg;
+    assert(msg != NULL);
 
     /* Allocate and move to new node */
-    msg->next = list_getNode( msg );
-    msg->prev = prev;
-    msg = msg->next;
+    msg = list_newTail( msg );
 
     /* Get and store path and time information */
     list_setPath( msg );
@@ -198,123 +379,179 @@ void list_appendMessage( MESSAGE *msg, char *str ) {
     list_insertString( msg, str );
 }
 
-/* Writes the MESSAGE structs to a file */
-void list_writeBinary( FILE *fp, MESSAGE *msg ) {
-    assert( msg != NULL && fp != NULL );
-    msg = msg->root;
-    /* Don't write root node */
-    if ( msg->messageNum == 0 )
-        msg = msg->next;
+/* Writes the data file header. dataEnd is where the records written so far end and stats
+ * what they hold. */
+void list_writeHeader( FILE *fp, MESSAGE *msg, long dataEnd, STORE_STATS *stats ) {
+    STORE_HEADER header;
+    memset( &header, 0, sizeof( header ) );
+    header.nextId = msg->root->nextId;
+    header.generation = msg->root->generation;
+    header.dataEnd = dataEnd;
+    header.commits = msg->root->commits;
+    header.stats = *stats;
+
+    /* The list is in id order and has nothing deleted in it, so it goes out compacted */
+    header.denseEnd = dataEnd;
+    store_writeHeader( fp, &header );
+}
 
-    while ( msg ) {
-        if ( DEBUG )
-            printf( "Writing Note #%d\n", msg->messageNum );
+/* Writes a single note record at the current position of fp and remembers where it went */
+void list_writeRecord( FILE *fp, MESSAGE *msg ) {
+    if ( DEBUG )
+        printf( "Writing Note #%d\n", msg->id );
 
-        long first = msg->numChars;
-        int len;
+    long first = msg->numChars;
+    int len, flags;
 
-        /* Write numChars first so we know how many to read later */
-        fwrite( &first, sizeof( first ), 1, fp );
+    msg->offset = ftell( fp );
 
-        /* Write each line */
-        for ( LINE *line = msg->first; line->next; line = line->next ) {
-            fwrite( line->text, sizeof(char), line->lSize, fp );
+    /* Write the id and flags first. The flags live at a fixed offset so a delete
+     * only has to overwrite them rather than rewrite the file. */
+    flags = msg->deleted ? RECORD_DELETED : 0;
+    fwrite( &msg->id, sizeof(int), 1, fp );
+    fwrite( &flags, sizeof(int), 1, fp );
 
-            /* Write a newline so we can seperate the lines later */
-            fwrite( "\n", sizeof(char), 1, fp );
-        }
+    /* Write numChars so we know how many to read later */
+    fwrite( &first, sizeof( first ), 1, fp );
 
-        /* Write path */
-        len = strlen( msg->path ) + 1;
-        fwrite( &len, sizeof(int), 1, fp );
-        fwrite( msg->path, sizeof(char), len, fp );
+    /* Write each line */
+    for ( LINE *line = msg->first; line && line->next; line = line->next ) {
+        fwrite( line->text, sizeof(char), line->lSize, fp );
 
-        /* Write time */
-        len = strlen( msg->time ) + 1;
-        fwrite( &len, sizeof(int), 1, fp );
-        fwrite( msg->time, sizeof(char), len, fp );
-
-        msg = msg->next;
+        /* Write a newline so we can seperate the lines later */
+        fwrite( "\n", sizeof(char), 1, fp );
     }
+
+    /* Write path */
+    len = strlen( msg->path ) + 1;
+    fwrite( &len, sizeof(int), 1, fp );
+    fwrite( msg->path, sizeof(char), len, fp );
+
+    /* Write time */
+    len = strlen( msg->time ) + 1;
+    fwrite( &len, sizeof(int), 1, fp );
+    fwrite( msg->time, sizeof(char), len, fp );
 }
 
-/* Reads the note data from a file and places in struct */
-void list_readBinary( FILE *fp, MESSAGE *msg ) {
+/* Writes the header and all the live MESSAGE structs to a file. Tombstoned notes are dropped. */
+void list_writeBinary( FILE *fp, MESSAGE *msg ) {
     assert( msg != NULL && fp != NULL );
 
-    long first;
-    int len, note_num;
-    MESSAGE *previous = NULL;
-    note_num = 0;
+    MESSAGE *root = msg->root;
+    STORE_STATS stats;
+    stats_ofList( root, &stats );
+    root->commits++;
 
-    char path[MAX_PATH_SIZE];
-    char time[MAX_TIME_SIZE];
+    list_writeHeader( fp, root, 0, &stats );
 
-    char *errorMsg = "Error reading file, it may be corrupted. Run with the -R flag to delete the corrupted file. Sorry.\n";
+    /* Don't write root node */
+    for ( msg = root->next; msg; msg = msg->next )
+        list_writeRecord( fp, msg );
 
-    while ( fread( &first, sizeof( first ), 1, fp ) ) {
-        note_num++;
+    /* Now the records are all there, commit them */
+    root->dataEnd = ftell( fp );
+    list_writeHeader( fp, root, root->dataEnd, &stats );
+}
 
-        if ( DEBUG )
-            printf( "Reading Note #%d\n", note_num );
+/* Adds a note after msg from a record read from the data file and its body.
+ * Returns the new note. */
+MESSAGE *list_addRecord( MESSAGE *msg, RECORD *rec, char *body ) {
+    MESSAGE *previous = msg;
 
-        /* Allocate memory for new MESSAGE node */
-        msg->next = list_getNode( msg );
-        previous = msg;
+    /* Allocate memory for new MESSAGE node */
+    msg->next = list_getNode( msg );
 
-        /* Move to new node */
-        msg = msg->next;
-        msg->prev = previous;
+    /* Move to new node */
+    msg = msg->next;
+    msg->prev = previous;
+    msg->id = rec->id;
+    msg->offset = rec->offset;
 
-        /* We got the first length in the loop condition.... */
-        char *buffer = malloc( first * sizeof(char) + 1 );
-        long charDataRead = fread( buffer, sizeof(char), first, fp );
+    /* Insert the message */
+    list_insertString( msg, body );
 
-        if(charDataRead < first) {
-            fprintf(stderr, "%s", errorMsg);
-            exit(1);
-        }
-        buffer[first] = '\0';
+    memcpy( msg->path, rec->path, MAX_PATH_SIZE );
+    memcpy( msg->time, rec->time, MAX_TIME_SIZE );
+    return msg;
+}
+
+/* Moves every note in the list rooted at src to the front of the list rooted at dest,
+ * leaving src empty. The notes are renumbered lazily. */
+void list_splice( MESSAGE *dest, MESSAGE *src ) {
+    MESSAGE *first = src->next, *last = src->tail;
+    if ( !first )
+        return;
 
-        /* Update char stats. It's -1 as we don't count the terminator. */
-        msg->root->numChars += first-1;
+    for ( MESSAGE *msg = first; msg; msg = msg->next )
+        msg->root = dest;
 
-        /* Insert the message */
-        list_insertString( msg, buffer );
+    last->next = dest->next;
+    if ( dest->next )
+        dest->next->prev = last;
+    else
+        dest->tail = last;
+    dest->next = first;
+    first->prev = dest;
+
+    dest->totalMessages += src->totalMessages;
+    dest->numLines += src->numLines;
+    dest->numChars += src->numChars;
+    dest->numbersChanged = true;
+
+    src->next = src->tail = NULL;
+    src->totalMessages = src->numLines = 0;
+    src->numChars = 0;
+}
 
-        int dataRead = 0;
+/* Reads the note data from a file and places in struct. Returns false if a record is
+ * corrupt, with the notes before it in the list. */
+bool list_readBinary( FILE *fp, MESSAGE *msg ) {
+    assert( msg != NULL && fp != NULL );
 
-        /* Add path */
-        dataRead = fread( &len, sizeof( len ), 1, fp );
-        if(dataRead != 1) {
-            fprintf(stderr, "%s", errorMsg);
-            exit(1);
-        }
-        dataRead = fread( path, sizeof(char), len, fp );
-        if(dataRead != len) {
-            fprintf(stderr, "%s", errorMsg);
-            exit(1);
-        }
-        memcpy( msg->path, path, len );
-        msg->path[len] = 0;
+    int note_num = 0, status;
+    RECORD rec;
+    STORE_HEADER header;
+    char *buffer = NULL;
+
+    /* Files written before ids and tombstones existed have no header. Read those
+     * as they are and rewrite them in the new format next time we save. */
+    bool hasHeader = store_readHeader( fp, &header );
+    if ( hasHeader ) {
+        msg->root->nextId = header.nextId;
+        msg->root->generation = header.generation;
+        msg->root->commits = header.commits;
+    } else {
+        msg->root->needsRewrite = true;
+    }
 
+    /* Stop at the end of the committed records, anything past it is an append still being written */
+    long end = store_dataEnd( fp, hasHeader ? &header : NULL );
+    msg->root->dataEnd = end;
 
-        /* Add time */
-        dataRead = fread( &len, sizeof( len ), 1, fp );
-        if(dataRead != 1) {
-            fprintf(stderr, "%s", errorMsg);
-            exit(1);
-        }
-        dataRead = fread( time, sizeof(char), len, fp );
-        if(dataRead != len) {
-            fprintf(stderr, "%s", errorMsg);
-            exit(1);
+    while ( ( status = store_readRecord( fp, &rec, end, hasHeader, &buffer ) ) == STORE_OK ) {
+        note_num++;
+
+        if ( DEBUG )
+            printf( "Reading Note #%d\n", note_num );
+
+        if ( !hasHeader )
+            rec.id = msg->root->nextId;
+        if ( rec.id >= msg->root->nextId )
+            msg->root->nextId = rec.id + 1;
+
+        /* Skip over the records of deleted notes, they are reclaimed when the file is rewritten */
+        if ( rec.flags & RECORD_DELETED ) {
+            free( buffer );
+            continue;
         }
-        memcpy( msg->time, time, len );
-        msg->time[len] = 0;
 
+        msg = list_addRecord( msg, &rec, buffer );
         free( buffer );
     }
+
+    if ( msg != msg->root )
+        msg->root->tail = msg;
+    return status != STORE_CORRUPT;
 }
 
 /* Free all memory in the LINEDATA list */
@@ -328,16 +565,16 @@ void list_destroy( MESSAGE **message ) {
         line = msg->first;
         while ( line ) {
             tmpLine = line->next;
-            free( line->text );
-            free( line );
+            line_freeLine( line );
             line = tmpLine;
         }
+        line_dropIndex( msg );
         tmpMsg = msg->next;
+        if ( msg == msg->root )
+            list_freeGraveyard( msg );
         free( msg );
         msg = tmpMsg;
     }
-    free( line );
-    free( msg );
     *message = NULL;
 }
 
@@ -374,6 +611,7 @@ void list_printMessage( FILE *outStream, char *args, MESSAGE *msg ) {
         for ( char *s = args; *s; s++ ) {
             switch ( *s ) {
             case 'n':
+                list_refreshNumbers( msg );
                 fprintf( outStream, "Note Number: %d\n", msg->messageNum );
                 break;
             case 'p':
@@ -424,9 +662,7 @@ void list_lastNode( MESSAGE **msg ) {
     MESSAGE *tmp = *msg;
     if ( tmp->next == NULL )
         return;
-    for ( ; tmp->next; tmp = tmp->next )
-        ;
-    *msg = tmp;
+    *msg = tmp->root->tail;
 }
 
 /* Moves list pointer to the first node in the list.
@@ -459,18 +695,11 @@ void list_next( MESSAGE **msg ) {
 void list_previous( MESSAGE **msg ) {
     assert( *msg != NULL );
     MESSAGE *tmp = *msg;
-    int noteNum = tmp->messageNum;
-    if ( noteNum == 1 ) {
+    if ( !tmp->prev || tmp->prev == tmp->root ) {
         /* We are at the start of the list, so grab the last node */
         list_lastNode( &tmp );
     } else {
-        /* We are not at the start, so grab the first node */
-        list_firstNode( &tmp );
-
-        /* And loop through to noteNum -1, ie the previous node */
-        for ( ; tmp->next != NULL && tmp->messageNum != noteNum - 1;
-                tmp = tmp->next )
-            ;
+        tmp = tmp->prev;
     }
     *msg = tmp;
 }
@@ -484,19 +713,19 @@ MESSAGE *list_searchByNoteNum( MESSAGE *msg, int noteNum ) {
     msg = msg->root;
 
     /* Nothing to search if the list is empty */
-    if ( list_length( msg ) == 0 )
+    if ( !msg->next || noteNum < 1 )
         return NULL;
 
-    /* don't check root node */
-    msg = msg->next;
+    /* The last note is the one we're most often after */
+    if ( noteNum == msg->totalMessages )
+        return msg->tail;
 
-    for ( ; msg->messageNum != noteNum && msg->next; msg = msg->next )
+    /* Note numbers are just positions in the list, so count rather than trust stale messageNums */
+    int nNum = 1;
+    for ( msg = msg->next; msg && nNum < noteNum; msg = msg->next, nNum++ )
         ;
 
-    if ( msg->messageNum == noteNum )
-        return msg;
-    else
-        return NULL;
+    return msg;
 }
 
 /* Reorders the noteNums */
@@ -506,6 +735,7 @@ void list_orderList( MESSAGE *msg ) {
     int nNum = 1;
     /* Don't count root node */
     msg = msg->root;
+    msg->numbersChanged = false;
 
     if ( msg->next ) {
         msg = msg->next;
@@ -517,6 +747,65 @@ void list_orderList( MESSAGE *msg ) {
         printf( "Ordered list\n" );
 }
 
+/* Recalculates the noteNums if a delete has made them stale */
+void list_refreshNumbers( MESSAGE *msg ) {
+    assert( msg != NULL );
+    if ( msg->root->numbersChanged )
+        list_orderList( msg );
+}
+
+/* Frees all the LINEs of a message */
+void list_freeLines( MESSAGE *msg ) {
+    LINE *tmpLine, *line;
+    line = msg->first;
+    while ( line ) {
+        tmpLine = line->next;
+        line_freeLine( line );
+        line = tmpLine;
+    }
+    msg->first = msg->last = NULL;
+    msg->pageTop = msg->pageBot = msg->currentLine = NULL;
+    msg->topLine = 0;
+    line_dropIndex( msg );
+}
+
+/* Marks msg as deleted: unlinks it from the list, frees its lines and leaves a tombstone
+ * to be written on the next save. The remaining notes are renumbered lazily. */
+void list_deleteMessage( MESSAGE *msg ) {
+    assert( msg != NULL );
+
+    MESSAGE *root = msg->root;
+
+    /* Don't delete root node */
+    if ( msg == root || msg->deleted )
+        return;
+
+    msg->prev->next = msg->next;
+    if ( msg->next )
+        msg->next->prev = msg->prev;
+    if ( root->tail == msg )
+        root->tail = msg->prev == root ? NULL : msg->prev;
+
+    root->numLines -= msg->numLines;
+    root->numChars -= msg->numChars;
+
+    list_freeLines( msg );
+    msg->deleted = true;
+    msg->prev = NULL;
+
+    /* Only notes already in the data file need a tombstone written */
+    if ( msg->offset >= 0 ) {
+        msg->next = root->graveyard;
+        root->graveyard = msg;
+    } else {
+        free( msg );
+    }
+
+    root->totalMessages--;
+    root->numbersChanged = true;
+    root->hasChanged = true;
+}
+
 /* Delete a node by noteNum */
 void list_deleteNode( MESSAGE *msg, int noteNum ) {
 
@@ -526,43 +815,62 @@ void list_deleteNode( MESSAGE *msg, int noteNum ) {
     if ( noteNum == 0 )
         return;
 
-    msg = msg->root;
-
     MESSAGE *nodeToBeDeleted;
-    LINE *tmpLine, *line;
-
     if ( ( nodeToBeDeleted = list_searchByNoteNum( msg, noteNum ) ) == NULL ) {
         fprintf( stderr, "Unable to delete node\n" );
         return;
-    } else {
+    }
 
-        if ( !nodeToBeDeleted->prev ) {
-            msg->root = nodeToBeDeleted->next;
-        } else {
-            nodeToBeDeleted->prev->next = nodeToBeDeleted->next;
-        }
+    list_deleteMessage( nodeToBeDeleted );
+}
 
-        if ( !nodeToBeDeleted->next ) {
-            for (; msg->next ; msg = msg->next)
-                ;
-            msg = nodeToBeDeleted->prev;
-        } else {
-            nodeToBeDeleted->next->prev = nodeToBeDeleted->prev;
+/* Deletes notes from noteNum "from" to "to" inclusive in a single pass.
+ * Returns the number of notes deleted. */
+int list_deleteRange( MESSAGE *msg, int from, int to ) {
+    assert( msg != NULL );
+
+    MESSAGE *tmp;
+    int nNum = 1, deleted = 0;
+
+    if ( from < 1 )
+        from = 1;
+
+    for ( msg = msg->root->next; msg && nNum <= to; msg = tmp, nNum++ ) {
+        tmp = msg->next;
+        if ( nNum >= from ) {
+            list_deleteMessage( msg );
+            deleted++;
         }
     }
+    return deleted;
+}
 
-    line = nodeToBeDeleted->first;
-    while (line) {
-        tmpLine = line->next;
-        free(line->text);
-        free(line);
-        line = tmpLine;
-    }
-    free(line);
+/* Deletes every note for which match returns true in a single pass.
+ * Returns the number of notes deleted. */
+int list_deleteMatching( MESSAGE *msg, bool (*match)( MESSAGE *, void * ), void *arg ) {
+    assert( msg != NULL && match != NULL );
+
+    MESSAGE *tmp;
+    int deleted = 0;
 
-    msg->root->totalMessages--;
+    for ( msg = msg->root->next; msg; msg = tmp ) {
+        tmp = msg->next;
+        if ( match( msg, arg ) ) {
+            list_deleteMessage( msg );
+            deleted++;
+        }
+    }
+    return deleted;
+}
 
-    list_orderList(msg);
+/* Frees the tombstones that have been written to the data file */
+void list_freeGraveyard( MESSAGE *root ) {
+    MESSAGE *tmp;
+    while ( root->graveyard ) {
+        tmp = root->graveyard->next;
+        free( root->graveyard );
+        root->graveyard = tmp;
+    }
 }
 
 /* Deletes all nodes except for the root node */
@@ -591,16 +899,23 @@ void list_deleteAll( MESSAGE **message ) {
             printf( "Freeing Message #%d\n", msg->messageNum );
         while ( line ) {
             tmpLine = line->next;
-            free( line->text );
-            free( line );
+            line_freeLine( line );
             line = tmpLine;
         }
+        line_dropIndex( msg );
         tmpMsg = msg->next;
         free( msg );
         msg = tmpMsg;
     }
     root->next = NULL;
+    root->tail = NULL;
     root->totalMessages = 0;
+    root->numLines = 0;
+    root->numChars = 0;
+
+    /* Nothing left worth keeping, so rewriting is cheaper than a tombstone per note */
+    list_freeGraveyard( root );
+    root->needsRewrite = true;
     *message = root;
 }
 
@@ -614,14 +929,22 @@ void list_load( MESSAGE *msg ) {
     FILE *fp;
 
     if ( file_exists( path ) && ( fp = fopen( path, "rb" ) ) != NULL ) {
-        list_readBinary( fp, msg );
+        bool ok = list_readBinary( fp, msg );
         fclose( fp );
+        if ( !ok ) {
+            fprintf( stderr, "Error reading file, it may be corrupted. Run with the -R flag to "
+                    "delete the corrupted file. Sorry.\n" );
+            exit( 1 );
+        }
         return;
     } else {
         fprintf( stderr,
                 "Error loading data file at: %s\nAttempting to create one...\n",
                 path );
 
+        /* The new file has no header yet, so the first save has to write everything */
+        msg->root->needsRewrite = true;
+
         fp = fopen( path, "wb" );
         if ( fp != NULL ) {
             fprintf( stderr, "Successfully created file\n" );
@@ -635,39 +958,159 @@ void list_load( MESSAGE *msg ) {
     }
 }
 
-/* Attempts to save the list at path. */
-void list_save( MESSAGE *msg ) {
+/* Writes only what changed since the list was loaded: tombstones for deleted notes
+ * and records for new ones, taking them out of and adding them to the statistics in the
+ * header. The writer lock must be held. Returns how many of the deleted notes someone else
+ * had deleted already, or -1 if the file couldn't be opened or has to be rewritten. */
+int list_saveChanges( MESSAGE *msg ) {
+    MESSAGE *root = msg->root;
+    STORE_HEADER header;
+
+    FILE *fp = fopen( path, "r+b" );
+    if ( !fp )
+        return -1;
+
+    if ( !store_readHeader( fp, &header ) ) {
+        fclose( fp );
+        return -1;
+    }
+
+    /* An older header is too short to hold everything ours does. Compacting the file gives
+     * it a new one without losing notes others have added since we loaded, and our records
+     * are found again below like after any other compaction. */
+    if ( !store_headerCurrent( &header ) ) {
+        fclose( fp );
+        COMPACT_STATS compacted;
+        if ( !store_compactLocked( 0, &compacted ) || !( fp = fopen( path, "r+b" ) ) )
+            return -1;
+        if ( !store_readHeader( fp, &header ) ) {
+            fclose( fp );
+            return -1;
+        }
+    }
+
+    /* New notes are always at the end of the list, and their records go at the end of the file */
+    MESSAGE *tail = NULL;
+    for ( MESSAGE *tmp = root->tail; tmp && tmp != root && tmp->offset < 0; tmp = tmp->prev )
+        tail = tmp;
+
+    /* The file has been compacted or rewritten since we loaded it, so find our records again */
+    int alreadyDeleted = 0;
+    if ( header.generation != root->generation )
+        alreadyDeleted = store_relocate( fp, &header, root );
+
+    /* Someone else may have added notes since we loaded, make sure our ids are still unused.
+     * Ours were handed out from where nextId was when we loaded, so check the first of them
+     * rather than nextId, which has already moved past them. */
+    if ( tail && header.nextId > tail->id ) {
+        root->nextId = header.nextId;
+        for ( MESSAGE *tmp = tail; tmp; tmp = tmp->next )
+            tmp->id = root->nextId++;
+    } else if ( header.nextId > root->nextId ) {
+        root->nextId = header.nextId;
+    }
+
+    /* Flip the deleted flag of each tombstone in place. A note someone else has deleted
+     * already is left alone, so it isn't taken out of the statistics twice. */
+    RECORD rec;
+    long end = store_dataEnd( fp, &header );
+    MESSAGE **dead = &root->graveyard;
+    while ( *dead ) {
+        fseek( fp, ( *dead )->offset, SEEK_SET );
+        if ( store_readRecord( fp, &rec, end, true, NULL ) != STORE_OK
+                || ( rec.flags & RECORD_DELETED ) ) {
+            MESSAGE *tmp = *dead;
+            *dead = tmp->next;
+            free( tmp );
+            alreadyDeleted++;
+            continue;
+        }
+        rec.flags |= RECORD_DELETED;
+        fseek( fp, rec.offset + sizeof(int), SEEK_SET );
+        fwrite( &rec.flags, sizeof(int), 1, fp );
+
+        /* Compaction only rewrites the compacted part once enough of it is dead */
+        if ( rec.offset < header.denseEnd )
+            header.deadDense += rec.size;
+        dead = &( *dead )->next;
+    }
+    bool lostExtreme = stats_removeNotes( &header.stats, root->graveyard );
+    list_freeGraveyard( root );
+
+    if ( tail )
+        stats_addNotes( &header.stats, tail );
+
+    fseek( fp, store_dataEnd( fp, &header ), SEEK_SET );
+    for ( ; tail; tail = tail->next )
+        list_writeRecord( fp, tail );
+
+    /* Only move dataEnd once the records are on disk, so readers never see half a note */
+    fflush( fp );
+    header.dataEnd = ftell( fp );
+
+    /* The oldest or newest note went. If nobody else has written since we last looked, the
+     * list holds every note in the file, otherwise look through the record headers. */
+    if ( lostExtreme && header.commits == root->commits )
+        stats_listTimes( root, &header.stats );
+    else if ( lostExtreme )
+        stats_scan( fp, header.headerSize, header.dataEnd, true, &header.stats, true );
+    root->commits = ++header.commits;
+    header.nextId = root->nextId;
+    store_writeHeader( fp, &header );
+    root->dataEnd = header.dataEnd;
+
+    fclose( fp );
+    return alreadyDeleted;
+}
+
+/* Attempts to save the list at path. Returns false if it couldn't be saved, or if notes
+ * it deleted had already been deleted by someone else. */
+bool list_save( MESSAGE *msg ) {
     assert( msg != NULL );
 
     if(!msg->root->hasChanged)
-        return;
+        return true;
+
+    int lockFd = store_lock();
+    bool ok = list_saveLocked( msg );
+    store_unlock( lockFd );
+    return ok;
+}
+
+/* Saves the list like list_save, for a caller that already holds the writer lock */
+bool list_saveLocked( MESSAGE *msg ) {
+    assert( msg != NULL );
+
+    if(!msg->root->hasChanged)
+        return true;
 
     if ( DEBUG )
         printf( "Saving list at: %s\n", path );
 
-    FILE *fp = NULL;
-    if ( file_exists( path ) && ( fp = fopen( path, "wb" ) ) != NULL ) {
-        list_writeBinary( fp, msg );
-        fclose( fp );
-        return;
+    int alreadyDeleted = msg->root->needsRewrite ? -1 : list_saveChanges( msg );
+    if ( alreadyDeleted < 0 ) {
+        if ( !file_exists( path ) )
+            fprintf( stderr, "Error loading data file at: %s\nAttempting to create one...\n",
+                    path );
 
-    } else {
-        fprintf( stderr,
-                "Error loading data file at: %s\nAttempting to create one...\n",
-                path );
+        if ( !store_rewrite( msg ) ) {
+            fprintf( stderr, "Failed to save data file at: %s\n", path );
+            return false;
+        }
 
-        fp = fopen( path, "wb" );
-        if ( fp != NULL ) {
-            fprintf( stderr, "Successfully created file\n" );
-            list_writeBinary( fp, msg );
-            fclose( fp );
-            return;
+        /* A full rewrite drops the tombstones */
+        list_freeGraveyard( msg->root );
+        msg->root->needsRewrite = false;
+    }
 
-        } else {
-            fprintf( stderr, "Failed to create file\n" );
-            return;
-        }
+    msg->root->hasChanged = false;
+
+    if ( alreadyDeleted > 0 ) {
+        fprintf( stderr, "Error: %d of the notes deleted had already been deleted by someone "
+                "else\n", alreadyDeleted );
+        return false;
     }
+    return true;
 }
 
 /* Searches the listNode's message for substring. Returns true if it does,
@@ -682,4 +1125,14 @@ bool list_messageHasSubstring( MESSAGE *msg, char *subStr ) {
     return false;
 }
 
+/* Predicate for list_deleteMatching: true if the message contains the string arg */
+bool list_matchSubstring( MESSAGE *msg, void *arg ) {
+    return list_messageHasSubstring( msg, ( char * ) arg );
+}
 
+/* Predicate for list_deleteMatching: true if the message was written within the TIME_RANGE arg */
+bool list_matchTimeRange( MESSAGE *msg, void *arg ) {
+    TIME_RANGE *range = arg;
+    long t = parseNoteTime( msg->time );
+    return t >= 0 && t >= range->from && t < range->to;
+}
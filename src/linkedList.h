@@ -33,6 +33,9 @@ void list_init( MESSAGE **msg );
 /* Returns a new MESSAGE node */
 MESSAGE *list_getNode( MESSAGE *msg );
 
+/* Allocates a new MESSAGE node, links it to the end of the list and gives it the next id */
+MESSAGE *list_newTail( MESSAGE *msg );
+
 /* Get and store path information */
 void list_setPath(MESSAGE *msg);
 
@@ -45,10 +48,60 @@ void insertLine( LINE **l, char *s, int lineLen, int numLines );
 /* Inserts a string into a MESSAGE struct */
 void list_insertString( MESSAGE *msg, char *str );
 
-/* Reads the note data from a file and places in struct */
-void list_readBinary( FILE *fp, MESSAGE *msg );
+/* Builds the lines of a note from text that arrives a block at a time. Only the start of
+ * a line whose end hasn't arrived yet is kept aside. */
+typedef struct {
+    MESSAGE *msg;
+
+    /* The empty line at the end, which the next line goes in, and the line before it */
+    LINE *line;
+    LINE *prev;
+
+    char *partial;
+    int partialLen;
+    int partialSize;
+
+    /* numChars counts bytes, characters UTF-8 characters, newlines included in both */
+    int numLines;
+    long numChars;
+    long characters;
+} LINE_BUILDER;
+
+/* Starts building the lines of msg, which must not have any yet */
+void list_buildStart( LINE_BUILDER *build, MESSAGE *msg );
+
+/* Adds len bytes of text to the note. Newlines and NULs end lines. */
+void list_buildText( LINE_BUILDER *build, const char *text, size_t len );
+
+/* Moves the lines part has built, from the text that comes after ours, onto the end of
+ * the note being built, renumbering them to carry on from ours. Our text must end a line
+ * where part's starts. Anything part has kept aside is kept aside by us, and part can
+ * only be thrown away after. */
+void list_buildJoin( LINE_BUILDER *build, LINE_BUILDER *part );
+
+/* Adds the last line, if it had no newline, and fills in the note's statistics */
+void list_buildFinish( LINE_BUILDER *build );
+
+/* Reads the note data from a file and places in struct. Returns false if a record is
+ * corrupt, with the notes before it in the list. */
+bool list_readBinary( FILE *fp, MESSAGE *msg );
+
+/* Adds a note after msg from a record read from the data file and its body.
+ * Returns the new note. */
+MESSAGE *list_addRecord( MESSAGE *msg, RECORD *rec, char *body );
+
+/* Moves every note in the list rooted at src to the front of the list rooted at dest,
+ * leaving src empty. The notes are renumbered lazily. */
+void list_splice( MESSAGE *dest, MESSAGE *src );
+
+/* Writes the data file header. dataEnd is where the records written so far end and stats
+ * what they hold. */
+void list_writeHeader( FILE *fp, MESSAGE *msg, long dataEnd, STORE_STATS *stats );
 
-/* Writes the MESSAGE structs to a file */
+/* Writes a single note record at the current position of fp and remembers where it went */
+void list_writeRecord( FILE *fp, MESSAGE *msg );
+
+/* Writes the header and all the live MESSAGE structs to a file. Tombstoned notes are dropped. */
 void list_writeBinary( FILE *fp, MESSAGE *msg );
 
 /* Free all memory in the LINEDATA list */
@@ -94,21 +147,58 @@ MESSAGE *list_searchByNoteNum( MESSAGE *msg, int noteNum );
 /* Reorders the noteNums */
 void list_orderList( MESSAGE *msg );
 
+/* Recalculates the noteNums if a delete has made them stale */
+void list_refreshNumbers( MESSAGE *msg );
+
+/* Frees all the LINEs of a message */
+void list_freeLines( MESSAGE *msg );
+
+/* Frees the tombstones that have been written to the data file */
+void list_freeGraveyard( MESSAGE *root );
+
+/* Marks msg as deleted: unlinks it from the list, frees its lines and leaves a tombstone
+ * to be written on the next save. The remaining notes are renumbered lazily. */
+void list_deleteMessage( MESSAGE *msg );
+
 /* Delete a node by noteNum */
 void list_deleteNode( MESSAGE *msg, int noteNum );
 
+/* Deletes notes from noteNum "from" to "to" inclusive in a single pass.
+ * Returns the number of notes deleted. */
+int list_deleteRange( MESSAGE *msg, int from, int to );
+
+/* Deletes every note for which match returns true in a single pass.
+ * Returns the number of notes deleted. */
+int list_deleteMatching( MESSAGE *msg, bool (*match)( MESSAGE *, void * ), void *arg );
+
 /* Deletes all nodes except for the root node */
 void list_deleteAll( MESSAGE **message );
 
 /* Attempts to read a saved list from path. If no file is found, attempts to create one.*/
 void list_load( MESSAGE *msg );
 
-/* Attempts to save the list at path. */
-void list_save( MESSAGE *msg );
+/* Writes only what changed since the list was loaded: tombstones for deleted notes
+ * and records for new ones, taking them out of and adding them to the statistics in the
+ * header. The writer lock must be held. Returns how many of the deleted notes someone else
+ * had deleted already, or -1 if the file couldn't be opened or has to be rewritten. */
+int list_saveChanges( MESSAGE *msg );
+
+/* Attempts to save the list at path. Returns false if it couldn't be saved, or if notes
+ * it deleted had already been deleted by someone else. */
+bool list_save( MESSAGE *msg );
+
+/* Saves the list like list_save, for a caller that already holds the writer lock */
+bool list_saveLocked( MESSAGE *msg );
 
 /* Searches the listNode's message for substring. Returns true if it does,
  * false if not. */
 bool list_messageHasSubstring( MESSAGE *msg, char *subStr );
 
+/* Predicate for list_deleteMatching: true if the message contains the string arg */
+bool list_matchSubstring( MESSAGE *msg, void *arg );
+
+/* Predicate for list_deleteMatching: true if the message was written within the TIME_RANGE arg */
+bool list_matchTimeRange( MESSAGE *msg, void *arg );
+
 
 #endif /* LINKEDLIST_H_ */
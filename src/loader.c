@@ -0,0 +1,224 @@
+/*
+ * loader.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "loader.h"
+#include "linkedList.h"
+#include "store.h"
+#include "event.h"
+
+/* Returns how many percent of the way through end position is */
+static int loader_percent( long position, long end ) {
+    return end > 0 ? position * 100 / end : 0;
+}
+
+/* Sets the loader's state and progress, and tells the UI if there is anything new to show */
+static void loader_setProgress( LOADER *loader, int state, long position, long end ) {
+    pthread_mutex_lock( &loader->lock );
+    bool changed = state != loader->state
+            || loader_percent( position, end ) != loader_percent( loader->position, loader->end );
+    loader->state = state;
+    loader->position = position;
+    loader->end = end;
+    pthread_mutex_unlock( &loader->lock );
+
+    if ( changed )
+        event_post( EVENT_LOADER );
+}
+
+/* Gives the id a record read from a file without a header would have been given, and
+ * keeps nextId ahead of every id seen */
+static void loader_assignId( RECORD *rec, bool hasHeader, int *nextId ) {
+    if ( !hasHeader )
+        rec->id = *nextId;
+    if ( rec->id >= *nextId )
+        *nextId = rec->id + 1;
+}
+
+/* Finds the newest note by skipping from record to record without reading the bodies,
+ * then reads it and every other note */
+static void *loader_run( void *arg ) {
+    LOADER *loader = arg;
+    MESSAGE *newest = NULL, *rest = NULL;
+    STORE_HEADER header;
+    RECORD rec;
+    char *buffer = NULL;
+    int status, nextId = 1;
+
+    FILE *fp = fopen( path, "rb" );
+    if ( !fp ) {
+        loader_setProgress( loader, LOADER_FAILED, 0, 0 );
+        return NULL;
+    }
+
+    list_init( &newest );
+    list_init( &rest );
+
+    bool hasHeader = store_readHeader( fp, &header );
+    if ( hasHeader )
+        nextId = header.nextId;
+    long start = ftell( fp );
+    long end = store_dataEnd( fp, hasHeader ? &header : NULL );
+
+    /* First pass: find the last record that isn't deleted */
+    long newestOffset = -1;
+    int newestId = 0, count = 0;
+    while ( !atomic_load( &loader->cancelled )
+            && ( status = store_readRecord( fp, &rec, end, hasHeader, NULL ) ) == STORE_OK ) {
+        loader_assignId( &rec, hasHeader, &nextId );
+        if ( !( rec.flags & RECORD_DELETED ) ) {
+            newestOffset = rec.offset;
+            newestId = rec.id;
+        }
+        if ( ++count % 1024 == 0 )
+            loader_setProgress( loader, LOADER_INDEXING, ftell( fp ) - start, end - start );
+    }
+    if ( atomic_load( &loader->cancelled ) || status == STORE_CORRUPT )
+        goto failed;
+
+    /* The header details go with the newest note so the list can be saved from then on */
+    newest->nextId = nextId;
+    newest->generation = hasHeader ? header.generation : 0;
+    newest->dataEnd = end;
+    newest->commits = hasHeader ? header.commits : 0;
+    newest->needsRewrite = !hasHeader;
+
+    if ( newestOffset >= 0 ) {
+        fseek( fp, newestOffset, SEEK_SET );
+        if ( store_readRecord( fp, &rec, end, hasHeader, &buffer ) != STORE_OK )
+            goto failed;
+        rec.id = newestId;
+        newest->tail = list_addRecord( newest, &rec, buffer );
+        free( buffer );
+    }
+
+    pthread_mutex_lock( &loader->lock );
+    loader->newest = newest;
+    loader->newestReady = true;
+    loader->state = LOADER_LOADING;
+    loader->position = 0;
+    pthread_mutex_unlock( &loader->lock );
+    event_post( EVENT_LOADER );
+    newest = NULL;
+
+    /* Second pass: read everything else */
+    MESSAGE *msg = rest;
+    nextId = hasHeader ? header.nextId : 1;
+    fseek( fp, start, SEEK_SET );
+    count = 0;
+    while ( !atomic_load( &loader->cancelled )
+            && ( status = store_readRecord( fp, &rec, end, hasHeader, &buffer ) ) == STORE_OK ) {
+        loader_assignId( &rec, hasHeader, &nextId );
+        if ( !( rec.flags & RECORD_DELETED ) && rec.offset != newestOffset )
+            msg = list_addRecord( msg, &rec, buffer );
+        free( buffer );
+
+        if ( ++count % 256 == 0 )
+            loader_setProgress( loader, LOADER_LOADING, ftell( fp ) - start, end - start );
+    }
+    if ( atomic_load( &loader->cancelled ) || status == STORE_CORRUPT )
+        goto failed;
+
+    if ( msg != rest )
+        rest->tail = msg;
+    fclose( fp );
+
+    pthread_mutex_lock( &loader->lock );
+    loader->rest = rest;
+    loader->state = LOADER_DONE;
+    pthread_mutex_unlock( &loader->lock );
+    event_post( EVENT_LOADER );
+    return NULL;
+
+    failed:
+    fclose( fp );
+    if ( newest )
+        list_destroy( &newest );
+    list_destroy( &rest );
+    loader_setProgress( loader, LOADER_FAILED, 0, 0 );
+    return NULL;
+}
+
+/* Starts loading the data file at path in the background */
+void loader_start( LOADER *loader ) {
+    memset( loader, 0, sizeof( *loader ) );
+    atomic_init( &loader->cancelled, false );
+    pthread_mutex_init( &loader->lock, NULL );
+    loader->state = LOADER_INDEXING;
+
+    if ( pthread_create( &loader->thread, NULL, loader_run, loader ) == 0 )
+        loader->running = true;
+    else
+        loader_run( loader );
+}
+
+/* Returns the loader's state and sets percent to how far through the current pass it is */
+int loader_progress( LOADER *loader, int *percent ) {
+    pthread_mutex_lock( &loader->lock );
+    int state = loader->state;
+    if ( percent )
+        *percent = loader_percent( loader->position, loader->end );
+    pthread_mutex_unlock( &loader->lock );
+    return state;
+}
+
+/* If the newest note has been read, moves it into the list rooted at root along with the
+ * details from the data file header and returns true */
+bool loader_takeNewest( LOADER *loader, MESSAGE *root ) {
+    pthread_mutex_lock( &loader->lock );
+    MESSAGE *newest = loader->newestReady ? loader->newest : NULL;
+    loader->newest = NULL;
+    pthread_mutex_unlock( &loader->lock );
+
+    if ( !newest )
+        return false;
+
+    root->nextId = newest->nextId;
+    root->generation = newest->generation;
+    root->dataEnd = newest->dataEnd;
+    root->commits = newest->commits;
+    root->needsRewrite = newest->needsRewrite;
+    list_splice( root, newest );
+    list_destroy( &newest );
+    return true;
+}
+
+/* If the load has finished, moves the rest of the notes in front of those already in the
+ * list rooted at root and returns true */
+bool loader_finish( LOADER *loader, MESSAGE *root ) {
+    pthread_mutex_lock( &loader->lock );
+    MESSAGE *rest = loader->state == LOADER_DONE ? loader->rest : NULL;
+    loader->rest = NULL;
+    pthread_mutex_unlock( &loader->lock );
+
+    if ( !rest )
+        return false;
+
+    /* The newest note always comes before the rest are done */
+    loader_takeNewest( loader, root );
+    list_splice( root, rest );
+    list_destroy( &rest );
+
+    if ( loader->running )
+        pthread_join( loader->thread, NULL );
+    loader->running = false;
+    loader->state = LOADER_IDLE;
+    return true;
+}
+
+/* Tells the loader to give up and waits for it. Notes not yet handed over are thrown away. */
+void loader_cancel( LOADER *loader ) {
+    if ( !loader->running )
+        return;
+    atomic_store( &loader->cancelled, true );
+    pthread_join( loader->thread, NULL );
+    loader->running = false;
+
+    if ( loader->newest )
+        list_destroy( &loader->newest );
+    if ( loader->rest )
+        list_destroy( &loader->rest );
+}
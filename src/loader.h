@@ -0,0 +1,66 @@
+/*
+ * loader.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "structures.h"
+
+/* What the loader is doing */
+enum {
+    LOADER_IDLE, LOADER_INDEXING, LOADER_LOADING, LOADER_DONE, LOADER_FAILED
+};
+
+/* Loads the data file on a background thread. The newest note is read first and handed
+ * over on its own, then the rest follow in one go once they have all been read. The UI is
+ * woken with EVENT_LOADER whenever there is something new to show. */
+typedef struct {
+    pthread_t thread;
+    bool running;
+
+    /* Set by the UI thread to tell the loader thread to give up */
+    atomic_bool cancelled;
+
+    /* Everything below is shared with the loader thread and guarded by lock */
+    pthread_mutex_t lock;
+    int state;
+
+    /* How far through the data file the current pass is */
+    long position;
+    long end;
+
+    /* A list holding just the newest note, with the header of the data file in its root.
+     * Set once the newest note has been read, until it's taken with loader_takeNewest. */
+    MESSAGE *newest;
+    bool newestReady;
+
+    /* A list holding every other note once they have all been read */
+    MESSAGE *rest;
+} LOADER;
+
+/* Starts loading the data file at path in the background */
+void loader_start( LOADER *loader );
+
+/* Returns the loader's state and sets percent to how far through the current pass it is */
+int loader_progress( LOADER *loader, int *percent );
+
+/* If the newest note has been read, moves it into the list rooted at root along with the
+ * details from the data file header and returns true */
+bool loader_takeNewest( LOADER *loader, MESSAGE *root );
+
+/* If the load has finished, moves the rest of the notes in front of those already in the
+ * list rooted at root and returns true */
+bool loader_finish( LOADER *loader, MESSAGE *root );
+
+/* Tells the loader to give up and waits for it. Notes not yet handed over are thrown away. */
+void loader_cancel( LOADER *loader );
+
+#endif /* LOADER_H_ */
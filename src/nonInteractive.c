@@ -6,7 +6,21 @@
  */
 
 #include "nonInteractive.h"
+#include "notebook.h"
+#include "server.h"
+#include "store.h"
+#include "export.h"
+#include "fuzzy.h"
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+/* How much is read from stdin or a command at once */
+#define READ_BLOCK_SIZE ( 1 << 20 )
+
+extern char **environ;
 
 /* Prints usage */
 void printUsage( FILE *outStream ) {
@@ -20,19 +34,57 @@ void printUsage( FILE *outStream ) {
                     " -v: Print the version and quit.\n"
                     " -P: \"Pops\" the last note, ie, prints the last note and then deletes it.\n"
                     " -N: Prints the note at the supplied note number and deletes it, if it exists. Requires an integer argument. \n"
-                    " -D: Deletes the note at supplied note number, if it exists. Requires an integer argument.\n"
+                    " -D: Deletes the note at supplied note number, if it exists. Requires an integer argument or a range, eg 3-10.\n"
+                    " -X: Deletes all notes that contain supplied string. Requires a string argument.\n"
+                    " -T: Deletes all notes written between two dates, eg \"2013-07-01,2013-08-01\". Either date can be left out.\n"
                     " -R: Deletes all notes.\n"
+                    " -m: Compacts the data file, reclaiming the space used by deleted notes and checking the notes.\n"
+                    "     Notes compacted before are left alone until a quarter of them have been deleted.\n"
+                    "     An optional number of seconds, eg -m10, limits how long it works for. Run it again to carry on.\n"
                     " -p: \"Pops\" the last note without deleting it.\n"
                     " -n: Prints the note at the supplied note number without deleting it. Requires an integer argument.\n"
                     " -a: Appends a note to the list. Requires a string argument.\n"
+                    " -u: Imports files as notes, one note per file. Takes any number of files, directories or globs,\n"
+                    "     eg -u ~/logs \"*.txt\". Directories are imported with everything in them.\n"
+                    " -j: Imports notes from a JSON Lines or CSV file, or stdin if the file is -, such as -o writes.\n"
+                    "     Uses the text, path, time and timestamp fields, and keeps each note's time.\n"
                     " -c: Copies text from the clipboard and adds to list. Requires Xclip\n"
+                    " -x: Runs the supplied command and adds what it prints, stdout and stderr, as a note.\n"
+                    "     With -r the note ends with the command's exit status and how long it ran for.\n"
                     " -l: Prints all the notes leaving them intact.\n"
                     " -f: Prints all notes that contain supplied string. Requires a string argument.\n"
                     " -g: \"greps\" notes, ie, prints all occurences of supplied string along with note and line number\n"
-                    " -s: Prints total notes, lines and characters.\n\n"
-                    "CONTACT:\n"
-                    " Please email any bugs, requests or hate mail to facetoe@ymail.com, or file a bug at https://github.com/facetoe/terminote2\n",
+                    "     -f and -g can be repeated to look for several strings at once, eg -g error -g timeout,\n"
+                    "     and each match says which of them it contains.\n"
+                    " -w: Looks for every line of the supplied file, or stdin if the file is -, as -f and -g do.\n"
+                    "     On its own it greps for them.\n"
+                    "     -f and -g can instead report their matches with one of these:\n"
+                    "     -k: Prints only how many notes (-f) or lines (-g) match.\n"
+                    "     -q: Prints nothing, exiting with 0 if anything matches and 1 if nothing does.\n"
+                    "     -z: Prints only the supplied number of newest matches, newest first, eg -z 10. 0 prints them all.\n"
+                    "     These search from the newest note back, stopping as soon as they know the answer,\n"
+                    "     and exit with 1 when nothing matches, like grep.\n"
+                    "     -g can also print lines of context, like grep, or JSON Lines:\n"
+                    "     -A, -B, -C: Print the supplied number of lines after, before or around each match, eg -C 2.\n"
+                    "     -y: Prints each line as JSON, with the byte offset and column of every match in it.\n"
+                    " -F: Ranks the notes by how well they match the supplied words, which can have typos, eg -F \"dokcer network\".\n"
+                    "     Recent notes, and notes whose path matches or that were written here, rank higher.\n"
+                    "     Prints the 10 best, or the number given with -z, with the line that matched best.\n",
             VERSION );
+    fprintf( outStream,
+            " -s: Prints total notes, lines and characters. They are kept in the data file, so it's instant.\n"
+                    " -S: Also prints the total size, the oldest and newest notes and how many notes there are of each size.\n"
+                    " -o: Exports every note to the supplied file: JSON Lines for .jsonl or - (stdout), CSV for .csv,\n"
+                    "     a file per note for a directory or a path ending in /, and the text -l prints for anything else.\n"
+                    " -e: Runs commands from a file, or stdin if the file is -, one per line, saving once at the end.\n"
+                    "     Commands are: append TEXT, print [N|all], pop [N], delete N[-M], grep TEXT, find TEXT, stats,\n"
+                    "     commit (save now) and commit N (save every N changes).\n"
+                    " -d: Starts a server that keeps the notebook loaded. While it runs, terminote passes its work to the server.\n"
+                    " -t: Prints the last note, then each new note as it is added, like tail -f. Runs until interrupted.\n"
+                    " -b: Selects the notebook to use, eg -b work. Can be combined with any other argument.\n"
+                    "     -f, -g, -l, -s and -S also accept a comma separated list of notebooks, or \"*\" for all of them.\n\n"
+                    "CONTACT:\n"
+                    " Please email any bugs, requests or hate mail to facetoe@ymail.com, or file a bug at https://github.com/facetoe/terminote2\n" );
 }
 
 /* Pops noteNum note and prints with args sections then deletes note */
@@ -53,207 +105,602 @@ void nonInteractive_pop( FILE *outStream, MESSAGE *msg, char *args,
     }
 }
 
-/* Searches through messages printing them if they contain searchTerm */
-void nonInteractive_printAllWithSubString( FILE *outStream, MESSAGE *msg,
-        char *searchTerm ) {
+/* Returns true if a line of msg contains any of the patterns. With found, every line is
+ * searched and found is set for each of the patterns that occur, otherwise it stops at the
+ * first. */
+static bool findPatterns( MESSAGE *msg, PATTERNS *patterns, bool *found ) {
+    bool any = false;
+    for ( LINE *line = msg->first; line && line->next; line = line->next ) {
+        if ( !found && patterns_any( patterns, line->text, line->lSize ) )
+            return true;
+        if ( found && patterns_all( patterns, line->text, line->lSize, found ) )
+            any = true;
+    }
+    return any;
+}
 
-    msg = msg->root->next;
-    if ( !msg ) {
-        fprintf( outStream, "Nothing Found\n" );
+/* Prints msg, which patterns found. With more than one pattern, which of them it contains
+ * are printed too. */
+static void printFound( FILE *outStream, MESSAGE *msg, PATTERNS *patterns, bool *found ) {
+    if ( patterns->numPatterns < 2 ) {
+        list_printMessage( outStream, "nptm", msg );
+        return;
     }
 
-    for ( ; msg; msg = msg->next ) {
-        if ( list_messageHasSubstring( msg, searchTerm ) )
-            list_printMessage( outStream, "nptm", msg );
+    list_printMessage( outStream, "npt", msg );
+    fprintf( outStream, "Patterns: " );
+    patterns_print( outStream, patterns, found );
+    fprintf( outStream, "\n" );
+    list_printMessage( outStream, "m", msg );
+    memset( found, 0, patterns->numPatterns * sizeof(bool) );
+}
+
+/* Adds where the next thing printed to outStream starts, found in msg, to hits */
+static void addHit( SEARCH_HITS *hits, FILE *outStream, MESSAGE *msg ) {
+    if ( !hits )
+        return;
+    if ( hits->numHits == hits->size ) {
+        hits->size = hits->size ? hits->size * 2 : 16;
+        hits->hits = realloc( hits->hits, hits->size * sizeof(SEARCH_HIT) );
+        if ( !hits->hits ) {
+            fprintf( stderr, "Failed to allocate memory in addHit\n" );
+            exit( 1 );
+        }
     }
+    SEARCH_HIT *hit = &hits->hits[hits->numHits++];
+    hit->time = parseNoteTime( msg->time );
+    hit->offset = ftell( outStream );
 }
 
-/* Reads from stdin until EOF growing the buffer as needed */
-void nonInteractive_appendMessage( MESSAGE *msg ) {
+/* Searches through messages printing them if they contain any of the patterns, and which
+ * ones when there are several. All of them are looked for in one pass over each line. mode
+ * can instead only count the notes, only find out whether there are any, or print the
+ * newest limit of them, newest first. Those look from the newest note back and stop as
+ * soon as they have the answer. If hits isn't NULL, where each of the newest starts is
+ * added to it. Returns the number of notes found. */
+int nonInteractive_printAllWithSubString( FILE *outStream, MESSAGE *msg,
+        PATTERNS *patterns, int mode, int limit, SEARCH_HITS *hits ) {
+    MESSAGE *root = msg->root;
+    int found = 0;
+
+    /* Only printed notes need to know which patterns they contain */
+    bool *which = NULL;
+    if ( ( mode == SEARCH_ALL || mode == SEARCH_NEWEST ) && patterns->numPatterns > 1 )
+        which = calloc( patterns->numPatterns, sizeof(bool) );
+
+    if ( mode == SEARCH_ALL ) {
+        msg = root->next;
+        if ( !msg ) {
+            fprintf( outStream, "Nothing Found\n" );
+        }
 
-    /* Loop to the end of the message */
-    msg = msg->root;
-    for ( ; msg->next; msg = msg->next )
-        ;
+        for ( ; msg; msg = msg->next ) {
+            if ( findPatterns( msg, patterns, which ) ) {
+                printFound( outStream, msg, patterns, which );
+                found++;
+            }
+        }
+        free( which );
+        return found;
+    }
+
+    for ( msg = root->tail; msg && msg != root; msg = msg->prev ) {
+        if ( !findPatterns( msg, patterns, which ) )
+            continue;
+
+        found++;
+        if ( mode == SEARCH_NEWEST ) {
+            addHit( hits, outStream, msg );
+            printFound( outStream, msg, patterns, which );
+        }
+        if ( mode == SEARCH_EXISTS || ( mode == SEARCH_NEWEST && found == limit ) )
+            break;
+    }
+
+    if ( mode == SEARCH_COUNT )
+        fprintf( outStream, "%d\n", found );
+    free( which );
+    return found;
+}
+
+/* Reads everything from fd into the note being built, a block at a time */
+static void readLines( int fd, LINE_BUILDER *build ) {
+    char *buffer = malloc( READ_BLOCK_SIZE );
+    if ( !buffer ) {
+        fprintf( stderr, "Failed to allocate memory for the read buffer in readLines\n" );
+        exit( 1 );
+    }
+
+    ssize_t n;
+    while ( ( n = read( fd, buffer, READ_BLOCK_SIZE ) ) != 0 ) {
+        if ( n < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            fprintf( stderr, "Error reading input: %s\n", strerror( errno ) );
+            break;
+        }
+        list_buildText( build, buffer, n );
+    }
+    free( buffer );
+}
+
+/* Reads from stdin until EOF into a new note */
+void nonInteractive_appendMessage( MESSAGE *msg ) {
 
     /* Allocate and move to new node */
-    msg->next = list_getNode( msg );
-    msg = msg->next;
+    msg = list_newTail( msg );
 
     /* Get and set path and time information */
     list_setPath( msg );
     list_setTime( msg );
 
-    int ch, lineLen, totChars, numLines, buffSize;
-    ch = lineLen = totChars = numLines = 0;
-
-    char *tmp, *buffer;
-    tmp = buffer = NULL;
-
-    buffSize = 1024;
-    buffer = malloc( buffSize * sizeof(char) );
+    LINE_BUILDER build;
+    list_buildStart( &build, msg );
+    readLines( STDIN_FILENO, &build );
+    list_buildFinish( &build );
+}
 
-    if ( !buffer ) {
-        fprintf( stderr,
-                "Failed to allocate memory for message buffer in nonInteractive_appendMessage\n" );
-        exit( 1 );
+/* Runs command with the shell and reads what it writes to stdout and stderr into a new note
+ * as it arrives. If tag is set a last line gives the exit status and how long it ran for.
+ * Returns the exit status, or -1 if the command couldn't be run or was killed. */
+int nonInteractive_appendCommandOutput( MESSAGE *msg, char *command, bool tag ) {
+    int fds[2];
+    if ( pipe( fds ) != 0 ) {
+        fprintf( stderr, "Unable to create a pipe for the command\n" );
+        return -1;
     }
 
-    LINE *line, *prev;
-    line = prev = NULL;
-    line = line_getLine();
+#ifdef F_SETPIPE_SZ
+    /* A bigger pipe means fewer trips between the command and us */
+    fcntl( fds[0], F_SETPIPE_SZ, READ_BLOCK_SIZE );
+#endif
+
+    /* stdout and stderr share the pipe, so they interleave just as they would on a terminal */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init( &actions );
+    posix_spawn_file_actions_addclose( &actions, fds[0] );
+    posix_spawn_file_actions_adddup2( &actions, fds[1], STDOUT_FILENO );
+    posix_spawn_file_actions_adddup2( &actions, fds[1], STDERR_FILENO );
+    posix_spawn_file_actions_addclose( &actions, fds[1] );
+
+    double start = store_now();
+    pid_t pid;
+    char *argv[] = { "sh", "-c", command, NULL };
+    int error = posix_spawn( &pid, "/bin/sh", &actions, NULL, argv, environ );
+    posix_spawn_file_actions_destroy( &actions );
+    close( fds[1] );
+
+    if ( error ) {
+        fprintf( stderr, "Failed to run %s: %s\n", command, strerror( error ) );
+        close( fds[0] );
+        return -1;
+    }
 
-    while ( ( ch = getchar() ) != EOF ) {
+    /* Allocate and move to new node */
+    msg = list_newTail( msg );
 
-        /* If we've outgrown the buffer then allocate some more memory */
-        if ( lineLen >= buffSize ) {
-            buffSize *= 2;
-            tmp = realloc( buffer, buffSize * sizeof(char *) );
+    /* Get and set path and time information */
+    list_setPath( msg );
+    list_setTime( msg );
 
-            if ( !tmp ) {
-                fprintf( stderr,
-                        "Failed to allocate %d bytes in nonInteractive_appendMessage\n",
-                        buffSize );
-                exit( 1 );
-            } else {
-                buffer = tmp;
-            }
-        }
+    LINE_BUILDER build;
+    list_buildStart( &build, msg );
+    readLines( fds[0], &build );
+    close( fds[0] );
 
-        if ( ch != '\n' && ch != '\0' ) {
-            buffer[lineLen] = ch;
-            lineLen++;
-        } else {
+    int status = 0, result = -1;
+    while ( waitpid( pid, &status, 0 ) < 0 && errno == EINTR )
+        ;
+    if ( WIFEXITED( status ) )
+        result = WEXITSTATUS( status );
+
+    if ( tag ) {
+        char line[100];
+        int len;
+        if ( WIFSIGNALED( status ) )
+            len = snprintf( line, sizeof( line ), "\n[killed by signal %d after %.2fs]",
+                    WTERMSIG( status ), store_now() - start );
+        else
+            len = snprintf( line, sizeof( line ), "\n[exit status %d after %.2fs]", result,
+                    store_now() - start );
+
+        /* The tag goes on a line of its own, even if the output didn't end with a newline */
+        list_buildText( &build, build.partialLen ? line : line + 1, build.partialLen ? len : len - 1 );
+    }
+    list_buildFinish( &build );
+    return result;
+}
 
-            numLines++;
-            buffer[lineLen] = 0;
+/* What grep needs to print the lines it finds in the format asked for */
+typedef struct {
+    FILE *outStream;
+    PATTERNS *patterns;
+    GREP_FORMAT *format;
+
+    /* Which patterns the last line contains, when there are several and it's printed as text */
+    bool *which;
+
+    /* Where the patterns are in the last line, when it's printed as JSON */
+    PATTERN_MATCH *matches;
+    int numMatches;
+    int matchesSize;
+
+    /* The last line printed, so a gap between lines of context can be marked */
+    int lastNote;
+    int lastLine;
+} GREP_OUTPUT;
+
+/* Returns true if line contains any of the patterns. Also works out what printing it needs:
+ * where each match is for JSON, or which patterns it contains when there are several. */
+static bool grepLine( GREP_OUTPUT *out, LINE *line ) {
+    if ( out->format->json ) {
+        out->numMatches = patterns_matches( out->patterns, line->text, line->lSize,
+                &out->matches, &out->matchesSize );
+        return out->numMatches > 0;
+    }
+    if ( !out->which )
+        return patterns_any( out->patterns, line->text, line->lSize );
 
-            /* You pass buffer + lineLen because insertLine expects the pointer to be at the end of the string */
-            insertLine( &line, buffer + lineLen, lineLen, numLines );
+    memset( out->which, 0, out->patterns->numPatterns * sizeof(bool) );
+    return patterns_all( out->patterns, line->text, line->lSize, out->which ) > 0;
+}
 
-            if ( numLines == 1 ) {
-                msg->first = line;
-            }
+/* Prints line of note messageNum as a JSON object, with each match's pattern, byte offset
+ * from 0 and column from 1, or marked as context if it isn't a match */
+static void printGrepJson( GREP_OUTPUT *out, int messageNum, LINE *line, bool match ) {
+    FILE *outStream = out->outStream;
+    fprintf( outStream, "{\"note\":%d,\"line\":%d,", messageNum, line->lNum );
+
+    if ( match ) {
+        /* The matches are in order, so the columns are counted in one walk along the line,
+         * skipping UTF-8 continuation bytes */
+        const unsigned char *text = ( const unsigned char * ) line->text;
+        size_t byte = 0;
+        int column = 1;
+
+        fprintf( outStream, "\"matches\":[" );
+        for ( int i = 0; i < out->numMatches; i++ ) {
+            PATTERN_MATCH *m = &out->matches[i];
+            for ( ; byte < m->offset; byte++ )
+                if ( ( text[byte] & 0xC0 ) != 0x80 )
+                    column++;
+
+            const char *pattern = out->patterns->patterns[m->pattern];
+            fprintf( outStream, "%s{\"pattern\":\"", i ? "," : "" );
+            export_json( outStream, pattern, strlen( pattern ) );
+            fprintf( outStream, "\",\"byte\":%zu,\"column\":%d}", m->offset, column );
+        }
+        fprintf( outStream, "]," );
+    } else {
+        fprintf( outStream, "\"context\":true," );
+    }
 
-            /* Set and update the prev pointer */
-            line->prev = prev;
-            prev = line;
+    fprintf( outStream, "\"text\":\"" );
+    export_json( outStream, line->text, line->lSize );
+    fprintf( outStream, "\"}\n" );
+}
 
-            /* Get a new line and move to it */
-            line->next = line_getLine();
-            line = line->next;
-            totChars += lineLen + 1;
-            lineLen = 0;
-        }
+/* Prints a line grep found, or a line of context around one, and the note it's in. As text
+ * the leading whitespace is trimmed, a match has "Line N:" and context has "Line N-", and
+ * with more than one pattern the ones a match contains are printed before it. When there is
+ * context, lines that don't follow on from the last one printed are preceded by "--". */
+static void printGrepLine( GREP_OUTPUT *out, int messageNum, LINE *line, bool match ) {
+    if ( out->format->json ) {
+        printGrepJson( out, messageNum, line, match );
+        return;
     }
 
-    /* Update MESSAGE statistics for this message */
-    msg->last = line->prev;
-    msg->numChars = totChars;
-    msg->numLines = numLines;
-    msg->messageNum = msg->root->totalMessages + 1;
-    msg->root->totalMessages++;
-    free( buffer );
+    FILE *outStream = out->outStream;
+    if ( ( out->format->before || out->format->after ) && out->lastNote
+            && ( messageNum != out->lastNote || line->lNum != out->lastLine + 1 ) )
+        fprintf( outStream, "--\n" );
+    out->lastNote = messageNum;
+    out->lastLine = line->lNum;
+
+    char *pntr = line->text;
+    while(*pntr == ' ') {pntr++;} // Loop past leading whitespace.
+    fprintf( outStream, "Msg: %d: Line %d%c ", messageNum, line->lNum, match ? ':' : '-' );
+    if ( match && out->which ) {
+        fprintf( outStream, "[" );
+        patterns_print( outStream, out->patterns, out->which );
+        fprintf( outStream, "] " );
+    }
+    fprintf( outStream, "%s\n", pntr );
 }
 
-/* Reads the output of command into buffer then inserts into a MESSAGE struct. */
-void nonInteractive_appendClipboardContents( MESSAGE *msg, char *command ) {
+/* Searches all messages and prints lines that contain any of the patterns, and which ones
+ * when there are several. All of them are looked for in one pass over each line. Also trims
+ * leading whitespace when printing. format can add lines of context before and after each
+ * match, and print JSON Lines giving where each match is instead. The lines before are kept
+ * in a ring as the note is scanned, so nothing is read twice. mode can instead only count
+ * the lines, only find out whether there are any, or print the newest limit of them, from
+ * the end of the newest note back. Those stop as soon as they have the answer. If hits isn't
+ * NULL, where each of the newest starts is added to it. Returns the number of lines found. */
+int nonInteractive_grepMessages( FILE *outStream, MESSAGE *msg, PATTERNS *patterns, int mode,
+        int limit, GREP_FORMAT *format, SEARCH_HITS *hits ) {
+    MESSAGE *root = msg->root;
+    LINE *line = NULL;
+    int found = 0;
+
+    GREP_OUTPUT out;
+    memset( &out, 0, sizeof(GREP_OUTPUT) );
+    out.outStream = outStream;
+    out.patterns = patterns;
+    out.format = format;
+
+    /* Only printed lines need to know which patterns they contain */
+    if ( ( mode == SEARCH_ALL || mode == SEARCH_NEWEST ) && patterns->numPatterns > 1
+            && !format->json )
+        out.which = calloc( patterns->numPatterns, sizeof(bool) );
+
+    if ( mode == SEARCH_ALL ) {
+        /* The last format->before lines that weren't printed, oldest at ringStart */
+        LINE **ring = format->before ? malloc( format->before * sizeof(LINE *) ) : NULL;
+
+        msg = root->next;
+        if ( msg )
+            list_refreshNumbers( msg );
+        for ( ; msg; msg = msg->next ) {
+            int ringStart = 0, ringCount = 0, after = 0;
+
+            for ( line = msg->first; line->next; line = line->next ) {
+                if ( grepLine( &out, line ) ) {
+                    for ( ; ringCount; ringCount-- ) {
+                        printGrepLine( &out, msg->messageNum, ring[ringStart], false );
+                        ringStart = ( ringStart + 1 ) % format->before;
+                    }
+                    printGrepLine( &out, msg->messageNum, line, true );
+                    after = format->after;
+                    found++;
+                } else if ( after ) {
+                    printGrepLine( &out, msg->messageNum, line, false );
+                    after--;
+                } else if ( ring ) {
+                    if ( ringCount == format->before )
+                        ringStart = ( ringStart + 1 ) % format->before;
+                    else
+                        ringCount++;
+                    ring[( ringStart + ringCount - 1 ) % format->before] = line;
+                }
+            }
+        }
+        free( ring );
+        free( out.which );
+        free( out.matches );
+        return found;
+    }
 
-    /* Loop to the end of the message */
-    msg = msg->root;
-    for ( ; msg->next; msg = msg->next )
-        ;
+    /* Count the note numbers down as we go, rather than renumbering every note first */
+    int number = root->totalMessages;
+    for ( msg = root->tail; msg && msg != root; msg = msg->prev, number-- ) {
+        for ( line = msg->last; line; line = line->prev ) {
+            if ( !grepLine( &out, line ) )
+                continue;
+
+            found++;
+            if ( mode == SEARCH_NEWEST ) {
+                addHit( hits, outStream, msg );
+                printGrepLine( &out, number, line, true );
+            }
+            if ( mode == SEARCH_EXISTS || ( mode == SEARCH_NEWEST && found == limit ) )
+                goto done;
+        }
+    }
 
-    /* Allocate and move to new node */
-    msg->next = list_getNode( msg );
-    msg = msg->next;
+    done:
+    if ( mode == SEARCH_COUNT )
+        fprintf( outStream, "%d\n", found );
+    free( out.which );
+    free( out.matches );
+    return found;
+}
 
-    /* Get and set path and time information */
-    list_setPath( msg );
-    list_setTime( msg );
+/* Ranks the notes by how well they match query, which is a few words that can be misspelt,
+ * and prints the best limit of them, best first, each with its score and the line that
+ * matched best. Returns the number of notes printed. */
+int nonInteractive_fuzzySearch( FILE *outStream, MESSAGE *msg, const char *query, int limit ) {
+    MESSAGE *root = msg->root;
+    FUZZY_QUERY fuzzy;
+    if ( !fuzzy_compile( &fuzzy, query ) )
+        return 0;
+
+    list_refreshNumbers( root );
+    MESSAGE **notes = malloc( ( root->totalMessages + 1 ) * sizeof(MESSAGE *) );
+    if ( !notes ) {
+        fprintf( stderr, "Failed to allocate memory in nonInteractive_fuzzySearch\n" );
+        exit( 1 );
+    }
+    int numNotes = 0;
+    for ( msg = root->next; msg; msg = msg->next )
+        notes[numNotes++] = msg;
+
+    if ( limit <= 0 || limit > numNotes )
+        limit = numNotes;
+    FUZZY_RESULT *results = malloc( ( limit ? limit : 1 ) * sizeof(FUZZY_RESULT) );
+    if ( !results ) {
+        fprintf( stderr, "Failed to allocate memory in nonInteractive_fuzzySearch\n" );
+        exit( 1 );
+    }
 
-    char *tmp, *buffer;
-    tmp = buffer = NULL;
+    FUZZY_INDEX index;
+    fuzzy_index( &index, notes, numNotes );
+    int found = fuzzy_rank( &index, &fuzzy, limit, results );
 
-    int buffSize, ch, charsRead;
-    buffSize = 1024;
-    charsRead = 0;
+    for ( int i = 0; i < found; i++ ) {
+        MESSAGE *note = notes[results[i].note];
+        fprintf( outStream, "Msg: %d: Score %d: ", note->messageNum, results[i].score );
 
-    buffer = malloc( buffSize * sizeof(char) );
+        /* Only the path matched */
+        if ( !results[i].line ) {
+            fprintf( outStream, "Path: %s\n", note->path );
+            continue;
+        }
 
-    if ( !buffer ) {
-        fprintf( stderr,
-                "Failed to allocate memory for message buffer in nonInteractive_appendClipboardContents\n" );
-        exit( 1 );
+        char *pntr = results[i].line->text;
+        while ( *pntr == ' ' )
+            pntr++;
+        fprintf( outStream, "%s\n", pntr );
     }
 
-    FILE *fp;
+    fuzzy_freeIndex( &index );
+    free( results );
+    free( notes );
+    return found;
+}
 
-    /* Open the command for reading. */
-    fp = popen( command, "r" );
-    if ( fp == NULL ) {
-        printf( "Failed to run command\n" );
-        exit( 1 );
+/* Prints the last note, then each note added after it as it lands, like tail -f. Only the
+ * new part of the data file is read each time. Returns false if the file can't be watched. */
+bool nonInteractive_follow( FILE *outStream ) {
+    FOLLOW follow;
+    MESSAGE *msg = NULL;
+    list_init( &msg );
+    list_load( msg );
+
+    follow_init( &follow, msg );
+    if ( !follow_watch( &follow ) ) {
+        fprintf( stderr, "Unable to watch %s for changes\n", path );
+        list_destroy( &msg );
+        return false;
     }
 
-    while ( ( ch = fgetc( fp ) ) != EOF ) {
+    if ( msg->root->tail )
+        list_printMessage( outStream, "nptm", msg->root->tail );
 
-        /* If we've outgrown the buffer then allocate some more memory */
-        if ( charsRead >= buffSize ) {
-            buffSize *= 2;
-            tmp = realloc( buffer, buffSize * sizeof(char *) );
+    /* Look before the first wait, so notes written while we were loading aren't missed */
+    for ( ;; ) {
+        for ( MESSAGE *added = follow_read( &follow, msg ); added; added = added->next )
+            list_printMessage( outStream, "nptm", added );
+        fflush( outStream );
+        follow_wait( &follow, -1 );
+    }
+}
 
-            if ( !tmp ) {
-                fprintf( stderr,
-                        "Failed to allocate %d bytes in nonInteractive_appendMessage\n",
-                        buffSize );
-                exit( 1 );
-            } else {
-                buffer = tmp;
-            }
+/* Replaces the escapes \n, \t and \\ in str with the characters they stand for */
+static void unescape( char *str ) {
+    char *out = str;
+    for ( char *s = str; *s; s++ ) {
+        if ( *s == '\\' && s[1] ) {
+            s++;
+            *out++ = *s == 'n' ? '\n' : *s == 't' ? '\t' : *s;
         } else {
-            /* Otherwise add the character to the buffer and increment charsRead */
-            buffer[charsRead] = ch;
-            charsRead++;
+            *out++ = *s;
         }
     }
+    *out = '\0';
+}
 
-    /* Insert the buffer contents into a MESSAGE struct */
-    list_insertString( msg, buffer );
-
-    free( buffer );
-    pclose( fp );
+/* Fills opts from one batch command. Returns false if the command isn't valid. */
+static bool parseBatchCommand( OPTIONS *opts, char *cmd, char *arg ) {
+    bool hasInt = *arg && isInteger( arg );
+
+    if ( !strcmp( cmd, "append" ) ) {
+        unescape( arg );
+        opts->append = 1;
+        opts->appendStr = arg;
+    } else if ( !strcmp( cmd, "print" ) ) {
+        if ( !*arg )
+            opts->printL = 1;
+        else if ( !strcmp( arg, "all" ) )
+            opts->printA = 1;
+        else if ( hasInt && atoi( arg ) > 0 )
+            opts->printN = atoi( arg );
+        else
+            return false;
+    } else if ( !strcmp( cmd, "pop" ) ) {
+        if ( !*arg )
+            opts->pop = 1;
+        else if ( hasInt && atoi( arg ) > 0 )
+            opts->popN = atoi( arg );
+        else
+            return false;
+    } else if ( !strcmp( cmd, "delete" ) ) {
+        /* Backwards ranges are refused like they are for -D */
+        if ( !validateRange( "delete", arg, &opts->delN, &opts->delTo ) || opts->delN < 1 )
+            return false;
+    } else if ( !strcmp( cmd, "grep" ) && *arg ) {
+        opts->grep = 1;
+        opts->searchTerm = arg;
+    } else if ( !strcmp( cmd, "find" ) && *arg ) {
+        opts->searchNotes = 1;
+        opts->searchTerm = arg;
+    } else if ( !strcmp( cmd, "stats" ) ) {
+        opts->stats = 1;
+    } else {
+        return false;
+    }
+    return true;
 }
 
-/* Searches all messages and prints lines that contain substring. Also trims leading whitespace when printing. */
-void nonInteractive_grepMessages( FILE *outStream, MESSAGE *msg, char *subString ) {
-    msg = msg->root->next;
-    if ( !msg )
-        return;
-    char *pntr = NULL;
-    LINE *line = NULL;
-    for ( ; msg; msg = msg->next ) {
-        for ( line = msg->first; line->next; line = line->next ) {
-            if ( strstr( line->text, subString ) != NULL ) {
-                pntr = line->text;
-                while(*pntr == ' ') {pntr++;} // Loop past leading whitespace.
-                fprintf( outStream, "Msg: %d: Line %d: %s\n", msg->messageNum,
-                        line->lNum, pntr );
+/* Runs commands read from inStream, one per line, against msg. Changes are saved
+ * together every commitEvery commands that change something, or by a "commit"
+ * command, and whatever is left is saved by the caller. The caller holds the writer lock
+ * from loading msg until that last save, so nobody can change the notes under a pop or
+ * delete. */
+void nonInteractive_runBatch( FILE *inStream, FILE *outStream, MESSAGE *msg ) {
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t len;
+    int lineNum = 0, pending = 0, commitEvery = 0;
+
+    OPTIONS *opts = options_new();
+
+    while ( ( len = getline( &line, &lineSize, inStream ) ) != -1 ) {
+        lineNum++;
+        if ( len > 0 && line[len - 1] == '\n' )
+            line[--len] = '\0';
+
+        /* Skip blank lines and comments */
+        char *cmd = line;
+        while ( *cmd == ' ' || *cmd == '\t' )
+            cmd++;
+        if ( !*cmd || *cmd == '#' )
+            continue;
+
+        /* Split the command from its argument */
+        char *arg = cmd;
+        while ( *arg && *arg != ' ' && *arg != '\t' )
+            arg++;
+        if ( *arg )
+            *arg++ = '\0';
+
+        if ( !strcmp( cmd, "commit" ) ) {
+            if ( *arg && isInteger( arg ) ) {
+                commitEvery = atoi( arg );
+            } else {
+                list_saveLocked( msg );
+                pending = 0;
             }
+            continue;
+        }
 
+        /* Start each command afresh, freeing whatever the last one held */
+        patterns_free( &opts->patterns );
+        memset( opts, 0, sizeof(OPTIONS) );
+        if ( !parseBatchCommand( opts, cmd, arg ) ) {
+            fprintf( stderr, "Line %d: invalid command: %s %s\n", lineNum, cmd, arg );
+            continue;
+        }
+
+        /* Every command that changes something adds or removes notes, so only they count
+         * towards the next commit */
+        int before = msg->root->totalMessages;
+        options_run( opts, msg, outStream );
+
+        if ( msg->root->totalMessages != before && commitEvery > 0 && ++pending >= commitEvery ) {
+            list_saveLocked( msg );
+            pending = 0;
         }
     }
-}
 
-void nonInteractive_printStats(FILE *outStream, MESSAGE *msg) {
-    fprintf(outStream, "Messages: %d\nLines: %d\nCharacters: %ld\n",
-            msg->root->totalMessages, msg->root->numLines, msg->root->numChars);
+    options_free( opts );
+    free( line );
 }
 
 /* Run in non-interactive mode */
 void nonInteractive_run( OPTIONS *opts, int argc, char **argv ) {
 
     if ( argc == 1 ) {
+        /* What's piped in is read here rather than by a server, which would have to wait on it */
         MESSAGE *msg = NULL;
         list_init( &msg );
         list_load( msg );
@@ -265,7 +712,15 @@ void nonInteractive_run( OPTIONS *opts, int argc, char **argv ) {
         list_destroy( &msg );
     } else {
         /* If we get here there are command line arguments, parse and execute them */
-        options_parse( opts, argc, argv );
+        if ( !options_parse( opts, argc, argv ) )
+            exit( 1 );
+
+        if ( opts->notebook && !notebook_isMultiple( opts->notebook ) )
+            notebook_select( opts->notebook );
+
+        if ( options_usesList( opts ) && server_forward( argc, argv ) )
+            return;
+
         options_execute( opts );
     }
 
@@ -11,27 +11,69 @@
 #include "linkedList.h"
 #include "line.h"
 #include "options.h"
+#include "follow.h"
+
+/* Where each note or line a newest first search printed starts in its output, and when
+ * its note was written, so the newest of several searches' results can be picked out */
+typedef struct {
+    long time;
+    long offset;
+} SEARCH_HIT;
+
+typedef struct {
+    SEARCH_HIT *hits;
+    int numHits;
+    int size;
+} SEARCH_HITS;
 
 /* Prints usage */
 void printUsage( FILE *outStream );
 
-/* Searches through messages printing them if they contain searchTerm */
-void nonInteractive_printAllWithSubString( FILE *outStream, MESSAGE *msg, char *searchTerm );
+/* Searches through messages printing them if they contain any of the patterns, and which
+ * ones when there are several. All of them are looked for in one pass over each line. mode
+ * can instead only count the notes, only find out whether there are any, or print the
+ * newest limit of them, newest first. Those look from the newest note back and stop as
+ * soon as they have the answer. If hits isn't NULL, where each of the newest starts is
+ * added to it. Returns the number of notes found. */
+int nonInteractive_printAllWithSubString( FILE *outStream, MESSAGE *msg, PATTERNS *patterns,
+        int mode, int limit, SEARCH_HITS *hits );
 
-/* Reads from stdin until EOF growing the buffer as needed */
+/* Reads from stdin until EOF into a new note */
 void nonInteractive_appendMessage( MESSAGE *msg );
 
-/* Reads the output of command into a MESSAGE struct. */
-void nonInteractive_appendClipboardContents( MESSAGE *msg , char *command);
+/* Runs command with the shell and reads what it writes to stdout and stderr into a new note
+ * as it arrives. If tag is set a last line gives the exit status and how long it ran for.
+ * Returns the exit status, or -1 if the command couldn't be run or was killed. */
+int nonInteractive_appendCommandOutput( MESSAGE *msg, char *command, bool tag );
 
 /* Pops noteNum note and prints with args sections then deletes note */
 void nonInteractive_pop( FILE *outStream, MESSAGE *msg, char *args, int noteNum );
 
-/* "greps" the messages printing all matches with message and line numbers */
-void nonInteractive_grepMessages(FILE *outStream, MESSAGE *msg, char *subString);
+/* "greps" the messages printing all lines that contain any of the patterns, with message and
+ * line numbers and, when there are several, which patterns matched. All of them are looked
+ * for in one pass over each line. format can add lines of context around each match, or
+ * print JSON Lines with the byte and column of every match. mode can instead only count the
+ * lines, only find out whether there are any, or print the newest limit of them, from the
+ * end of the newest note back. Those stop as soon as they have the answer. If hits isn't
+ * NULL, where each of the newest starts is added to it. Returns the number of lines found. */
+int nonInteractive_grepMessages( FILE *outStream, MESSAGE *msg, PATTERNS *patterns, int mode,
+        int limit, GREP_FORMAT *format, SEARCH_HITS *hits );
+
+/* Ranks the notes by how well they match query, which is a few words that can be misspelt,
+ * and prints the best limit of them, best first, each with its score and the line that
+ * matched best. Returns the number of notes printed. */
+int nonInteractive_fuzzySearch( FILE *outStream, MESSAGE *msg, const char *query, int limit );
+
+/* Prints the last note, then each note added after it as it lands, like tail -f. Only the
+ * new part of the data file is read each time. Returns false if the file can't be watched. */
+bool nonInteractive_follow( FILE *outStream );
 
-/* Prints information on stored messages */
-void nonInteractive_printStats(FILE *outStream, MESSAGE *msg);
+/* Runs commands read from inStream, one per line, against msg. Changes are saved
+ * together every commitEvery commands that change something, or by a "commit"
+ * command, and whatever is left is saved by the caller. The caller holds the writer lock
+ * from loading msg until that last save, so nobody can change the notes under a pop or
+ * delete. */
+void nonInteractive_runBatch( FILE *inStream, FILE *outStream, MESSAGE *msg );
 
 /* Run in non-interactive mode */
 void nonInteractive_run( OPTIONS *opts, int argc, char **argv );
@@ -0,0 +1,339 @@
+/*
+ * notebook.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "notebook.h"
+#include "nonInteractive.h"
+#include "stats.h"
+
+#include <dirent.h>
+#include <pthread.h>
+
+#define NOTEBOOK_EXT ".data"
+
+/* One notebook's share of notebook_runAll */
+typedef struct {
+    char *name;
+    char *dataPath;
+    OPTIONS *opts;
+    char *output;
+    size_t outputLen;
+    int found;
+
+    /* Where each of the newest starts in output, when only the newest are asked for */
+    SEARCH_HITS hits;
+
+    /* Set if there's no such notebook, or its data file couldn't be read */
+    bool missing;
+    bool corrupt;
+} NOTEBOOK_JOB;
+
+/* The notebooks of notebook_runAll, shared out among the threads running them */
+typedef struct {
+    NOTEBOOK_JOB *jobs;
+    int numJobs;
+    pthread_mutex_t lock;
+    int next;
+} NOTEBOOK_WORK;
+
+/* One of the newest things found in any of the notebooks */
+typedef struct {
+    NOTEBOOK_JOB *job;
+    SEARCH_HIT *hit;
+    long end;
+} NOTEBOOK_HIT;
+
+/* Returns true if name can be used as a notebook name, ie letters, digits, '-', '_' and '.' */
+bool notebook_validName( char *name ) {
+    if ( !*name || *name == '.' || strlen( name ) > 100 )
+        return false;
+
+    for ( char *s = name; *s; s++ ) {
+        if ( !isalnum( ( unsigned char ) *s ) && *s != '-' && *s != '_' && *s != '.' )
+            return false;
+    }
+    return true;
+}
+
+/* Returns a malloced path to the data file of notebook name. The default notebook is the
+ * original data file, the rest live in notebookDir. */
+char *notebook_dataPath( char *name ) {
+    char *homeDir = getenv( "HOME" );
+    if ( !homeDir )
+        homeDir = "";
+
+    int buffSize = strlen( homeDir ) + strlen( notebookDir ) + strlen( name )
+            + strlen( dataFile ) + strlen( NOTEBOOK_EXT ) + 2;
+    char *pathBuffer = malloc( buffSize );
+
+    if ( !strcmp( name, DEFAULT_NOTEBOOK ) )
+        snprintf( pathBuffer, buffSize, "%s%s", homeDir, dataFile );
+    else
+        snprintf( pathBuffer, buffSize, "%s%s/%s%s", homeDir, notebookDir, name,
+                NOTEBOOK_EXT );
+    return pathBuffer;
+}
+
+/* Points path at the data file of notebook name, creating notebookDir if needed */
+void notebook_select( char *name ) {
+    if ( !notebook_validName( name ) ) {
+        fprintf( stderr, "Error: \"%s\" is not a valid notebook name\n", name );
+        exit( 1 );
+    }
+
+    if ( strcmp( name, DEFAULT_NOTEBOOK ) ) {
+        char *dir = notebook_dataPath( "" );
+        *strrchr( dir, '/' ) = '\0';
+        mkdir( dir, 0700 );
+        free( dir );
+    }
+
+    path = notebook_dataPath( name );
+}
+
+/* Returns true if names selects more than one notebook, ie it's a comma separated list or "*" */
+bool notebook_isMultiple( char *names ) {
+    return strchr( names, ',' ) || !strcmp( names, "*" );
+}
+
+static int compareNames( const void *a, const void *b ) {
+    return strcmp( *( char * const * ) a, *( char * const * ) b );
+}
+
+/* Returns a malloced, NULL terminated array of the notebooks selected by names.
+ * "*" selects every notebook. */
+char **notebook_list( char *names ) {
+    int size = 16, count = 0;
+    char **list = malloc( size * sizeof(char *) );
+
+    if ( !strcmp( names, "*" ) ) {
+        list[count++] = strdup( DEFAULT_NOTEBOOK );
+
+        char *dir = notebook_dataPath( "" );
+        *strrchr( dir, '/' ) = '\0';
+        DIR *dp = opendir( dir );
+        free( dir );
+
+        struct dirent *entry;
+        while ( dp && ( entry = readdir( dp ) ) ) {
+            size_t len = strlen( entry->d_name );
+            size_t extLen = strlen( NOTEBOOK_EXT );
+            if ( len <= extLen || strcmp( entry->d_name + len - extLen, NOTEBOOK_EXT ) )
+                continue;
+
+            if ( count + 1 >= size ) {
+                size *= 2;
+                list = realloc( list, size * sizeof(char *) );
+            }
+            list[count] = strndup( entry->d_name, len - extLen );
+            count++;
+        }
+        if ( dp )
+            closedir( dp );
+
+        /* Keep the default notebook first */
+        qsort( list + 1, count - 1, sizeof(char *), compareNames );
+    } else {
+        char *copy = strdup( names ), *save = NULL;
+        for ( char *name = strtok_r( copy, ",", &save ); name;
+                name = strtok_r( NULL, ",", &save ) ) {
+            if ( !notebook_validName( name ) ) {
+                fprintf( stderr, "Error: \"%s\" is not a valid notebook name\n", name );
+                exit( 1 );
+            }
+            if ( count + 1 >= size ) {
+                size *= 2;
+                list = realloc( list, size * sizeof(char *) );
+            }
+            list[count++] = strdup( name );
+        }
+        free( copy );
+    }
+
+    list[count] = NULL;
+    return list;
+}
+
+/* Frees an array returned by notebook_list */
+void notebook_freeList( char **names ) {
+    for ( char **name = names; *name; name++ )
+        free( *name );
+    free( names );
+}
+
+/* Loads one notebook and runs the option against it, collecting the output in memory.
+ * Only this notebook's file is touched and no locks are taken. Statistics come from the
+ * header without loading anything. */
+static void notebook_runJob( NOTEBOOK_JOB *job ) {
+    OPTIONS *opts = job->opts;
+    if ( job->missing )
+        return;
+
+    FILE *outStream = open_memstream( &job->output, &job->outputLen );
+    if ( opts->stats ) {
+        STORE_STATS stats;
+        if ( stats_read( job->dataPath, &stats ) )
+            stats_print( outStream, &stats, opts->detailedStats );
+        else
+            job->corrupt = true;
+        fclose( outStream );
+        return;
+    }
+
+    FILE *fp = fopen( job->dataPath, "rb" );
+    if ( !fp ) {
+        fclose( outStream );
+        return;
+    }
+
+    MESSAGE *msg = NULL;
+    list_init( &msg );
+    bool ok = list_readBinary( fp, msg );
+    fclose( fp );
+
+    /* Only what's asked for from a notebook we can read in full */
+    SEARCH_HITS *hits = opts->searchMode == SEARCH_NEWEST ? &job->hits : NULL;
+    if ( !ok ) {
+        job->corrupt = true;
+    } else if ( opts->searchNotes ) {
+        if ( msg->root->next || opts->searchMode == SEARCH_COUNT )
+            job->found = nonInteractive_printAllWithSubString( outStream, msg, &opts->patterns,
+                    opts->searchMode, opts->searchLimit, hits );
+    } else if ( opts->grep ) {
+        job->found = nonInteractive_grepMessages( outStream, msg, &opts->patterns,
+                opts->searchMode, opts->searchLimit, &opts->grepFormat, hits );
+    } else if ( opts->printA ) {
+        if ( msg->root->next )
+            list_printAll( outStream, msg );
+    }
+
+    fclose( outStream );
+    list_destroy( &msg );
+}
+
+/* Runs the notebooks of the NOTEBOOK_WORK arg one at a time until there are none left */
+static void *notebook_work( void *arg ) {
+    NOTEBOOK_WORK *work = arg;
+    int i;
+    while ( ( i = takeJob( &work->lock, &work->next, 1 ) ) < work->numJobs )
+        notebook_runJob( &work->jobs[i] );
+    return NULL;
+}
+
+/* Newest first, and in the order they were found when they're as new */
+static int compareHits( const void *a, const void *b ) {
+    const NOTEBOOK_HIT *x = a, *y = b;
+    if ( x->hit->time != y->hit->time )
+        return ( x->hit->time < y->hit->time ) - ( x->hit->time > y->hit->time );
+    if ( x->job != y->job )
+        return ( x->job > y->job ) - ( x->job < y->job );
+    return ( x->hit > y->hit ) - ( x->hit < y->hit );
+}
+
+/* Prints the newest limit of everything the jobs found, newest first, with the name of the
+ * notebook before each run of them from the same one. Returns how many were printed. */
+static int notebook_printNewest( FILE *outStream, NOTEBOOK_JOB *jobs, int count, int limit ) {
+    int total = 0;
+    for ( int i = 0; i < count; i++ )
+        total += jobs[i].hits.numHits;
+
+    NOTEBOOK_HIT *hits = malloc( ( total ? total : 1 ) * sizeof(NOTEBOOK_HIT) );
+    int n = 0;
+    for ( int i = 0; i < count; i++ ) {
+        for ( int j = 0; j < jobs[i].hits.numHits; j++ ) {
+            hits[n].job = &jobs[i];
+            hits[n].hit = &jobs[i].hits.hits[j];
+            hits[n].end = j + 1 < jobs[i].hits.numHits ? jobs[i].hits.hits[j + 1].offset
+                    : ( long ) jobs[i].outputLen;
+            n++;
+        }
+    }
+    qsort( hits, n, sizeof(NOTEBOOK_HIT), compareHits );
+
+    if ( n > limit )
+        n = limit;
+    for ( int i = 0; i < n; i++ ) {
+        if ( !i || hits[i].job != hits[i - 1].job )
+            fprintf( outStream, "Notebook: %s\n", hits[i].job->name );
+        fwrite( hits[i].job->output + hits[i].hit->offset, 1, hits[i].end - hits[i].hit->offset,
+                outStream );
+    }
+    free( hits );
+    return n;
+}
+
+/* Runs the read only option in opts against each notebook in names, a few at a time on a
+ * thread per core, printing each notebook's results in turn. Counts are added up, and only
+ * the newest limit of everything found are printed when those are asked for. Notebooks that
+ * don't exist or can't be read are reported. Returns the exit status, which is 1 if one of
+ * them couldn't be searched or, like options_run's, if a count, exists or newest search
+ * found nothing. */
+int notebook_runAll( FILE *outStream, char *names, OPTIONS *opts ) {
+    if ( !opts->searchNotes && !opts->grep && !opts->printA && !opts->stats ) {
+        fprintf( stderr,
+                "Error: only -f, -g, -l, -s and -S can be used with more than one notebook\n" );
+        exit( 1 );
+    }
+
+    char **list = notebook_list( names );
+    int count = 0, found = 0;
+    bool failed = false, all = !strcmp( names, "*" );
+    for ( ; list[count]; count++ )
+        ;
+
+    NOTEBOOK_WORK work;
+    memset( &work, 0, sizeof( work ) );
+    pthread_mutex_init( &work.lock, NULL );
+    work.jobs = calloc( count ? count : 1, sizeof(NOTEBOOK_JOB) );
+    work.numJobs = count;
+
+    for ( int i = 0; i < count; i++ ) {
+        NOTEBOOK_JOB *job = &work.jobs[i];
+        job->name = list[i];
+        job->dataPath = notebook_dataPath( list[i] );
+        job->opts = opts;
+
+        /* "*" always has the default notebook, whether or not anything has been written to it */
+        job->missing = !file_exists( job->dataPath );
+        if ( job->missing && !( all && !strcmp( job->name, DEFAULT_NOTEBOOK ) ) ) {
+            fprintf( stderr, "Error: there is no notebook called \"%s\"\n", job->name );
+            failed = true;
+        }
+    }
+
+    /* Only as many notebooks are loaded at once as there are cores */
+    runOnCores( notebook_work, &work, count );
+
+    if ( opts->searchMode == SEARCH_NEWEST )
+        found = notebook_printNewest( outStream, work.jobs, count, opts->searchLimit );
+
+    for ( int i = 0; i < count; i++ ) {
+        NOTEBOOK_JOB *job = &work.jobs[i];
+        if ( job->corrupt ) {
+            fprintf( stderr, "Error reading notebook \"%s\", it may be corrupted\n", job->name );
+            failed = true;
+        }
+
+        if ( opts->searchMode != SEARCH_NEWEST ) {
+            found += job->found;
+            if ( job->outputLen > 0 ) {
+                fprintf( outStream, "Notebook: %s\n", job->name );
+                fwrite( job->output, 1, job->outputLen, outStream );
+            }
+        }
+        free( job->output );
+        free( job->hits.hits );
+        free( job->dataPath );
+    }
+
+    if ( opts->searchMode == SEARCH_COUNT )
+        fprintf( outStream, "Total: %d\n", found );
+
+    free( work.jobs );
+    pthread_mutex_destroy( &work.lock );
+    notebook_freeList( list );
+    return failed || ( opts->searchMode != SEARCH_ALL && found == 0 );
+}
@@ -0,0 +1,47 @@
+/*
+ * notebook.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef NOTEBOOK_H_
+#define NOTEBOOK_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "options.h"
+
+/* Name of the notebook kept in the original data file */
+#define DEFAULT_NOTEBOOK "default"
+
+/* Returns true if name can be used as a notebook name, ie letters, digits, '-', '_' and '.' */
+bool notebook_validName( char *name );
+
+/* Returns a malloced path to the data file of notebook name. The default notebook is the
+ * original data file, the rest live in notebookDir. */
+char *notebook_dataPath( char *name );
+
+/* Points path at the data file of notebook name, creating notebookDir if needed */
+void notebook_select( char *name );
+
+/* Returns true if names selects more than one notebook, ie it's a comma separated list or "*" */
+bool notebook_isMultiple( char *names );
+
+/* Returns a malloced, NULL terminated array of the notebooks selected by names.
+ * "*" selects every notebook. */
+char **notebook_list( char *names );
+
+/* Frees an array returned by notebook_list */
+void notebook_freeList( char **names );
+
+/* Runs the read only option in opts against each notebook in names, a few at a time on a
+ * thread per core, printing each notebook's results in turn. Counts are added up, and only
+ * the newest limit of everything found are printed when those are asked for. Notebooks that
+ * don't exist or can't be read are reported. Returns the exit status, which is 1 if one of
+ * them couldn't be searched or, like options_run's, if a count, exists or newest search
+ * found nothing. */
+int notebook_runAll( FILE *outStream, char *names, OPTIONS *opts );
+
+#endif /* NOTEBOOK_H_ */
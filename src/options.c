@@ -9,6 +9,13 @@
 
 #include "options.h"
 #include "nonInteractive.h"
+#include "store.h"
+#include "notebook.h"
+#include "server.h"
+#include "import.h"
+#include "export.h"
+#include "fuzzy.h"
+#include "stats.h"
 #include <fcntl.h>
 
 #define OPT_NUM 17
@@ -26,7 +33,11 @@ OPTIONS *options_new() {
     opts->popN = 0;
 
     opts->delN = 0;
+    opts->delTo = 0;
     opts->delA = 0;
+    opts->delMatch = 0;
+    opts->delTerm = NULL;
+    opts->delTime = 0;
 
     opts->printN = 0;
     opts->printA = 0;
@@ -37,35 +48,125 @@ OPTIONS *options_new() {
     opts->searchNotes = 0;
     opts->grep = 0;
     opts->searchTerm = NULL;
+    opts->searchMode = SEARCH_ALL;
+    patterns_init( &opts->patterns );
+    opts->searchLimit = 0;
+    opts->grepFormat.before = 0;
+    opts->grepFormat.after = 0;
+    opts->grepFormat.json = false;
+    opts->fuzzy = 0;
+    opts->fuzzyQuery = NULL;
 
     opts->copyFromClip = 0;
+    opts->capture = 0;
+    opts->command = NULL;
+    opts->tagStatus = 0;
 
     opts->outputToFile = 0;
     opts->append = 0;
     opts->usage = 0;
     opts->stats = 0;
+    opts->detailedStats = 0;
+    opts->compact = 0;
+    opts->compactTime = 0;
+    opts->notebook = NULL;
+    opts->server = 0;
+    opts->follow = 0;
+    opts->import = 0;
+    opts->importPaths = NULL;
+    opts->importCount = 0;
+    opts->importRecords = 0;
+    opts->recordsFile = NULL;
+    opts->batch = 0;
+    opts->batchFile = NULL;
+    opts->readsStdin = 0;
     opts->interactive = 0;
 
     return opts;
 }
 
-int validateInt( char *flag, char *arg ) {
-    int result;
+/* Parses the integer argument of flag into result. Returns false if it isn't one. */
+bool validateInt( char *flag, char *arg, int *result ) {
     if ( !isInteger( arg ) ) {
         fprintf( stderr, "Error: %s requires an integer\n", flag );
-        exit( 1 );
-    } else {
-        sscanf( optarg, "%d", &result );
+        return false;
+    }
+    sscanf( arg, "%d", result );
+    return true;
+}
+
+/* Parses a note number or a range of note numbers, eg 5 or 5-10. Returns false if it
+ * isn't one. */
+bool validateRange( char *flag, char *arg, int *from, int *to ) {
+    char *dash = strchr( arg, '-' );
+    if ( !dash ) {
+        if ( !validateInt( flag, arg, from ) )
+            return false;
+        *to = *from;
+        return true;
     }
-    return result;
+
+    *dash = '\0';
+    bool ok = validateInt( flag, arg, from ) && validateInt( flag, dash + 1, to );
+    *dash = '-';
+    if ( ok && *to < *from ) {
+        fprintf( stderr, "Error: %s range is backwards\n", flag );
+        return false;
+    }
+    return ok;
+}
+
+/* Parses a date range in the form FROM,TO. Either date can be left out. Returns false if
+ * the dates can't be read. */
+bool validateTimeRange( char *flag, char *arg, TIME_RANGE *range ) {
+    char *comma = strchr( arg, ',' );
+    if ( comma )
+        *comma = '\0';
+
+    range->from = *arg ? parseDate( arg ) : 0;
+    range->to = comma && comma[1] ? parseDate( comma + 1 ) : time( NULL ) + 1;
+
+    if ( range->from < 0 || range->to < 0 ) {
+        fprintf( stderr,
+                "Error: %s requires dates in the form YYYY-MM-DD[ HH:MM],YYYY-MM-DD[ HH:MM]\n",
+                flag );
+        return false;
+    }
+    return true;
+}
+
+/* Adds term to the strings -f or -g look for. The first one is kept as searchTerm. */
+static void addSearchTerm( OPTIONS *options, char *term ) {
+    if ( !options->searchTerm )
+        options->searchTerm = term;
+    patterns_add( &options->patterns, term );
+}
+
+/* Sets how the search reports what it finds, which can only be set once. Returns false if
+ * it has been set already. */
+static bool setSearchMode( OPTIONS *options, int mode ) {
+    if ( options->searchMode != SEARCH_ALL ) {
+        fprintf( stderr, "Error: only one of -k, -q and -z can be used\n" );
+        return false;
+    }
+    options->searchMode = mode;
+    return true;
+}
+
+/* Frees opts and everything it holds */
+void options_free( OPTIONS *opts ) {
+    patterns_free( &opts->patterns );
+    free( opts );
 }
 
-/* Parse command line options */
-void options_parse( OPTIONS *options, int argc, char **argv ) {
+/* Parse command line options. Prints what's wrong and returns false if they can't be
+ * used, leaving the caller to decide whether to exit. */
+bool options_parse( OPTIONS *options, int argc, char **argv ) {
     char opt;
     int numFlags = 0;
+    bool patternFile = false;
 
-    while ( ( opt = getopt( argc, argv, "n:csivhPN:D:Rplf:g:a:o:" ) ) != -1 ) {
+    while ( ( opt = getopt( argc, argv, "n:csSivhPN:D:X:T:Rplm::f:g:a:o:b:de:tx:ruj:kqz:w:A:B:C:yF:" ) ) != -1 ) {
         switch ( opt ) {
 
         /* Copy from clipboard */
@@ -79,6 +180,13 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
             numFlags++;
             break;
 
+            /* Prints statistics in detail */
+        case 'S':
+            options->stats = 1;
+            options->detailedStats = 1;
+            numFlags++;
+            break;
+
             /* Interactive */
         case 'i':
             options->interactive = 1;
@@ -105,13 +213,30 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
 
             /* Pop n */
         case 'N':
-            options->popN = validateInt( "-N", optarg );
+            if ( !validateInt( "-N", optarg, &options->popN ) )
+                return false;
             numFlags++;
             break;
 
             /* Delete n */
         case 'D':
-            options->delN = validateInt( "-D", optarg );
+            if ( !validateRange( "-D", optarg, &options->delN, &options->delTo ) )
+                return false;
+            numFlags++;
+            break;
+
+            /* Delete notes containing string */
+        case 'X':
+            options->delMatch = 1;
+            options->delTerm = optarg;
+            numFlags++;
+            break;
+
+            /* Delete notes within time range */
+        case 'T':
+            options->delTime = 1;
+            if ( !validateTimeRange( "-T", optarg, &options->delRange ) )
+                return false;
             numFlags++;
             break;
 
@@ -129,7 +254,8 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
 
             /* Print n */
         case 'n':
-            options->printN = validateInt( "-n", optarg );
+            if ( !validateInt( "-n", optarg, &options->printN ) )
+                return false;
             numFlags++;
             break;
 
@@ -141,18 +267,79 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
 
             /* Print all notes containing sub string */
         case 'f':
+            if ( !options->searchNotes )
+                numFlags++;
             options->searchNotes = 1;
-            options->searchTerm = optarg;
-            numFlags++;
+            addSearchTerm( options, optarg );
             break;
 
             /* "grep" notes */
         case 'g':
+            if ( !options->grep )
+                numFlags++;
             options->grep = 1;
-            options->searchTerm = optarg;
+            addSearchTerm( options, optarg );
+            break;
+
+            /* Rank notes by how well they match */
+        case 'F':
+            options->fuzzy = 1;
+            options->fuzzyQuery = optarg;
             numFlags++;
             break;
 
+            /* Search for every line of a file */
+        case 'w':
+            if ( !patterns_addFile( &options->patterns, optarg ) ) {
+                fprintf( stderr, "Error: unable to read patterns from %s\n", optarg );
+                return false;
+            }
+            patternFile = true;
+            if ( !strcmp( optarg, "-" ) )
+                options->readsStdin = 1;
+            break;
+
+            /* Only count what the search finds */
+        case 'k':
+            if ( !setSearchMode( options, SEARCH_COUNT ) )
+                return false;
+            break;
+
+            /* Only find out if the search finds anything */
+        case 'q':
+            if ( !setSearchMode( options, SEARCH_EXISTS ) )
+                return false;
+            break;
+
+            /* Print the newest matches of the search */
+        case 'z':
+            if ( !setSearchMode( options, SEARCH_NEWEST )
+                    || !validateInt( "-z", optarg, &options->searchLimit ) )
+                return false;
+            break;
+
+            /* Lines of context to print after, before or around what grep finds */
+        case 'A':
+            if ( !validateInt( "-A", optarg, &options->grepFormat.after ) )
+                return false;
+            break;
+
+        case 'B':
+            if ( !validateInt( "-B", optarg, &options->grepFormat.before ) )
+                return false;
+            break;
+
+        case 'C':
+            if ( !validateInt( "-C", optarg, &options->grepFormat.before ) )
+                return false;
+            options->grepFormat.after = options->grepFormat.before;
+            break;
+
+            /* Print what grep finds as JSON Lines */
+        case 'y':
+            options->grepFormat.json = true;
+            break;
+
             /* Append note to list */
         case 'a':
             options->append = 1;
@@ -160,6 +347,69 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
             numFlags++;
             break;
 
+            /* Compact the data file */
+        case 'm':
+            options->compact = 1;
+            if ( optarg ) {
+                int seconds;
+                if ( !validateInt( "-m", optarg, &seconds ) )
+                    return false;
+                options->compactTime = seconds;
+            }
+            numFlags++;
+            break;
+
+            /* Run commands from a file */
+        case 'e':
+            options->batch = 1;
+            options->batchFile = optarg;
+            if ( !strcmp( optarg, "-" ) )
+                options->readsStdin = 1;
+            numFlags++;
+            break;
+
+            /* Start the server */
+        case 'd':
+            options->server = 1;
+            numFlags++;
+            break;
+
+            /* Add the output of a command */
+        case 'x':
+            options->capture = 1;
+            options->command = optarg;
+            numFlags++;
+            break;
+
+            /* Import files */
+        case 'u':
+            options->import = 1;
+            numFlags++;
+            break;
+
+            /* Import notes from JSON Lines or CSV */
+        case 'j':
+            options->importRecords = 1;
+            options->recordsFile = optarg;
+            numFlags++;
+            break;
+
+            /* Tag captured output with the exit status and runtime */
+        case 'r':
+            options->tagStatus = 1;
+            break;
+
+            /* Follow the notes */
+        case 't':
+            options->follow = 1;
+            numFlags++;
+            break;
+
+            /* Select notebook */
+        case 'b':
+            options->notebook = optarg;
+            break;
+
             /* Output to file */
         case 'o':
             options->outputToFile = 1;
@@ -169,7 +419,7 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
 
         case '?':
             printf("Unknown argument. Aborting.\n");
-            exit(0);
+            return false;
             break;
 
         default:
@@ -180,11 +430,59 @@ void options_parse( OPTIONS *options, int argc, char **argv ) {
         }
     }
 
+    /* The paths to import are everything left over after the flags */
+    if ( options->import ) {
+        options->importPaths = argv + optind;
+        options->importCount = argc - optind;
+        if ( options->importCount < 1 ) {
+            fprintf( stderr, "Error: -u requires at least one file, directory or glob\n" );
+            return false;
+        }
+    }
+
+    /* A pattern file on its own is grepped for */
+    if ( patternFile && !options->searchNotes && !options->grep ) {
+        options->grep = 1;
+        numFlags++;
+    }
+
+    if ( options->searchMode != SEARCH_ALL && !options->searchNotes && !options->grep
+            && !( options->fuzzy && options->searchMode == SEARCH_NEWEST ) ) {
+        fprintf( stderr, "Error: -k, -q and -z only work with -f and -g, and -z with -F\n" );
+        return false;
+    }
+
+    GREP_FORMAT *format = &options->grepFormat;
+    if ( ( format->before || format->after || format->json ) && !options->grep ) {
+        fprintf( stderr, "Error: -A, -B, -C and -y only work with -g\n" );
+        return false;
+    }
+    if ( ( format->before || format->after ) && options->searchMode != SEARCH_ALL ) {
+        fprintf( stderr, "Error: -A, -B and -C can't be used with -k, -q or -z\n" );
+        return false;
+    }
+
+    /* Every pattern is looked for in the same pass, so build the automaton once for all of them */
+    if ( options->searchNotes || options->grep ) {
+        if ( !options->patterns.numPatterns ) {
+            fprintf( stderr, "Error: the pattern file has no patterns in it\n" );
+            return false;
+        }
+        if ( !options->searchTerm )
+            options->searchTerm = options->patterns.patterns[0];
+        patterns_build( &options->patterns );
+    }
+
     /* Only one option at a time makes sense, so if there are more then one print usage and exit */
     if ( numFlags > 1 ) {
         printf( "Too many arguments.\nUsage: terminote [FLAG] [ARGUMENT]\n" );
-        exit( 1 );
+        return false;
     }
+
+    /* With nothing else to do, what's piped in is appended */
+    if ( !numFlags && !options->copyFromClip && !isatty( STDIN_FILENO ) )
+        options->readsStdin = 1;
+    return true;
 }
 
 /* Print options for debugging */
@@ -200,9 +498,32 @@ void options_print( OPTIONS *opts ) {
             opts->printN, opts->printA, opts->searchNotes, opts->searchTerm );
 }
 
+/* Returns true if opts deletes notes chosen from the loaded list */
+static bool options_deletes( OPTIONS *opts ) {
+    return opts->pop || opts->popN || opts->delN || opts->delMatch || opts->delTime;
+}
+
+/* Returns true if opts only works on the list of the selected notebook, so it can be
+ * run against a list that is already loaded. Batches and anything reading stdin could keep
+ * a server waiting on one client, so those aren't. */
+bool options_usesList( OPTIONS *opts ) {
+    return !( opts->usage || opts->version || opts->delA || opts->compact
+            || opts->server || opts->follow || opts->capture || opts->outputToFile
+            || opts->importRecords || opts->stats || opts->batch || opts->readsStdin
+            || ( opts->notebook && notebook_isMultiple( opts->notebook ) ) );
+}
+
 /* Executes options then destroys the list */
 void options_execute( OPTIONS *opts ) {
 
+    /* Searches across several notebooks load each one on its own */
+    if ( opts->notebook && notebook_isMultiple( opts->notebook ) ) {
+        int status = notebook_runAll( stdout, opts->notebook, opts );
+        if ( status )
+            exit( status );
+        return;
+    }
+
     /* No need to load the list for these options */
     if ( opts->usage ) {
         printUsage( stdout );
@@ -211,31 +532,104 @@ void options_execute( OPTIONS *opts ) {
         printf( "terminote %.1f\n", VERSION );
         exit( 0 );
     } else if ( opts->delA ) {
-        int fd = open( path, O_TRUNC, O_WRONLY );
-        close( fd );
+        /* Under the lock, so nobody is half way through writing to the file we empty */
+        int lockFd = store_lock();
+        int fd = open( path, O_WRONLY | O_TRUNC );
+        if ( fd >= 0 )
+            close( fd );
+        store_unlock( lockFd );
         exit( 0 );
+    } else if ( opts->compact ) {
+        COMPACT_STATS stats;
+        bool ok = store_compact( opts->compactTime, &stats );
+        if ( ok )
+            store_printStats( stdout, &stats );
+        exit( ok ? 0 : 1 );
+    } else if ( opts->server ) {
+        exit( server_start() ? 0 : 1 );
+    } else if ( opts->follow ) {
+        exit( nonInteractive_follow( stdout ) ? 0 : 1 );
     } else if ( opts->outputToFile ) {
-        printf( "Not implemented\n" ); //outStream = fopen( opts->outFile, "w" );
+        exit( export_notes( opts->outFile ) ? 0 : 1 );
+    } else if ( opts->importRecords ) {
+        int imported = import_records( opts->recordsFile );
+        if ( imported >= 0 )
+            printf( "Imported %d notes\n", imported );
+        exit( imported >= 0 ? 0 : 1 );
+    } else if ( opts->stats ) {
+        /* The header keeps them, so there's no need to read a single note */
+        STORE_STATS stats;
+        if ( !stats_read( path, &stats ) ) {
+            fprintf( stderr, "Error reading file, it may be corrupted. Run with the -R flag to "
+                    "delete the corrupted file. Sorry.\n" );
+            exit( 1 );
+        }
+        stats_print( stdout, &stats, opts->detailedStats );
+        exit( 0 );
     }
 
     FILE *outStream = NULL;
     outStream = stdout;
 
+    /* Deletes pick their notes by number, so nobody else may change the notes between
+     * loading them and saving, or two pops would both take the same note. A batch can
+     * have deletes anywhere in it, so it keeps the lock until its last commit. */
+    bool locked = options_deletes( opts ) || opts->batch;
+    int lockFd = locked ? store_lock() : -1;
+
     MESSAGE *msg = NULL;
     list_init( &msg );
     list_load( msg );
 
+    int status = options_run( opts, msg, outStream );
+
+    /* Clean up */
+    if ( msg ) {
+        if ( !( locked ? list_saveLocked( msg ) : list_save( msg ) ) )
+            status = 1;
+        list_destroy( &msg );
+    }
+    store_unlock( lockFd );
+    if ( status )
+        exit( status );
+}
+
+/* Runs the options that work on the list against msg, which is already loaded. Returns the
+ * exit status: 1 if a count, exists or newest search found nothing, otherwise 0. */
+int options_run( OPTIONS *opts, MESSAGE *msg, FILE *outStream ) {
+    int found = 1;
+
+    /* Batch commands only give a single searchTerm */
+    PATTERNS single, *patterns = &opts->patterns;
+    patterns_init( &single );
+    if ( ( opts->searchNotes || opts->grep ) && !patterns->numPatterns ) {
+        patterns_add( &single, opts->searchTerm );
+        patterns_build( &single );
+        patterns = &single;
+    }
+
     if ( opts->pop ) {
-        nonInteractive_pop( stdout, msg, "nptm", msg->root->totalMessages );
+        nonInteractive_pop( outStream, msg, "nptm", msg->root->totalMessages );
         msg->root->hasChanged = true;
 
     } else if ( opts->popN ) {
-        nonInteractive_pop( stdout, msg, "nptm", opts->popN );
+        nonInteractive_pop( outStream, msg, "nptm", opts->popN );
         msg->root->hasChanged = true;
 
     } else if ( opts->delN ) {
-        list_deleteNode( msg, opts->delN );
-        msg->root->hasChanged = true;
+        if ( opts->delTo > opts->delN )
+            fprintf( outStream, "Deleted %d notes\n",
+                    list_deleteRange( msg, opts->delN, opts->delTo ) );
+        else
+            list_deleteNode( msg, opts->delN );
+
+    } else if ( opts->delMatch ) {
+        fprintf( outStream, "Deleted %d notes\n",
+                list_deleteMatching( msg, list_matchSubstring, opts->delTerm ) );
+
+    } else if ( opts->delTime ) {
+        fprintf( outStream, "Deleted %d notes\n",
+                list_deleteMatching( msg, list_matchTimeRange, &opts->delRange ) );
 
     } else if ( opts->printN ) {
         MESSAGE *tmp = NULL;
@@ -249,21 +643,39 @@ void options_execute( OPTIONS *opts ) {
         list_printAll( outStream, msg );
 
     } else if ( opts->searchNotes ) {
-        nonInteractive_printAllWithSubString( outStream, msg,
-                opts->searchTerm );
+        found = nonInteractive_printAllWithSubString( outStream, msg,
+                patterns, opts->searchMode, opts->searchLimit, NULL );
 
     } else if ( opts->grep ) {
-        nonInteractive_grepMessages( outStream, msg, opts->searchTerm );
+        found = nonInteractive_grepMessages( outStream, msg, patterns,
+                opts->searchMode, opts->searchLimit, &opts->grepFormat, NULL );
+
+    } else if ( opts->fuzzy ) {
+        found = nonInteractive_fuzzySearch( outStream, msg, opts->fuzzyQuery,
+                opts->searchMode == SEARCH_NEWEST ? opts->searchLimit : FUZZY_DEFAULT_RESULTS );
 
     } else if ( opts->append ) {
         list_appendMessage( msg, opts->appendStr );
         msg->root->hasChanged = true;
 
     } else if ( opts->stats ) {
-        nonInteractive_printStats( outStream, msg );
+        /* Batches may have changed the notes since they were saved, so count what's loaded */
+        STORE_STATS stats;
+        stats_ofList( msg->root, &stats );
+        stats_print( outStream, &stats, opts->detailedStats );
 
     } else if ( opts->copyFromClip ) {
-        nonInteractive_appendClipboardContents( msg, "xclip -o  2>&1" );
+        nonInteractive_appendCommandOutput( msg, "xclip -o", false );
+        msg->root->hasChanged = true;
+
+    } else if ( opts->import ) {
+        int imported = import_files( msg, opts->importPaths, opts->importCount );
+        fprintf( outStream, "Imported %d notes\n", imported );
+        if ( imported > 0 )
+            msg->root->hasChanged = true;
+
+    } else if ( opts->capture ) {
+        nonInteractive_appendCommandOutput( msg, opts->command, opts->tagStatus );
         msg->root->hasChanged = true;
 
     } else if ( opts->printL ) {
@@ -271,15 +683,26 @@ void options_execute( OPTIONS *opts ) {
         if ( tmp ) {
             list_printMessage( outStream, "nptm", tmp );
         }
-    }
 
-    if ( opts->outputToFile )
-        fclose( outStream );
+    } else if ( opts->batch ) {
+        FILE *inStream = strcmp( opts->batchFile, "-" ) ? fopen( opts->batchFile, "r" ) : stdin;
+        if ( !inStream ) {
+            fprintf( stderr, "Unable to open %s\n", opts->batchFile );
+        } else {
+            nonInteractive_runBatch( inStream, outStream, msg );
+            if ( inStream != stdin )
+                fclose( inStream );
+        }
 
-    /* Clean up */
-    if ( msg ) {
-        list_save( msg );
-        list_destroy( &msg );
+    } else if ( !isatty( STDIN_FILENO ) ) {
+        /* Only a notebook was given, so append what's piped in like we do with no arguments */
+        nonInteractive_appendMessage( msg );
+        msg->root->hasChanged = true;
     }
+
+    patterns_free( &single );
+
+    /* Like grep, the search modes scripts use say whether anything matched */
+    return ( opts->searchMode != SEARCH_ALL || opts->fuzzy ) && found == 0;
 }
 
@@ -14,6 +14,21 @@
 #include "helperFunctions.h"
 #include "linkedList.h"
 #include "defines.h"
+#include "patterns.h"
+
+/* How -f and -g report what they find: every match, only how many there are, only whether
+ * there are any, or the newest few */
+enum {
+    SEARCH_ALL, SEARCH_COUNT, SEARCH_EXISTS, SEARCH_NEWEST
+};
+
+/* How -g prints the lines it finds: how many lines of the note to show before and after
+ * each one, and whether to print JSON Lines with where each match is in its line */
+typedef struct {
+    int before;
+    int after;
+    bool json;
+} GREP_FORMAT;
 
 typedef struct {
     /* Pop last note */
@@ -21,10 +36,17 @@ typedef struct {
     /* Pop n note */
     int popN;
 
-    /* Delete n note */
+    /* Delete n note, or notes n to delTo */
     int delN;
+    int delTo;
     /* Delete all notes */
     int delA;
+    /* Delete notes containing delTerm */
+    int delMatch;
+    char *delTerm;
+    /* Delete notes written within delRange */
+    int delTime;
+    TIME_RANGE delRange;
 
     /* Print n note */
     int printN;
@@ -38,6 +60,18 @@ typedef struct {
     int grep;
     char *searchTerm;
 
+    /* Everything -f or -g look for: each searchTerm and the lines of any pattern files */
+    PATTERNS patterns;
+
+    /* How the search reports its matches, and how many of the newest to print */
+    int searchMode;
+    int searchLimit;
+    GREP_FORMAT grepFormat;
+
+    /* Rank notes by how well they match fuzzyQuery */
+    int fuzzy;
+    char *fuzzyQuery;
+
     /* Append note */
     int append;
     char *appendStr;
@@ -54,8 +88,44 @@ typedef struct {
     /* Copy data from clipboard */
     int copyFromClip;
 
-    /* Number of messages */
+    /* Add the output of command as a note, ending it with the exit status if tagStatus is set */
+    int capture;
+    char *command;
+    int tagStatus;
+
+    /* Number of messages, with their sizes, times and size histogram if detailedStats is set */
     int stats;
+    int detailedStats;
+
+    /* Compact the data file, giving up after compactTime seconds if it's not 0 */
+    int compact;
+    double compactTime;
+
+    /* Notebook, or comma separated notebooks, to work on */
+    char *notebook;
+
+    /* Run commands from batchFile */
+    int batch;
+    char *batchFile;
+
+    /* Something is read from stdin, patterns with -w -, commands with -e - or a note piped
+     * in with nothing else to do */
+    int readsStdin;
+
+    /* Start the server */
+    int server;
+
+    /* Import the files matched by the paths or globs in importPaths as notes */
+    int import;
+    char **importPaths;
+    int importCount;
+
+    /* Import the notes in recordsFile, a JSON Lines or CSV file */
+    int importRecords;
+    char *recordsFile;
+
+    /* Print notes as they are added, like tail -f */
+    int follow;
 
     /* Output to file instead of stdout */
     int outputToFile;
@@ -66,8 +136,16 @@ typedef struct {
 /* Initialize options struct */
 OPTIONS *options_new();
 
-/* Parse command line options */
-void options_parse( OPTIONS *options, int argc, char **argv );
+/* Frees opts and everything it holds */
+void options_free( OPTIONS *opts );
+
+/* Parse command line options. Prints what's wrong and returns false if they can't be
+ * used, leaving the caller to decide whether to exit. */
+bool options_parse( OPTIONS *options, int argc, char **argv );
+
+/* Parses a note number or a range of note numbers, eg 5 or 5-10. Returns false if it
+ * isn't one. */
+bool validateRange( char *flag, char *arg, int *from, int *to );
 
 /* Print options for debugging */
 void options_print( OPTIONS *opts );
@@ -78,9 +156,18 @@ void options_validate( OPTIONS *opts );
 /* Print options for debugging */
 void options_print(OPTIONS *opts);
 
+/* Returns true if opts only works on the list of the selected notebook, so it can be
+ * run against a list that is already loaded. Batches and anything reading stdin could keep
+ * a server waiting on one client, so those aren't. */
+bool options_usesList( OPTIONS *opts );
+
 /* Executes options then destroys the list */
 void options_execute( OPTIONS *opts );
 
+/* Runs the options that work on the list against msg, which is already loaded. Returns the
+ * exit status: 1 if a count, exists or newest search found nothing, otherwise 0. */
+int options_run( OPTIONS *opts, MESSAGE *msg, FILE *outStream );
+
 
 
 
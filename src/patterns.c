@@ -0,0 +1,289 @@
+/*
+ * patterns.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "patterns.h"
+
+/* Sets up an empty set of patterns */
+void patterns_init( PATTERNS *set ) {
+    memset( set, 0, sizeof(PATTERNS) );
+}
+
+/* Adds pattern to the set, unless it is already in it */
+void patterns_add( PATTERNS *set, const char *pattern ) {
+    for ( int i = 0; i < set->numPatterns; i++ )
+        if ( !strcmp( set->patterns[i], pattern ) )
+            return;
+
+    if ( set->numPatterns == set->patternsSize ) {
+        set->patternsSize = set->patternsSize ? set->patternsSize * 2 : 16;
+        set->patterns = realloc( set->patterns, set->patternsSize * sizeof(char *) );
+        if ( !set->patterns ) {
+            fprintf( stderr, "Failed to allocate memory in patterns_add\n" );
+            exit( 1 );
+        }
+    }
+    set->patterns[set->numPatterns++] = strdup( pattern );
+}
+
+/* Adds each line of the file at file to the set, skipping blank ones. Returns false if the
+ * file can't be read. */
+bool patterns_addFile( PATTERNS *set, const char *file ) {
+    FILE *fp = strcmp( file, "-" ) ? fopen( file, "r" ) : stdin;
+    if ( !fp )
+        return false;
+
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t len;
+    while ( ( len = getline( &line, &lineSize, fp ) ) != -1 ) {
+        while ( len > 0 && ( line[len - 1] == '\n' || line[len - 1] == '\r' ) )
+            line[--len] = '\0';
+        if ( len > 0 )
+            patterns_add( set, line );
+    }
+
+    free( line );
+    if ( fp != stdin )
+        fclose( fp );
+    return true;
+}
+
+/* Grows the automaton to hold one more state, with no transitions and no output. Returns
+ * the new state. */
+static int patterns_newState( PATTERNS *set, int *statesSize ) {
+    if ( set->numStates == *statesSize ) {
+        *statesSize = *statesSize ? *statesSize * 2 : 64;
+        set->next = realloc( set->next, ( size_t ) *statesSize * set->numClasses * sizeof(int) );
+        set->output = realloc( set->output, *statesSize * sizeof(int) );
+        set->outLink = realloc( set->outLink, *statesSize * sizeof(int) );
+        if ( !set->next || !set->output || !set->outLink ) {
+            fprintf( stderr, "Failed to allocate memory in patterns_newState\n" );
+            exit( 1 );
+        }
+    }
+
+    int state = set->numStates++;
+    memset( set->next + ( size_t ) state * set->numClasses, 0, set->numClasses * sizeof(int) );
+    set->output[state] = -1;
+    set->outLink[state] = -1;
+    return state;
+}
+
+/* Builds the automaton. Must be called after the last pattern is added and before searching. */
+void patterns_build( PATTERNS *set ) {
+    /* A single pattern is left to strstr */
+    if ( set->numPatterns < 2 )
+        return;
+
+    memset( set->classes, 0, sizeof( set->classes ) );
+    set->numClasses = 1;
+    for ( int i = 0; i < set->numPatterns; i++ )
+        for ( unsigned char *c = ( unsigned char * ) set->patterns[i]; *c; c++ )
+            if ( !set->classes[*c] )
+                set->classes[*c] = set->numClasses++;
+
+    /* Put every pattern in a trie. The root is state 0, so a transition to 0 means there is
+     * no child yet. */
+    int statesSize = 0;
+    patterns_newState( set, &statesSize );
+    for ( int i = 0; i < set->numPatterns; i++ ) {
+        int state = 0;
+        for ( unsigned char *c = ( unsigned char * ) set->patterns[i]; *c; c++ ) {
+            int *to = &set->next[( size_t ) state * set->numClasses + set->classes[*c]];
+            if ( !*to ) {
+                int child = patterns_newState( set, &statesSize );
+                /* The table may have moved */
+                to = &set->next[( size_t ) state * set->numClasses + set->classes[*c]];
+                *to = child;
+            }
+            state = *to;
+        }
+        set->output[state] = i;
+    }
+
+    /* Walk the trie breadth first, so each state's failure state is done before it is
+     * needed. Missing transitions are filled in from the failure state, which turns the
+     * trie into a DFA that never has to follow a failure link while searching. */
+    int *fail = calloc( set->numStates, sizeof(int) );
+    int *queue = malloc( set->numStates * sizeof(int) );
+    set->accepting = calloc( set->numStates, sizeof(bool) );
+    if ( !fail || !queue || !set->accepting ) {
+        fprintf( stderr, "Failed to allocate memory in patterns_build\n" );
+        exit( 1 );
+    }
+
+    int head = 0, tail = 0;
+    queue[tail++] = 0;
+    while ( head < tail ) {
+        int state = queue[head++];
+        int *row = set->next + ( size_t ) state * set->numClasses;
+        int *failRow = set->next + ( size_t ) fail[state] * set->numClasses;
+
+        for ( int c = 0; c < set->numClasses; c++ ) {
+            int child = row[c];
+            if ( !child ) {
+                row[c] = state == 0 ? 0 : failRow[c];
+                continue;
+            }
+
+            fail[child] = state == 0 ? 0 : failRow[c];
+            set->outLink[child] = set->output[fail[child]] >= 0 ? fail[child]
+                    : set->outLink[fail[child]];
+            queue[tail++] = child;
+        }
+        set->accepting[state] = set->output[state] >= 0 || set->outLink[state] >= 0;
+    }
+
+    free( queue );
+    free( fail );
+}
+
+/* Returns true if any of the patterns occurs in the len bytes at text, which end in a NUL */
+bool patterns_any( PATTERNS *set, const char *text, size_t len ) {
+    if ( set->numPatterns < 2 )
+        return set->numPatterns && strstr( text, set->patterns[0] );
+
+    /* The root only accepts if one of the patterns is empty, which matches anything */
+    if ( set->accepting[0] )
+        return true;
+
+    const unsigned char *s = ( const unsigned char * ) text, *end = s + len;
+    int state = 0;
+    for ( ; s < end; s++ ) {
+        state = set->next[( size_t ) state * set->numClasses + set->classes[*s]];
+        if ( set->accepting[state] )
+            return true;
+    }
+    return false;
+}
+
+/* Finds every pattern that occurs in the len bytes at text, which end in a NUL, setting
+ * found[i] for each pattern i. Returns how many of them weren't set already. */
+int patterns_all( PATTERNS *set, const char *text, size_t len, bool *found ) {
+    int added = 0;
+
+    if ( set->numPatterns < 2 ) {
+        if ( set->numPatterns && !found[0] && strstr( text, set->patterns[0] ) )
+            found[0] = true, added++;
+        return added;
+    }
+
+    if ( set->output[0] >= 0 && !found[set->output[0]] ) {
+        found[set->output[0]] = true;
+        added++;
+    }
+
+    const unsigned char *s = ( const unsigned char * ) text, *end = s + len;
+    int state = 0;
+    for ( ; s < end; s++ ) {
+        state = set->next[( size_t ) state * set->numClasses + set->classes[*s]];
+        if ( !set->accepting[state] )
+            continue;
+
+        /* Every pattern ending here is on the chain of output links */
+        for ( int out = set->output[state] >= 0 ? state : set->outLink[state]; out >= 0;
+                out = set->outLink[out] ) {
+            if ( !found[set->output[out]] ) {
+                found[set->output[out]] = true;
+                added++;
+            }
+        }
+    }
+    return added;
+}
+
+/* Adds a match of pattern at offset to matches, growing it if it's full */
+static void patterns_addMatch( PATTERN_MATCH **matches, int *size, int count, int pattern,
+        size_t offset ) {
+    if ( count == *size ) {
+        *size = *size ? *size * 2 : 16;
+        *matches = realloc( *matches, *size * sizeof(PATTERN_MATCH) );
+        if ( !*matches ) {
+            fprintf( stderr, "Failed to allocate memory in patterns_addMatch\n" );
+            exit( 1 );
+        }
+    }
+    ( *matches )[count].pattern = pattern;
+    ( *matches )[count].offset = offset;
+}
+
+/* Orders matches by where they start, then by pattern */
+static int compareMatches( const void *a, const void *b ) {
+    const PATTERN_MATCH *x = a, *y = b;
+    if ( x->offset != y->offset )
+        return x->offset < y->offset ? -1 : 1;
+    return x->pattern - y->pattern;
+}
+
+/* Finds every place any of the patterns occurs in the len bytes at text, which end in a NUL,
+ * overlapping ones included. They are put in *matches in the order they start, growing it
+ * as needed with *size its length. Returns how many were found. */
+int patterns_matches( PATTERNS *set, const char *text, size_t len, PATTERN_MATCH **matches,
+        int *size ) {
+    int count = 0;
+
+    if ( set->numPatterns < 2 ) {
+        if ( !set->numPatterns )
+            return 0;
+
+        /* An empty pattern matches once, at the start */
+        const char *pattern = set->patterns[0];
+        for ( const char *s = strstr( text, pattern ); s; s = *pattern ? strstr( s + 1, pattern ) : NULL )
+            patterns_addMatch( matches, size, count++, 0, s - text );
+        return count;
+    }
+
+    if ( set->output[0] >= 0 )
+        patterns_addMatch( matches, size, count++, set->output[0], 0 );
+
+    const unsigned char *start = ( const unsigned char * ) text, *s = start, *end = s + len;
+    int state = 0;
+    for ( ; s < end; s++ ) {
+        state = set->next[( size_t ) state * set->numClasses + set->classes[*s]];
+        if ( !set->accepting[state] )
+            continue;
+
+        for ( int out = set->output[state] >= 0 ? state : set->outLink[state]; out > 0;
+                out = set->outLink[out] ) {
+            int pattern = set->output[out];
+            patterns_addMatch( matches, size, count++, pattern,
+                    s + 1 - start - strlen( set->patterns[pattern] ) );
+        }
+    }
+
+    /* They were found in the order they end, which for patterns of different lengths
+     * isn't the order they start */
+    qsort( *matches, count, sizeof(PATTERN_MATCH), compareMatches );
+    return count;
+}
+
+/* Writes the patterns set in found to outStream, separated by commas */
+void patterns_print( FILE *outStream, PATTERNS *set, bool *found ) {
+    const char *separator = "";
+    for ( int i = 0; i < set->numPatterns; i++ ) {
+        if ( found[i] ) {
+            fprintf( outStream, "%s%s", separator, set->patterns[i] );
+            separator = ", ";
+        }
+    }
+}
+
+/* Frees the patterns and the automaton */
+void patterns_free( PATTERNS *set ) {
+    for ( int i = 0; i < set->numPatterns; i++ )
+        free( set->patterns[i] );
+    free( set->patterns );
+    free( set->next );
+    free( set->output );
+    free( set->outLink );
+    free( set->accepting );
+    patterns_init( set );
+}
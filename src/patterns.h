@@ -0,0 +1,75 @@
+/*
+ * patterns.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef PATTERNS_H_
+#define PATTERNS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Where a pattern was found in a text */
+typedef struct {
+    int pattern;
+    size_t offset;
+} PATTERN_MATCH;
+
+/* A set of strings to search for at once. Once built, an Aho-Corasick automaton finds every
+ * one of them in a single pass over the text, however many there are. A set of one is
+ * searched for with strstr instead. Built sets are only read, so threads can share them. */
+typedef struct {
+    char **patterns;
+    int numPatterns;
+    int patternsSize;
+
+    /* Bytes that appear in no pattern share class 0, the rest get a class each, so the
+     * transition table only needs a column per class rather than per byte */
+    unsigned char classes[256];
+    int numClasses;
+
+    /* The automaton: the state to move to from each state on each class, the pattern that
+     * ends at each state or -1, and the next state along the failure links that ends a
+     * pattern or -1. accepting is set for states where any pattern ends. */
+    int *next;
+    int *output;
+    int *outLink;
+    bool *accepting;
+    int numStates;
+} PATTERNS;
+
+/* Sets up an empty set of patterns */
+void patterns_init( PATTERNS *set );
+
+/* Adds pattern to the set, unless it is already in it */
+void patterns_add( PATTERNS *set, const char *pattern );
+
+/* Adds each line of the file at file to the set, skipping blank ones. Returns false if the
+ * file can't be read. */
+bool patterns_addFile( PATTERNS *set, const char *file );
+
+/* Builds the automaton. Must be called after the last pattern is added and before searching. */
+void patterns_build( PATTERNS *set );
+
+/* Returns true if any of the patterns occurs in the len bytes at text, which end in a NUL */
+bool patterns_any( PATTERNS *set, const char *text, size_t len );
+
+/* Finds every pattern that occurs in the len bytes at text, which end in a NUL, setting
+ * found[i] for each pattern i. Returns how many of them weren't set already. */
+int patterns_all( PATTERNS *set, const char *text, size_t len, bool *found );
+
+/* Finds every place any of the patterns occurs in the len bytes at text, which end in a NUL,
+ * overlapping ones included. They are put in *matches in the order they start, growing it
+ * as needed with *size its length. Returns how many were found. */
+int patterns_matches( PATTERNS *set, const char *text, size_t len, PATTERN_MATCH **matches,
+        int *size );
+
+/* Writes the patterns set in found to outStream, separated by commas */
+void patterns_print( FILE *outStream, PATTERNS *set, bool *found );
+
+/* Frees the patterns and the automaton */
+void patterns_free( PATTERNS *set );
+
+#endif /* PATTERNS_H_ */
@@ -0,0 +1,204 @@
+/*
+ * search.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "search.h"
+#include "linkedList.h"
+#include "event.h"
+
+#include <time.h>
+
+/* How often the UI is told about new matches while the search is going */
+#define SEARCH_POST_MS 50
+
+/* Wakes the UI to show new matches, at most every SEARCH_POST_MS unless now is set */
+static void search_post( SEARCH *search, bool now ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    long ms = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    if ( now || ms - search->lastPost >= SEARCH_POST_MS ) {
+        search->lastPost = ms;
+        event_post( EVENT_SEARCH );
+    }
+}
+
+/* Adds a match to the results */
+static void search_addMatch( SEARCH *search, MESSAGE *msg, int line, int col ) {
+    pthread_mutex_lock( &search->lock );
+    if ( search->numMatches == search->matchesSize ) {
+        int size = search->matchesSize ? search->matchesSize * 2 : 256;
+        SEARCH_MATCH *bigger = realloc( search->matches, size * sizeof(SEARCH_MATCH) );
+        if ( !bigger ) {
+            fprintf( stderr, "Failed to allocate memory in search_addMatch\n" );
+            abort();
+        }
+        search->matches = bigger;
+        search->matchesSize = size;
+    }
+    SEARCH_MATCH *match = &search->matches[search->numMatches++];
+    match->msg = msg;
+    match->messageNum = msg->messageNum;
+    match->line = line;
+    match->col = col;
+    bool first = search->numMatches == 1;
+    pthread_cond_broadcast( &search->changed );
+    pthread_mutex_unlock( &search->lock );
+
+    /* The first match is jumped to straight away */
+    search_post( search, first );
+}
+
+/* Scans every line of every note for the term, checking between lines whether it's been cancelled */
+static void *search_run( void *arg ) {
+    SEARCH *search = arg;
+    size_t termLen = strlen( search->term );
+
+    for ( MESSAGE *msg = search->root->next; msg && !atomic_load( &search->cancelled );
+            msg = msg->next ) {
+        int lineNum = 0;
+
+        /* The last LINE is an empty placeholder */
+        for ( LINE *line = msg->first; line && line->next && !atomic_load( &search->cancelled );
+                line = line->next, lineNum++ ) {
+            for ( char *s = strstr( line->text, search->term ); s;
+                    s = strstr( s + termLen, search->term ) )
+                search_addMatch( search, msg, lineNum, s - line->text );
+        }
+    }
+
+    pthread_mutex_lock( &search->lock );
+    search->done = true;
+    pthread_cond_broadcast( &search->changed );
+    pthread_mutex_unlock( &search->lock );
+    search_post( search, true );
+    return NULL;
+}
+
+/* Sets up an idle search */
+void search_init( SEARCH *search ) {
+    memset( search, 0, sizeof( *search ) );
+    atomic_init( &search->cancelled, false );
+    pthread_mutex_init( &search->lock, NULL );
+    pthread_cond_init( &search->changed, NULL );
+    search->done = true;
+}
+
+/* Stops any search in progress and starts looking for term in every note after root.
+ * The notes must not change until the search is stopped. */
+void search_start( SEARCH *search, MESSAGE *root, const char *term ) {
+    search_stop( search );
+
+    snprintf( search->term, sizeof( search->term ), "%s", term );
+    search->root = root;
+    search->numMatches = 0;
+    search->done = false;
+    atomic_store( &search->cancelled, false );
+    search->lastPost = 0;
+
+    /* The matches are ordered by note number, so make sure they're up to date */
+    list_refreshNumbers( root );
+
+    if ( !*search->term ) {
+        search->done = true;
+        return;
+    }
+
+    if ( pthread_create( &search->thread, NULL, search_run, search ) == 0 )
+        search->running = true;
+    else
+        search_run( search );
+}
+
+/* Stops the search in progress, if any, and waits for its thread to finish */
+void search_stop( SEARCH *search ) {
+    if ( !search->running )
+        return;
+    atomic_store( &search->cancelled, true );
+    pthread_join( search->thread, NULL );
+    search->running = false;
+}
+
+/* Stops the search and frees its matches */
+void search_clear( SEARCH *search ) {
+    search_stop( search );
+    free( search->matches );
+    search->matches = NULL;
+    search->numMatches = search->matchesSize = 0;
+    search->term[0] = '\0';
+    search->done = true;
+}
+
+/* Returns how many matches have been found so far and sets done if the search has finished */
+int search_progress( SEARCH *search, bool *done ) {
+    pthread_mutex_lock( &search->lock );
+    int n = search->numMatches;
+    if ( done )
+        *done = search->done;
+    pthread_mutex_unlock( &search->lock );
+    return n;
+}
+
+/* Compares a match with a position. Returns <0, 0 or >0 like strcmp. */
+static int search_compare( SEARCH_MATCH *match, int messageNum, int line, int col ) {
+    if ( match->messageNum != messageNum )
+        return match->messageNum - messageNum;
+    if ( match->line != line )
+        return match->line - line;
+    return match->col - col;
+}
+
+/* Finds the first match after, or with backward the last match before, column col of
+ * line in the note numbered messageNum. Wraps around the ends of the list. If the search
+ * is still going and hasn't found one yet, waits for it if wait is set and otherwise
+ * returns false straight away. Returns false if there are no matches. */
+bool search_find( SEARCH *search, int messageNum, int line, int col, bool backward,
+        bool wait, SEARCH_MATCH *match ) {
+    bool found = false;
+
+    pthread_mutex_lock( &search->lock );
+    for ( ;; ) {
+        /* Index of the first match after the position */
+        int lo = 0, hi = search->numMatches;
+        while ( lo < hi ) {
+            int mid = ( lo + hi ) / 2;
+            if ( search_compare( &search->matches[mid], messageNum, line, col ) <= 0 )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if ( !backward && lo < search->numMatches ) {
+            *match = search->matches[lo];
+            found = true;
+        } else if ( backward && lo > 0
+                && search_compare( &search->matches[lo - 1], messageNum, line, col ) < 0 ) {
+            *match = search->matches[lo - 1];
+            found = true;
+        } else if ( backward && lo > 1 ) {
+            *match = search->matches[lo - 2];
+            found = true;
+        }
+
+        if ( found || search->done )
+            break;
+        if ( !wait ) {
+            pthread_mutex_unlock( &search->lock );
+            return false;
+        }
+
+        /* Nothing yet, but the search thread might still find one */
+        pthread_cond_wait( &search->changed, &search->lock );
+    }
+
+    /* Wrap around */
+    if ( !found && search->numMatches > 0 ) {
+        *match = search->matches[backward ? search->numMatches - 1 : 0];
+        found = true;
+    }
+    pthread_mutex_unlock( &search->lock );
+    return found;
+}
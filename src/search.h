@@ -0,0 +1,79 @@
+/*
+ * search.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "structures.h"
+
+#define MAX_SEARCH_SIZE 256
+
+/* Where a search term was found */
+typedef struct {
+    MESSAGE *msg;
+    int messageNum;
+
+    /* Line in the message and column in the line, both counting from 0 */
+    int line;
+    int col;
+} SEARCH_MATCH;
+
+/* A search running in the background over every note in a list. The matches are
+ * found in list order and can be read while the search is still going. The UI is woken
+ * with EVENT_SEARCH when there are new matches to show. */
+typedef struct {
+    char term[MAX_SEARCH_SIZE];
+    MESSAGE *root;
+
+    pthread_t thread;
+    bool running;
+
+    /* Set to tell the search thread to give up */
+    atomic_bool cancelled;
+
+    /* When the search thread last woke the UI, in milliseconds */
+    long lastPost;
+
+    /* Everything below is shared with the search thread and guarded by lock */
+    pthread_mutex_t lock;
+
+    /* Signalled when matches are found and when the search finishes */
+    pthread_cond_t changed;
+    SEARCH_MATCH *matches;
+    int numMatches;
+    int matchesSize;
+    bool done;
+} SEARCH;
+
+/* Sets up an idle search */
+void search_init( SEARCH *search );
+
+/* Stops any search in progress and starts looking for term in every note after root.
+ * The notes must not change until the search is stopped. */
+void search_start( SEARCH *search, MESSAGE *root, const char *term );
+
+/* Stops the search in progress, if any, and waits for its thread to finish */
+void search_stop( SEARCH *search );
+
+/* Stops the search and frees its matches */
+void search_clear( SEARCH *search );
+
+/* Returns how many matches have been found so far and sets done if the search has finished */
+int search_progress( SEARCH *search, bool *done );
+
+/* Finds the first match after, or with backward the last match before, column col of
+ * line in the note numbered messageNum. Wraps around the ends of the list. If the search
+ * is still going and hasn't found one yet, waits for it if wait is set and otherwise
+ * returns false straight away. Returns false if there are no matches. */
+bool search_find( SEARCH *search, int messageNum, int line, int col, bool backward,
+        bool wait, SEARCH_MATCH *match );
+
+#endif /* SEARCH_H_ */
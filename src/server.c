@@ -0,0 +1,346 @@
+/*
+ * server.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "server.h"
+#include "linkedList.h"
+#include "options.h"
+#include "store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* The three fds a client hands over: stdin, stdout and stderr */
+#define NUM_FDS 3
+
+/* Longest request we'll accept */
+#define MAX_REQUEST_SIZE ( 1 << 20 )
+
+/* How long a client has to send its request before we give up on it, in seconds */
+#define REQUEST_TIMEOUT 5
+
+static volatile sig_atomic_t stopServer = 0;
+
+/* Sets the stopServer flag so the accept loop shuts down cleanly */
+static void hndStop( int sig ) {
+    ( void ) sig;
+    stopServer = 1;
+}
+
+/* Fills addr with the socket address for the notebook at path. Returns false if the
+ * path is too long to fit in a socket address. */
+static bool server_address( struct sockaddr_un *addr ) {
+    memset( addr, 0, sizeof( *addr ) );
+    addr->sun_family = AF_UNIX;
+    int len = snprintf( addr->sun_path, sizeof( addr->sun_path ), "%s.sock", path );
+    return len > 0 && len < ( int ) sizeof( addr->sun_path );
+}
+
+/* Connects to the server for the notebook at path. Returns the socket or -1. */
+static int server_connect() {
+    struct sockaddr_un addr;
+    if ( !server_address( &addr ) )
+        return -1;
+
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( fd < 0 )
+        return -1;
+
+    if ( connect( fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) != 0 ) {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/* Reads exactly len bytes. Returns false on EOF or error. */
+static bool readAll( int fd, void *buffer, size_t len ) {
+    char *p = buffer;
+    while ( len > 0 ) {
+        ssize_t n = read( fd, p, len );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Returns true if another process has changed the data file since msg was loaded or saved */
+static bool server_storeChanged( MESSAGE *msg ) {
+    MESSAGE *root = msg->root;
+    FILE *fp = fopen( path, "rb" );
+    if ( !fp )
+        return root->dataEnd != 0;
+
+    STORE_HEADER header;
+    bool hasHeader = store_readHeader( fp, &header );
+    long end = store_dataEnd( fp, hasHeader ? &header : NULL );
+    fclose( fp );
+
+    if ( !hasHeader )
+        return !root->needsRewrite || end != root->dataEnd;
+    return root->needsRewrite || header.generation != root->generation
+            || end != root->dataEnd;
+}
+
+/* Reads a request, runs it against msg with the client's stdin, stdout and stderr,
+ * then tells the client we're done. A client that doesn't send its request in time is
+ * dropped, so it can't hold up the others. */
+static void server_handle( int clientFd, MESSAGE **msg ) {
+    int fds[NUM_FDS], payloadLen = 0, status = 1;
+    struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+    setsockopt( clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+    char control[CMSG_SPACE( sizeof( fds ) )];
+    memset( control, 0, sizeof( control ) );
+
+    /* The fds come along with the length of the request */
+    struct iovec iov = { &payloadLen, sizeof( payloadLen ) };
+    struct msghdr header;
+    memset( &header, 0, sizeof( header ) );
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof( control );
+
+    if ( recvmsg( clientFd, &header, 0 ) != sizeof( payloadLen ) )
+        return;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &header );
+    if ( !cmsg || cmsg->cmsg_type != SCM_RIGHTS
+            || cmsg->cmsg_len != CMSG_LEN( sizeof( fds ) ) )
+        return;
+    memcpy( fds, CMSG_DATA( cmsg ), sizeof( fds ) );
+
+    char *payload = NULL;
+    if ( payloadLen <= 0 || payloadLen > MAX_REQUEST_SIZE
+            || !( payload = malloc( payloadLen ) )
+            || !readAll( clientFd, payload, payloadLen )
+            || payload[payloadLen - 1] != '\0' )
+        goto done;
+
+    /* The payload is the client's working directory then its arguments */
+    int argc = 0;
+    char *end = payload + payloadLen;
+    char **argv = malloc( ( payloadLen + 1 ) * sizeof(char *) );
+    char *cwd = payload;
+    for ( char *s = cwd + strlen( cwd ) + 1; s < end; s += strlen( s ) + 1 )
+        argv[argc++] = s;
+    argv[argc] = NULL;
+
+    if ( argc < 1 || chdir( cwd ) != 0 ) {
+        free( argv );
+        goto done;
+    }
+
+    /* Someone got at the file without us, so start again from what's there */
+    if ( server_storeChanged( *msg ) ) {
+        list_destroy( msg );
+        list_init( msg );
+        list_load( *msg );
+    }
+
+    /* Swap the client's stdin, stdout and stderr in for ours for the length of the request */
+    int saved[NUM_FDS];
+    fflush( stdout );
+    fflush( stderr );
+    for ( int i = 0; i < NUM_FDS; i++ ) {
+        saved[i] = dup( i );
+        dup2( fds[i], i );
+    }
+    clearerr( stdin );
+
+    OPTIONS *opts = options_new();
+#ifdef __GLIBC__
+    optind = 0;
+#else
+    optreset = 1;
+    optind = 1;
+#endif
+
+    /* A bad request only fails that request, and the client has had the reason printed */
+    if ( options_parse( opts, argc, argv ) ) {
+        status = options_run( opts, *msg, stdout );
+        if ( !list_save( *msg ) )
+            status = 1;
+    } else {
+        status = 1;
+    }
+    options_free( opts );
+
+    fflush( stdout );
+    fflush( stderr );
+    for ( int i = 0; i < NUM_FDS; i++ ) {
+        dup2( saved[i], i );
+        close( saved[i] );
+    }
+    clearerr( stdin );
+    free( argv );
+
+    done:
+    write( clientFd, &status, sizeof( status ) );
+    free( payload );
+    for ( int i = 0; i < NUM_FDS; i++ )
+        close( fds[i] );
+}
+
+/* Serves requests until told to stop with SIGTERM or SIGINT */
+void server_run( int listenFd ) {
+    struct sigaction sa;
+    memset( &sa, 0, sizeof( sa ) );
+
+    /* No SA_RESTART, so accept() returns when we're told to stop */
+    sa.sa_handler = hndStop;
+    sigaction( SIGTERM, &sa, NULL );
+    sigaction( SIGINT, &sa, NULL );
+
+    /* A client that goes away mid-request shouldn't take us with it */
+    sa.sa_handler = SIG_IGN;
+    sigaction( SIGPIPE, &sa, NULL );
+
+    MESSAGE *msg = NULL;
+    list_init( &msg );
+    list_load( msg );
+
+    while ( !stopServer ) {
+        int clientFd = accept( listenFd, NULL, NULL );
+        if ( clientFd < 0 )
+            continue;
+        server_handle( clientFd, &msg );
+        close( clientFd );
+    }
+
+    struct sockaddr_un addr;
+    server_address( &addr );
+    unlink( addr.sun_path );
+    close( listenFd );
+
+    list_save( msg );
+    list_destroy( &msg );
+}
+
+/* Starts a server in the background that keeps the notebook at path loaded and runs
+ * requests from terminote clients against it. Returns false if it couldn't be started. */
+bool server_start() {
+    struct sockaddr_un addr;
+    if ( !server_address( &addr ) ) {
+        fprintf( stderr, "Path to %s is too long for a socket\n", path );
+        return false;
+    }
+
+    int fd = server_connect();
+    if ( fd >= 0 ) {
+        close( fd );
+        fprintf( stderr, "A server is already running for %s\n", path );
+        return false;
+    }
+
+    /* Nobody answered, so any socket left lying around is stale */
+    unlink( addr.sun_path );
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( fd < 0 || bind( fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) != 0
+            || listen( fd, 64 ) != 0 ) {
+        perror( "Unable to start server" );
+        return false;
+    }
+
+    pid_t pid = fork();
+    if ( pid < 0 ) {
+        perror( "Unable to start server" );
+        return false;
+    } else if ( pid > 0 ) {
+        printf( "Started terminote server for %s (pid %d)\n", path, pid );
+        return true;
+    }
+
+    /* In the child: detach from the terminal and serve */
+    setsid();
+    int devNull = open( "/dev/null", O_RDWR );
+    for ( int i = 0; i < NUM_FDS; i++ )
+        dup2( devNull, i );
+    close( devNull );
+
+    server_run( fd );
+    exit( 0 );
+}
+
+/* Passes argv to the server for the notebook at path, along with our stdin, stdout and stderr,
+ * and waits for it to finish. Returns false if there is no server or it never got the
+ * request, in which case we should do the work ourselves. Exits with the server's status if
+ * it did the work, and with 1 if it went away without saying whether it did. */
+bool server_forward( int argc, char **argv ) {
+    int fd = server_connect();
+    if ( fd < 0 )
+        return false;
+
+    char *cwd = getcwd( NULL, 0 );
+    if ( !cwd ) {
+        close( fd );
+        return false;
+    }
+
+    /* Build the payload: our working directory then our arguments, each NUL terminated */
+    int payloadLen = strlen( cwd ) + 1;
+    for ( int i = 0; i < argc; i++ )
+        payloadLen += strlen( argv[i] ) + 1;
+
+    char *payload = malloc( sizeof(int) + payloadLen );
+    char *p = payload + sizeof(int);
+    memcpy( payload, &payloadLen, sizeof(int) );
+    p = stpcpy( p, cwd ) + 1;
+    for ( int i = 0; i < argc; i++ )
+        p = stpcpy( p, argv[i] ) + 1;
+    free( cwd );
+
+    /* Send the length along with our stdin, stdout and stderr, then the rest */
+    int fds[NUM_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE( sizeof( fds ) )];
+    memset( control, 0, sizeof( control ) );
+
+    struct iovec iov = { payload, sizeof(int) };
+    struct msghdr header;
+    memset( &header, 0, sizeof( header ) );
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof( control );
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &header );
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN( sizeof( fds ) );
+    memcpy( CMSG_DATA( cmsg ), fds, sizeof( fds ) );
+
+    fflush( stdout );
+    bool sent = sendmsg( fd, &header, 0 ) == sizeof(int)
+            && write( fd, payload + sizeof(int), payloadLen ) == payloadLen;
+    free( payload );
+
+    /* The server won't run a request it didn't get all of, so we can still do it ourselves */
+    if ( !sent ) {
+        close( fd );
+        return false;
+    }
+
+    /* Once it has it, doing it again here could do it twice */
+    int status;
+    if ( !readAll( fd, &status, sizeof( status ) ) ) {
+        fprintf( stderr, "Error: the server went away before finishing, check whether it "
+                "was done\n" );
+        status = 1;
+    }
+
+    close( fd );
+    exit( status );
+}
@@ -0,0 +1,27 @@
+/*
+ * server.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <stdbool.h>
+
+#include "structures.h"
+
+/* Starts a server in the background that keeps the notebook at path loaded and runs
+ * requests from terminote clients against it. Returns false if it couldn't be started. */
+bool server_start();
+
+/* Serves requests until told to stop with SIGTERM or SIGINT */
+void server_run( int listenFd );
+
+/* Passes argv to the server for the notebook at path, along with our stdin, stdout and stderr,
+ * and waits for it to finish. Returns false if there is no server, in which case we should
+ * do the work ourselves. Exits with the server's status if it did the work. */
+bool server_forward( int argc, char **argv );
+
+#endif /* SERVER_H_ */
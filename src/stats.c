@@ -0,0 +1,377 @@
+/*
+ * stats.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "stats.h"
+#include "store.h"
+#include "helperFunctions.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The oldest and newest of the times seen so far. Notes are compared by a key read straight
+ * from their time, so only the two that win have to be turned into real times. */
+typedef struct {
+    long oldestKey;
+    long newestKey;
+    char oldest[MAX_TIME_SIZE];
+    char newest[MAX_TIME_SIZE];
+} STATS_TIMES;
+
+/* Returns a key for a time that sorts as the time does */
+static long stats_key( long year, long month, long day, long hour, long min, long sec ) {
+    return ( ( ( ( year * 12 + month ) * 32 + day ) * 24 + hour ) * 60 + min ) * 60 + sec;
+}
+
+/* Reads the number at s, after any spaces, into n. Returns where it ends, or NULL if there
+ * isn't one. */
+static const char *stats_number( const char *s, long *n ) {
+    while ( *s == ' ' )
+        s++;
+    if ( *s < '0' || *s > '9' )
+        return NULL;
+    for ( *n = 0; *s >= '0' && *s <= '9'; s++ )
+        *n = *n * 10 + *s - '0';
+    return s;
+}
+
+/* Returns a key for a time in the format list_setTime writes that sorts as the time does,
+ * or -1 if it can't be read. It reads what parseNoteTime does without going through
+ * mktime, which is far too slow to call for every note. */
+static long stats_timeKey( const char *time ) {
+    static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month[4];
+    long day, hour, min, sec, year;
+    int len = 0;
+
+    /* Skip the day of the week */
+    while ( *time == ' ' )
+        time++;
+    while ( *time && *time != ' ' )
+        time++;
+    while ( *time == ' ' )
+        time++;
+
+    while ( len < 3 && time[len] && time[len] != ' ' ) {
+        month[len] = time[len];
+        len++;
+    }
+    month[len] = '\0';
+    char *m = strstr( months, month );
+    if ( !len || !m )
+        return -1;
+
+    time += len;
+    if ( !( time = stats_number( time, &day ) ) || !( time = stats_number( time, &hour ) )
+            || *time++ != ':' || !( time = stats_number( time, &min ) ) || *time++ != ':'
+            || !( time = stats_number( time, &sec ) ) || !stats_number( time, &year ) )
+        return -1;
+
+    return stats_key( year, ( m - months ) / 3, day, hour, min, sec );
+}
+
+/* Returns the key stats_timeKey gives the time t is written as, or -1 if there's no time */
+static long stats_keyOf( long t ) {
+    time_t when = t;
+    struct tm tm;
+    if ( t < 0 || !localtime_r( &when, &tm ) )
+        return -1;
+    return stats_key( tm.tm_year + 1900, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min,
+            tm.tm_sec );
+}
+
+/* Starts stats off with no notes */
+void stats_init( STORE_STATS *stats ) {
+    memset( stats, 0, sizeof(STORE_STATS) );
+    stats->oldest = stats->newest = -1;
+}
+
+/* Returns true if header was written with statistics, rather than before they were added */
+bool stats_inHeader( STORE_HEADER *header ) {
+    return header->headerSize >= ( int ) ( offsetof( STORE_HEADER, stats ) + sizeof(STORE_STATS) );
+}
+
+/* Returns the bucket of the size histogram a note of bytes bytes goes in */
+int stats_bucket( long bytes ) {
+    int bucket = 0;
+    for ( long limit = 64; bytes > limit && bucket < STATS_BUCKETS - 1; limit *= 2 )
+        bucket++;
+    return bucket;
+}
+
+/* Returns how many UTF-8 characters there are in the len bytes at text */
+long stats_characters( const char *text, size_t len ) {
+    const unsigned char *s = ( const unsigned char * ) text, *end = s + len;
+    long continuations = 0;
+    uint64_t word;
+
+    /* Every byte but those that carry on a character, 10xxxxxx, starts one. They are
+     * counted a word at a time: shifting each byte's bit 6 up to bit 7 leaves bit 7 set
+     * only in those. The top bit of the byte below lands on bit 0, outside the mask. */
+    for ( ; end - s >= 8; s += 8 ) {
+        memcpy( &word, s, 8 );
+        continuations += __builtin_popcountll(
+                word & ~( word << 1 ) & 0x8080808080808080ULL );
+    }
+    for ( ; s < end; s++ )
+        continuations += ( *s & 0xc0 ) == 0x80;
+    return len - continuations;
+}
+
+/* Adds the lines, characters and bytes of the len bytes at text to note */
+void stats_count( NOTE_STATS *note, const char *text, size_t len ) {
+    const char *s = text, *end = text + len;
+    while ( ( s = memchr( s, '\n', end - s ) ) ) {
+        note->lines++;
+        s++;
+    }
+    note->chars += stats_characters( text, len );
+    note->bytes += len;
+}
+
+/* Adds note to stats. A note whose time couldn't be read leaves the oldest and newest alone. */
+void stats_add( STORE_STATS *stats, NOTE_STATS *note ) {
+    stats->notes++;
+    stats->lines += note->lines;
+    stats->chars += note->chars;
+    stats->bytes += note->bytes;
+    stats->sizes[stats_bucket( note->bytes )]++;
+
+    if ( note->time < 0 )
+        return;
+    if ( stats->oldest < 0 || note->time < stats->oldest )
+        stats->oldest = note->time;
+    if ( note->time > stats->newest )
+        stats->newest = note->time;
+}
+
+/* Adds everything counted in from to stats */
+void stats_merge( STORE_STATS *stats, STORE_STATS *from ) {
+    stats->notes += from->notes;
+    stats->lines += from->lines;
+    stats->chars += from->chars;
+    stats->bytes += from->bytes;
+    for ( int i = 0; i < STATS_BUCKETS; i++ )
+        stats->sizes[i] += from->sizes[i];
+
+    if ( from->oldest >= 0 && ( stats->oldest < 0 || from->oldest < stats->oldest ) )
+        stats->oldest = from->oldest;
+    if ( from->newest > stats->newest )
+        stats->newest = from->newest;
+}
+
+/* Starts times off with nothing seen */
+static void stats_startTimes( STATS_TIMES *times ) {
+    times->oldestKey = LONG_MAX;
+    times->newestKey = -1;
+}
+
+/* Keeps time if it is older or newer than any seen so far */
+static void stats_seeTime( STATS_TIMES *times, const char *time ) {
+    long key = stats_timeKey( time );
+    if ( key < 0 )
+        return;
+    if ( key < times->oldestKey ) {
+        times->oldestKey = key;
+        snprintf( times->oldest, MAX_TIME_SIZE, "%s", time );
+    }
+    if ( key > times->newestKey ) {
+        times->newestKey = key;
+        snprintf( times->newest, MAX_TIME_SIZE, "%s", time );
+    }
+}
+
+/* Sets the oldest and newest of stats to those in times */
+static void stats_finishTimes( STATS_TIMES *times, STORE_STATS *stats ) {
+    stats->oldest = stats->newest = -1;
+    if ( times->newestKey >= 0 ) {
+        stats->oldest = parseNoteTime( times->oldest );
+        stats->newest = parseNoteTime( times->newest );
+    }
+}
+
+/* Adds first and every note after it to stats */
+void stats_addNotes( STORE_STATS *stats, MESSAGE *first ) {
+    STORE_STATS added;
+    STATS_TIMES times;
+
+    stats_init( &added );
+    stats_startTimes( &times );
+    for ( MESSAGE *msg = first; msg; msg = msg->next ) {
+        stats_add( &added, &msg->stats );
+        stats_seeTime( &times, msg->time );
+    }
+    stats_finishTimes( &times, &added );
+    stats_merge( stats, &added );
+}
+
+/* Takes the counts of note out of stats, leaving the oldest and newest alone */
+static void stats_subtract( STORE_STATS *stats, NOTE_STATS *note ) {
+    stats->notes--;
+    stats->lines -= note->lines;
+    stats->chars -= note->chars;
+    stats->bytes -= note->bytes;
+    stats->sizes[stats_bucket( note->bytes )]--;
+}
+
+/* Returns true if what's left in stats may have lost its oldest or newest note to the notes
+ * in times, which have been taken out of it */
+static bool stats_lostTimes( STORE_STATS *stats, STATS_TIMES *times ) {
+    if ( stats->notes <= 0 ) {
+        stats_init( stats );
+        return false;
+    }
+    return times->newestKey >= 0 && ( times->oldestKey <= stats_keyOf( stats->oldest )
+            || times->newestKey >= stats_keyOf( stats->newest ) );
+}
+
+/* Takes note, written at time, out of stats. Returns true if it was the oldest or newest,
+ * like stats_removeNotes. */
+bool stats_remove( STORE_STATS *stats, NOTE_STATS *note, const char *time ) {
+    STATS_TIMES times;
+    stats_startTimes( &times );
+    stats_subtract( stats, note );
+    stats_seeTime( &times, time );
+    return stats_lostTimes( stats, &times );
+}
+
+/* Takes first and every note after it, whose lines may have been freed, out of stats.
+ * There's no telling which note is next oldest or newest, so returns true if one of them
+ * was either and they need finding again with stats_scan. */
+bool stats_removeNotes( STORE_STATS *stats, MESSAGE *first ) {
+    STATS_TIMES times;
+    stats_startTimes( &times );
+
+    for ( MESSAGE *msg = first; msg; msg = msg->next ) {
+        stats_subtract( stats, &msg->stats );
+        stats_seeTime( &times, msg->time );
+    }
+    return stats_lostTimes( stats, &times );
+}
+
+/* Works out the statistics of every note in the list rooted at root */
+void stats_ofList( MESSAGE *root, STORE_STATS *stats ) {
+    stats_init( stats );
+    stats_addNotes( stats, root->next );
+}
+
+/* Finds the oldest and newest of the notes in the list rooted at root again, leaving the
+ * rest of stats as it is */
+void stats_listTimes( MESSAGE *root, STORE_STATS *stats ) {
+    STATS_TIMES times;
+    stats_startTimes( &times );
+    for ( MESSAGE *msg = root->next; msg; msg = msg->next )
+        stats_seeTime( &times, msg->time );
+    stats_finishTimes( &times, stats );
+}
+
+/* Works out the statistics of the live records of fp from start up to end. With timesOnly
+ * the bodies are skipped and only the oldest and newest are found again, leaving the rest
+ * of stats as it is. Returns false if a record is corrupt. */
+bool stats_scan( FILE *fp, long start, long end, bool hasHeader, STORE_STATS *stats,
+        bool timesOnly ) {
+    STATS_TIMES times;
+    NOTE_STATS note;
+    RECORD rec;
+    char *body = NULL;
+    int status;
+
+    if ( !timesOnly )
+        stats_init( stats );
+    stats_startTimes( &times );
+
+    fseek( fp, start, SEEK_SET );
+    while ( ( status = store_readRecord( fp, &rec, end, hasHeader, timesOnly ? NULL : &body ) )
+            == STORE_OK ) {
+        if ( !( rec.flags & RECORD_DELETED ) ) {
+            if ( !timesOnly ) {
+                memset( &note, 0, sizeof(NOTE_STATS) );
+                note.time = -1;
+                stats_count( &note, body, rec.numChars );
+                stats_add( stats, &note );
+            }
+            stats_seeTime( &times, rec.time );
+        }
+        free( body );
+        body = NULL;
+    }
+
+    stats_finishTimes( &times, stats );
+    return status == STORE_EOF;
+}
+
+/* Reads the statistics of the data file at dataPath from its header, without touching the
+ * records, unless the file was written before the header held them. A missing file has no
+ * notes. Returns false if the file can't be read. */
+bool stats_read( const char *dataPath, STORE_STATS *stats ) {
+    stats_init( stats );
+
+    FILE *fp = fopen( dataPath, "rb" );
+    if ( !fp )
+        return errno == ENOENT;
+
+    STORE_HEADER header;
+    bool ok = true, hasHeader = store_readHeader( fp, &header );
+    if ( hasHeader && stats_inHeader( &header ) )
+        *stats = header.stats;
+    else
+        ok = stats_scan( fp, ftell( fp ), store_dataEnd( fp, hasHeader ? &header : NULL ),
+                hasHeader, stats, false );
+
+    fclose( fp );
+    return ok;
+}
+
+/* Writes a size in bytes to dest, in KiB or MiB if it is a whole number of them */
+static void stats_formatSize( long bytes, char *dest, size_t size ) {
+    if ( bytes >= 1024 * 1024 && bytes % ( 1024 * 1024 ) == 0 )
+        snprintf( dest, size, "%ld MiB", bytes / ( 1024 * 1024 ) );
+    else if ( bytes >= 1024 && bytes % 1024 == 0 )
+        snprintf( dest, size, "%ld KiB", bytes / 1024 );
+    else
+        snprintf( dest, size, "%ld B", bytes );
+}
+
+/* Prints the time t was in the format list_setTime uses, or none if there isn't one */
+static void stats_printTime( FILE *outStream, const char *label, long t ) {
+    char text[MAX_TIME_SIZE] = "none";
+    time_t when = t;
+    struct tm tm;
+
+    if ( t >= 0 && localtime_r( &when, &tm ) )
+        strftime( text, sizeof( text ), "%a %b %e %H:%M:%S %Y", &tm );
+    fprintf( outStream, "%s: %s\n", label, text );
+}
+
+/* Prints the number of notes, lines and characters in stats and, if detailed is set, their
+ * size, the oldest and newest and the size histogram */
+void stats_print( FILE *outStream, STORE_STATS *stats, bool detailed ) {
+    fprintf( outStream, "Messages: %ld\nLines: %ld\nCharacters: %ld\n", stats->notes,
+            stats->lines, stats->chars );
+    if ( !detailed )
+        return;
+
+    fprintf( outStream, "Bytes: %ld\nAverage size: %ld bytes\n", stats->bytes,
+            stats->notes ? stats->bytes / stats->notes : 0 );
+    stats_printTime( outStream, "Oldest", stats->oldest );
+    stats_printTime( outStream, "Newest", stats->newest );
+
+    fprintf( outStream, "Sizes:\n" );
+    char size[32];
+    for ( int i = 0; i < STATS_BUCKETS; i++ ) {
+        if ( !stats->sizes[i] )
+            continue;
+        if ( i < STATS_BUCKETS - 1 ) {
+            stats_formatSize( 64L << i, size, sizeof( size ) );
+            fprintf( outStream, "  up to %s: %ld\n", size, stats->sizes[i] );
+        } else {
+            stats_formatSize( 64L << ( i - 1 ), size, sizeof( size ) );
+            fprintf( outStream, "  over %s: %ld\n", size, stats->sizes[i] );
+        }
+    }
+}
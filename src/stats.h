@@ -0,0 +1,71 @@
+/*
+ * stats.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "structures.h"
+
+/* Starts stats off with no notes */
+void stats_init( STORE_STATS *stats );
+
+/* Returns true if header was written with statistics, rather than before they were added */
+bool stats_inHeader( STORE_HEADER *header );
+
+/* Returns the bucket of the size histogram a note of bytes bytes goes in */
+int stats_bucket( long bytes );
+
+/* Returns how many UTF-8 characters there are in the len bytes at text */
+long stats_characters( const char *text, size_t len );
+
+/* Adds the lines, characters and bytes of the len bytes at text to note */
+void stats_count( NOTE_STATS *note, const char *text, size_t len );
+
+/* Adds note to stats. A note whose time couldn't be read leaves the oldest and newest alone. */
+void stats_add( STORE_STATS *stats, NOTE_STATS *note );
+
+/* Adds everything counted in from to stats */
+void stats_merge( STORE_STATS *stats, STORE_STATS *from );
+
+/* Adds first and every note after it to stats */
+void stats_addNotes( STORE_STATS *stats, MESSAGE *first );
+
+/* Takes note, written at time, out of stats. Returns true if it was the oldest or newest,
+ * like stats_removeNotes. */
+bool stats_remove( STORE_STATS *stats, NOTE_STATS *note, const char *time );
+
+/* Takes first and every note after it, whose lines may have been freed, out of stats.
+ * There's no telling which note is next oldest or newest, so returns true if one of them
+ * was either and they need finding again with stats_scan. */
+bool stats_removeNotes( STORE_STATS *stats, MESSAGE *first );
+
+/* Works out the statistics of every note in the list rooted at root */
+void stats_ofList( MESSAGE *root, STORE_STATS *stats );
+
+/* Finds the oldest and newest of the notes in the list rooted at root again, leaving the
+ * rest of stats as it is */
+void stats_listTimes( MESSAGE *root, STORE_STATS *stats );
+
+/* Works out the statistics of the live records of fp from start up to end. With timesOnly
+ * the bodies are skipped and only the oldest and newest are found again, leaving the rest
+ * of stats as it is. Returns false if a record is corrupt. */
+bool stats_scan( FILE *fp, long start, long end, bool hasHeader, STORE_STATS *stats,
+        bool timesOnly );
+
+/* Reads the statistics of the data file at dataPath from its header, without touching the
+ * records, unless the file was written before the header held them. A missing file has no
+ * notes. Returns false if the file can't be read. */
+bool stats_read( const char *dataPath, STORE_STATS *stats );
+
+/* Prints the number of notes, lines and characters in stats and, if detailed is set, their
+ * size, the oldest and newest and the size histogram */
+void stats_print( FILE *outStream, STORE_STATS *stats, bool detailed );
+
+#endif /* STATS_H_ */
@@ -0,0 +1,559 @@
+/*
+ * store.c
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#include "store.h"
+#include "stats.h"
+#include "linkedList.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/file.h> // flock
+#include <sys/sendfile.h>
+#include <time.h>
+
+#define COPY_BUFFER_SIZE ( 1 << 20 )
+
+/* The compacted part is rewritten once more than 1 in this many of its bytes are deleted */
+#define COMPACT_DEAD_SHARE 4
+
+/* Returns a monotonic time in seconds */
+double store_now() {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Takes the writer lock for the data file at path, blocking until it is free.
+ * Readers never take it. Returns the lock fd, or -1 if the lock file can't be opened. */
+int store_lock() {
+    int buffSize = strlen( path ) + strlen( ".lock" ) + 1;
+    char *lockPath = malloc( buffSize );
+    snprintf( lockPath, buffSize, "%s.lock", path );
+
+    int fd = open( lockPath, O_RDWR | O_CREAT, 0600 );
+    free( lockPath );
+    if ( fd < 0 )
+        return -1;
+
+    if ( flock( fd, LOCK_EX ) != 0 ) {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/* Releases a lock taken with store_lock */
+void store_unlock( int fd ) {
+    if ( fd < 0 )
+        return;
+    flock( fd, LOCK_UN );
+    close( fd );
+}
+
+/* Reads the data file header if there is one. Returns true if a header was read and leaves
+ * fp at the first record, otherwise rewinds fp and returns false. */
+bool store_readHeader( FILE *fp, STORE_HEADER *header ) {
+    memset( header, 0, sizeof(STORE_HEADER) );
+    rewind( fp );
+
+    size_t fixedSize = STORE_MAGIC_LEN + 2 * sizeof(int);
+    if ( fread( header, 1, fixedSize, fp ) != fixedSize
+            || memcmp( header->magic, STORE_MAGIC, STORE_MAGIC_LEN ) != 0
+            || header->headerSize < ( int ) fixedSize ) {
+        rewind( fp );
+        return false;
+    }
+
+    /* Read as much of the header as we understand and skip the rest */
+    size_t size = header->headerSize;
+    if ( size > sizeof(STORE_HEADER) )
+        size = sizeof(STORE_HEADER);
+    if ( fread( ( char * ) header + fixedSize, 1, size - fixedSize, fp ) != size - fixedSize ) {
+        rewind( fp );
+        return false;
+    }
+    fseek( fp, header->headerSize, SEEK_SET );
+
+    if ( header->nextId < 1 )
+        header->nextId = 1;
+    return true;
+}
+
+/* Returns true if header is as big as the one store_writeHeader writes, so it can be
+ * written over without touching the first record */
+bool store_headerCurrent( STORE_HEADER *header ) {
+    return header->headerSize >= ( int ) sizeof(STORE_HEADER);
+}
+
+/* Writes header at the start of fp */
+void store_writeHeader( FILE *fp, STORE_HEADER *header ) {
+    memcpy( header->magic, STORE_MAGIC, STORE_MAGIC_LEN );
+    header->version = STORE_VERSION;
+    header->headerSize = sizeof(STORE_HEADER);
+
+    rewind( fp );
+    fwrite( header, sizeof(STORE_HEADER), 1, fp );
+}
+
+/* Returns where the committed records in fp end */
+long store_dataEnd( FILE *fp, STORE_HEADER *header ) {
+    if ( header && header->dataEnd > 0 )
+        return header->dataEnd;
+
+    /* Files without a header, or with an older one, end at the end of the file */
+    struct stat st;
+    if ( fstat( fileno( fp ), &st ) != 0 )
+        return 0;
+    return st.st_size;
+}
+
+/* Reads a path or time: an int length then that many bytes including the terminator */
+static int store_readString( FILE *fp, char *dest, int maxLen, long end ) {
+    int len;
+    if ( fread( &len, sizeof( len ), 1, fp ) != 1 || len < 1 || len > maxLen
+            || ftell( fp ) + len > end )
+        return STORE_CORRUPT;
+    if ( fread( dest, sizeof(char), len, fp ) != ( size_t ) len )
+        return STORE_CORRUPT;
+    dest[len - 1] = '\0';
+    return STORE_OK;
+}
+
+/* Reads the record at the current position of fp, verifying every length against the
+ * record limits and end. If text is not NULL the note body is read into a malloced
+ * buffer there, otherwise it is skipped. Returns STORE_OK, STORE_EOF or STORE_CORRUPT. */
+int store_readRecord( FILE *fp, RECORD *rec, long end, bool hasHeader, char **text ) {
+    rec->offset = ftell( fp );
+    if ( rec->offset >= end )
+        return STORE_EOF;
+
+    rec->id = 0;
+    rec->flags = 0;
+    if ( hasHeader ) {
+        if ( fread( &rec->id, sizeof(int), 1, fp ) != 1
+                || fread( &rec->flags, sizeof(int), 1, fp ) != 1 )
+            return STORE_CORRUPT;
+    }
+
+    if ( fread( &rec->numChars, sizeof( rec->numChars ), 1, fp ) != 1
+            || rec->numChars < 0 || ( rec->body = ftell( fp ) ) + rec->numChars > end )
+        return STORE_CORRUPT;
+
+    if ( text ) {
+        *text = malloc( rec->numChars + 1 );
+        if ( !*text ) {
+            fprintf( stderr, "Failed to allocate %ld bytes in store_readRecord\n",
+                    rec->numChars + 1 );
+            exit( 1 );
+        }
+        if ( fread( *text, sizeof(char), rec->numChars, fp ) != ( size_t ) rec->numChars ) {
+            free( *text );
+            *text = NULL;
+            return STORE_CORRUPT;
+        }
+        ( *text )[rec->numChars] = '\0';
+    } else if ( fseek( fp, rec->numChars, SEEK_CUR ) != 0 ) {
+        return STORE_CORRUPT;
+    }
+
+    if ( store_readString( fp, rec->path, MAX_PATH_SIZE, end ) != STORE_OK
+            || store_readString( fp, rec->time, MAX_TIME_SIZE, end ) != STORE_OK ) {
+        if ( text ) {
+            free( *text );
+            *text = NULL;
+        }
+        return STORE_CORRUPT;
+    }
+
+    rec->size = ftell( fp ) - rec->offset;
+    return STORE_OK;
+}
+
+/* Copies len bytes starting at offset in src to the current position of dst */
+bool store_copyBytes( FILE *src, long offset, long len, FILE *dst, char *buffer, size_t bufferSize ) {
+    if ( fseek( src, offset, SEEK_SET ) != 0 )
+        return false;
+
+    while ( len > 0 ) {
+        size_t chunk = len < ( long ) bufferSize ? ( size_t ) len : bufferSize;
+        if ( fread( buffer, 1, chunk, src ) != chunk )
+            return false;
+        if ( fwrite( buffer, 1, chunk, dst ) != chunk )
+            return false;
+        len -= chunk;
+    }
+    return true;
+}
+
+/* Copies len bytes starting at offset in src to the end of what has been written to dst.
+ * The kernel copies them if it can, without them passing through buffer. */
+static bool store_copyRange( FILE *src, long offset, long len, FILE *dst, char *buffer,
+        size_t bufferSize ) {
+    if ( fflush( dst ) != 0 )
+        return false;
+
+    off_t from = offset;
+    long done = 0;
+    while ( done < len ) {
+        ssize_t sent = sendfile( fileno( dst ), fileno( src ), &from, len - done );
+        if ( sent <= 0 )
+            break;
+        done += sent;
+    }
+    fseek( dst, 0, SEEK_END );
+
+    /* Anything sendfile couldn't do is copied the slow way */
+    return done == len
+            || store_copyBytes( src, offset + done, len - done, dst, buffer, bufferSize );
+}
+
+static int compareMessageIds( const void *a, const void *b ) {
+    const MESSAGE *x = *( MESSAGE * const * ) a;
+    const MESSAGE *y = *( MESSAGE * const * ) b;
+    return ( x->id > y->id ) - ( x->id < y->id );
+}
+
+/* Finds the records of msg's notes in a data file that has been rewritten since
+ * it was loaded and updates their offsets. Notes that are no longer in the file
+ * were deleted by someone else and are dropped from the list. Returns how many of the
+ * notes waiting for a tombstone were among them. */
+int store_relocate( FILE *fp, STORE_HEADER *header, MESSAGE *msg ) {
+    MESSAGE *root = msg->root;
+    int count = 0;
+
+    for ( MESSAGE *tmp = root->next; tmp; tmp = tmp->next )
+        count++;
+    for ( MESSAGE *tmp = root->graveyard; tmp; tmp = tmp->next )
+        count++;
+
+    MESSAGE **byId = malloc( ( count + 1 ) * sizeof(MESSAGE *) );
+    int n = 0;
+
+    /* Only notes that were in the file when we loaded it have offsets to fix */
+    for ( MESSAGE *tmp = root->next; tmp; tmp = tmp->next )
+        if ( tmp->offset >= 0 )
+            byId[n++] = tmp;
+    for ( MESSAGE *tmp = root->graveyard; tmp; tmp = tmp->next )
+        byId[n++] = tmp;
+
+    qsort( byId, n, sizeof(MESSAGE *), compareMessageIds );
+
+    for ( int i = 0; i < n; i++ )
+        byId[i]->offset = -1;
+
+    RECORD rec;
+    MESSAGE key, *keyPtr = &key, **found;
+    long end = store_dataEnd( fp, header );
+
+    fseek( fp, header->headerSize, SEEK_SET );
+    while ( store_readRecord( fp, &rec, end, true, NULL ) == STORE_OK ) {
+        if ( rec.flags & RECORD_DELETED )
+            continue;
+        key.id = rec.id;
+        found = bsearch( &keyPtr, byId, n, sizeof(MESSAGE *), compareMessageIds );
+        if ( found )
+            ( *found )->offset = rec.offset;
+    }
+
+    /* Anything we didn't find has already been deleted, so there is nothing to write for it */
+    int alreadyDeleted = 0;
+    MESSAGE **dead = &root->graveyard;
+    while ( *dead ) {
+        if ( ( *dead )->offset < 0 ) {
+            MESSAGE *tmp = *dead;
+            *dead = tmp->next;
+            free( tmp );
+            alreadyDeleted++;
+        } else {
+            dead = &( *dead )->next;
+        }
+    }
+    for ( int i = 0; i < n; i++ ) {
+        if ( !byId[i]->deleted && byId[i]->offset < 0 ) {
+            list_deleteMessage( byId[i] );
+        }
+    }
+
+    free( byId );
+    root->generation = header->generation;
+    return alreadyDeleted;
+}
+
+/* Writes the whole list to a temporary file and renames it over the data file,
+ * so readers only ever see the old or the new file. Returns false on failure. */
+bool store_rewrite( MESSAGE *msg ) {
+    int buffSize = strlen( path ) + strlen( ".tmp" ) + 1;
+    char *tmpPath = malloc( buffSize );
+    snprintf( tmpPath, buffSize, "%s.tmp", path );
+
+    FILE *fp = fopen( tmpPath, "wb" );
+    if ( !fp ) {
+        free( tmpPath );
+        return false;
+    }
+
+    msg->root->generation++;
+    list_writeBinary( fp, msg );
+
+    bool ok = fflush( fp ) == 0 && fsync( fileno( fp ) ) == 0;
+    ok = fclose( fp ) == 0 && ok;
+    if ( ok )
+        ok = rename( tmpPath, path ) == 0;
+    if ( !ok )
+        remove( tmpPath );
+
+    free( tmpPath );
+    return ok;
+}
+
+/* Where a record lives and where it sorts */
+typedef struct {
+    int id;
+    int flags;
+    long offset;
+    long size;
+} INDEX_ENTRY;
+
+static int compareEntries( const void *a, const void *b ) {
+    const INDEX_ENTRY *x = a;
+    const INDEX_ENTRY *y = b;
+    if ( x->id != y->id )
+        return ( x->id > y->id ) - ( x->id < y->id );
+    return ( x->offset > y->offset ) - ( x->offset < y->offset );
+}
+
+/* Compacts a file without a header by loading it and writing it out in the current format */
+static bool store_compactLegacy( COMPACT_STATS *stats ) {
+    MESSAGE *msg = NULL;
+    list_init( &msg );
+
+    FILE *fp = fopen( path, "rb" );
+    if ( !fp ) {
+        list_destroy( &msg );
+        return false;
+    }
+    bool ok = list_readBinary( fp, msg );
+    fclose( fp );
+    if ( !ok ) {
+        fprintf( stderr, "A record of %s is corrupt, leaving the file as it is.\n", path );
+        list_destroy( &msg );
+        return false;
+    }
+
+    ok = store_rewrite( msg );
+    stats->kept = msg->root->totalMessages;
+    list_destroy( &msg );
+    return ok;
+}
+
+/* Compacts the data file: drops deleted and duplicate records, verifies the records and
+ * sorts them by id. Gives up processing records after timeLimit seconds (0 for no limit),
+ * copying the rest as they are so the next run can carry on. What an earlier run compacted
+ * is left as it is until enough of it has been deleted. Returns false on failure. */
+bool store_compact( double timeLimit, COMPACT_STATS *stats ) {
+    /* Keep writers out while we work. Readers carry on with the old file until the rename. */
+    int lockFd = store_lock();
+    bool ok = store_compactLocked( timeLimit, stats );
+    store_unlock( lockFd );
+    return ok;
+}
+
+/* Compacts the data file like store_compact, for a caller that already holds the writer lock.
+ * Only the records after the compacted part are read, unless more than 1 in
+ * COMPACT_DEAD_SHARE of its bytes have been deleted since, and the time limit holds for all
+ * of them. The statistics in the header are carried across, less any duplicates dropped. */
+bool store_compactLocked( double timeLimit, COMPACT_STATS *stats ) {
+    assert( stats != NULL );
+    memset( stats, 0, sizeof(COMPACT_STATS) );
+
+    double deadline = timeLimit > 0 ? store_now() + timeLimit : 0;
+    bool ok = false;
+
+    FILE *src = fopen( path, "rb" );
+    if ( !src )
+        return true;
+
+    struct stat st;
+    fstat( fileno( src ), &st );
+    stats->oldSize = st.st_size;
+
+    STORE_HEADER header;
+    if ( !store_readHeader( src, &header ) ) {
+        fclose( src );
+        ok = stats->oldSize == 0 || store_compactLegacy( stats );
+        stat( path, &st );
+        stats->newSize = st.st_size;
+        return ok;
+    }
+
+    long end = store_dataEnd( src, &header );
+    long denseEnd = header.denseEnd > header.headerSize ? header.denseEnd : header.headerSize;
+    if ( denseEnd > end )
+        denseEnd = end;
+
+    /* The compacted part is copied across untouched while little of it has been deleted.
+     * An older header doesn't say how much has, so it is compacted again. */
+    bool keepDense = store_headerCurrent( &header )
+            && header.deadDense * COMPACT_DEAD_SHARE <= denseEnd - header.headerSize;
+    long start = keepDense ? denseEnd : header.headerSize;
+    long processedEnd = start;
+
+    /* Index the records. Everything read is verified, but once we run out of time the
+     * rest of the file is left to be copied as it is. */
+    int size = 1024, count = 0, status;
+    INDEX_ENTRY *entries = malloc( size * sizeof(INDEX_ENTRY) );
+    RECORD rec;
+
+    fseek( src, start, SEEK_SET );
+    for ( ;; ) {
+        /* Always get through at least one record, so every run moves things along */
+        if ( deadline && count && store_now() > deadline )
+            break;
+
+        status = store_readRecord( src, &rec, end, true, NULL );
+        if ( status == STORE_EOF )
+            break;
+        if ( status == STORE_CORRUPT ) {
+            fprintf( stderr,
+                    "Record at offset %ld of %s is corrupt, leaving the file as it is.\n",
+                    rec.offset, path );
+            goto done;
+        }
+
+        if ( count == size ) {
+            size *= 2;
+            entries = realloc( entries, size * sizeof(INDEX_ENTRY) );
+            if ( !entries ) {
+                fprintf( stderr, "Failed to allocate memory in store_compact\n" );
+                exit( 1 );
+            }
+        }
+        entries[count].id = rec.id;
+        entries[count].flags = rec.flags;
+        entries[count].offset = rec.offset;
+        entries[count].size = rec.size;
+        count++;
+
+        processedEnd = rec.offset + rec.size;
+        if ( rec.id >= header.nextId )
+            header.nextId = rec.id + 1;
+    }
+
+    qsort( entries, count, sizeof(INDEX_ENTRY), compareEntries );
+
+    int buffSize = strlen( path ) + strlen( ".compact" ) + 1;
+    char *tmpPath = malloc( buffSize );
+    snprintf( tmpPath, buffSize, "%s.compact", path );
+
+    FILE *dst = fopen( tmpPath, "w+b" );
+    if ( !dst ) {
+        fprintf( stderr, "Unable to create %s\n", tmpPath );
+        free( tmpPath );
+        goto done;
+    }
+
+    char *buffer = malloc( COPY_BUFFER_SIZE );
+    ok = true;
+
+    STORE_HEADER newHeader = header;
+    newHeader.generation++;
+    newHeader.commits++;
+    newHeader.deadDense = keepDense ? header.deadDense : 0;
+    store_writeHeader( dst, &newHeader );
+
+    if ( keepDense ) {
+        stats->alreadyDense = denseEnd - header.headerSize;
+        ok = store_copyRange( src, header.headerSize, stats->alreadyDense, dst, buffer,
+                COPY_BUFFER_SIZE );
+    }
+
+    bool hasStats = stats_inHeader( &header ), lostExtreme = false;
+    char *body = NULL;
+
+    for ( int i = 0; ok && i < count; i++ ) {
+        if ( entries[i].flags & RECORD_DELETED ) {
+            stats->deletedDropped++;
+            continue;
+        }
+
+        /* The same id written twice: the later write wins. The header counted both. */
+        if ( i + 1 < count && entries[i + 1].id == entries[i].id ) {
+            stats->duplicatesDropped++;
+            if ( hasStats ) {
+                NOTE_STATS note;
+                memset( &note, 0, sizeof(NOTE_STATS) );
+                fseek( src, entries[i].offset, SEEK_SET );
+                ok = store_readRecord( src, &rec, end, true, &body ) == STORE_OK;
+                if ( ok ) {
+                    stats_count( &note, body, rec.numChars );
+                    lostExtreme |= stats_remove( &newHeader.stats, &note, rec.time );
+                }
+                free( body );
+                body = NULL;
+            }
+            continue;
+        }
+
+        ok = store_copyBytes( src, entries[i].offset, entries[i].size, dst, buffer,
+                COPY_BUFFER_SIZE );
+        stats->kept++;
+    }
+    newHeader.denseEnd = ftell( dst );
+
+    /* Whatever we didn't get to goes across untouched */
+    stats->remaining = end - processedEnd;
+    if ( ok && stats->remaining > 0 )
+        ok = store_copyRange( src, processedEnd, stats->remaining, dst, buffer,
+                COPY_BUFFER_SIZE );
+
+    newHeader.dataEnd = ftell( dst );
+
+    /* A header from before the statistics has to have them counted from the records. Only
+     * the record headers need reading again if a duplicate was the oldest or newest. */
+    if ( ok && ( !hasStats || lostExtreme ) ) {
+        fflush( dst );
+        ok = stats_scan( dst, sizeof(STORE_HEADER), newHeader.dataEnd, true, &newHeader.stats,
+                hasStats );
+    }
+    store_writeHeader( dst, &newHeader );
+
+    ok = ok && fflush( dst ) == 0 && fsync( fileno( dst ) ) == 0;
+    ok = fclose( dst ) == 0 && ok;
+    if ( ok )
+        ok = rename( tmpPath, path ) == 0;
+    if ( !ok ) {
+        fprintf( stderr, "Failed to write %s, leaving the file as it is.\n", tmpPath );
+        remove( tmpPath );
+    } else {
+        stats->newSize = newHeader.dataEnd;
+    }
+
+    free( buffer );
+    free( tmpPath );
+
+    done:
+    free( entries );
+    fclose( src );
+    return ok;
+}
+
+/* Prints what a compaction did */
+void store_printStats( FILE *outStream, COMPACT_STATS *stats ) {
+    fprintf( outStream, "Kept: %d\nDeleted notes dropped: %d\nDuplicates dropped: %d\n"
+            "Size: %ld -> %ld bytes\nReclaimed: %ld bytes\n", stats->kept,
+            stats->deletedDropped, stats->duplicatesDropped, stats->oldSize,
+            stats->newSize, stats->oldSize - stats->newSize );
+
+    if ( stats->alreadyDense > 0 )
+        fprintf( outStream, "Already compact, copied as it was: %ld bytes\n",
+                stats->alreadyDense );
+
+    if ( stats->remaining > 0 )
+        fprintf( outStream,
+                "Ran out of time with %ld bytes left to compact. Run again to carry on.\n",
+                stats->remaining );
+}
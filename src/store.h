@@ -0,0 +1,90 @@
+/*
+ * store.h
+ *
+ *  Created on: 19/10/2026
+ *      Author: facetoe
+ */
+
+#ifndef STORE_H_
+#define STORE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "structures.h"
+
+/* Results of store_readRecord */
+enum {
+    STORE_OK, STORE_EOF, STORE_CORRUPT
+};
+
+/* What a compaction did */
+typedef struct {
+    long oldSize;
+    long newSize;
+    int kept;
+    int deletedDropped;
+    int duplicatesDropped;
+
+    /* Bytes left uncompacted because we ran out of time */
+    long remaining;
+
+    /* Bytes compacted by an earlier run, which had too little deleted to be worth redoing */
+    long alreadyDense;
+} COMPACT_STATS;
+
+/* Returns a monotonic time in seconds */
+double store_now();
+
+/* Takes the writer lock for the data file at path, blocking until it is free.
+ * Readers never take it. Returns the lock fd, or -1 if the lock file can't be opened. */
+int store_lock();
+
+/* Releases a lock taken with store_lock */
+void store_unlock( int fd );
+
+/* Reads the data file header if there is one. Returns true if a header was read and leaves
+ * fp at the first record, otherwise rewinds fp and returns false. */
+bool store_readHeader( FILE *fp, STORE_HEADER *header );
+
+/* Returns true if header is as big as the one store_writeHeader writes, so it can be
+ * written over without touching the first record */
+bool store_headerCurrent( STORE_HEADER *header );
+
+/* Writes header at the start of fp */
+void store_writeHeader( FILE *fp, STORE_HEADER *header );
+
+/* Returns where the committed records in fp end */
+long store_dataEnd( FILE *fp, STORE_HEADER *header );
+
+/* Reads the record at the current position of fp, verifying every length against the
+ * record limits and end. If text is not NULL the note body is read into a malloced
+ * buffer there, otherwise it is skipped. Returns STORE_OK, STORE_EOF or STORE_CORRUPT. */
+int store_readRecord( FILE *fp, RECORD *rec, long end, bool hasHeader, char **text );
+
+/* Copies len bytes starting at offset in src to the current position of dst */
+bool store_copyBytes( FILE *src, long offset, long len, FILE *dst, char *buffer, size_t bufferSize );
+
+/* Finds the records of msg's notes in a data file that has been rewritten since
+ * it was loaded and updates their offsets. Notes that are no longer in the file
+ * were deleted by someone else and are dropped from the list. Returns how many of the
+ * notes waiting for a tombstone were among them. */
+int store_relocate( FILE *fp, STORE_HEADER *header, MESSAGE *msg );
+
+/* Writes the whole list to a temporary file and renames it over the data file,
+ * so readers only ever see the old or the new file. Returns false on failure. */
+bool store_rewrite( MESSAGE *msg );
+
+/* Compacts the data file: drops deleted and duplicate records, verifies the records and
+ * sorts them by id. Gives up processing records after timeLimit seconds (0 for no limit),
+ * copying the rest as they are so the next run can carry on. What an earlier run compacted
+ * is left as it is until enough of it has been deleted. Returns false on failure. */
+bool store_compact( double timeLimit, COMPACT_STATS *stats );
+
+/* Compacts the data file like store_compact, for a caller that already holds the writer lock */
+bool store_compactLocked( double timeLimit, COMPACT_STATS *stats );
+
+/* Prints what a compaction did */
+void store_printStats( FILE *outStream, COMPACT_STATS *stats );
+
+#endif /* STORE_H_ */
@@ -11,19 +11,80 @@
 #define MAX_TIME_SIZE 30
 #define MAX_PATH_SIZE 200
 
+/* Magic bytes at the start of a data file written with a header */
+#define STORE_MAGIC "TNOTE\0v2"
+#define STORE_MAGIC_LEN 8
+#define STORE_VERSION 2
+
+/* Record flags */
+#define RECORD_DELETED 0x1
+
+/* Buckets of the note size histogram. The first holds notes of up to 64 bytes, each one
+ * after holds notes up to twice the size of the one before, and the last holds the rest. */
+#define STATS_BUCKETS 16
+
 #include <stdbool.h>
 
+/* Where a display row starts within a line: its byte offset and its column */
+typedef struct {
+    int byte;
+    int col;
+} LINE_BREAK;
+
+/* A run of a line picked out by the highlighter: bytes start up to end, and the kind of
+ * token it is */
+typedef struct {
+    int start;
+    int end;
+    int kind;
+} LINE_SPAN;
+
 /* List to hold lines */
 struct line {
     int lNum;
     int lSize;
     char *text;
+
+    /* How the line is laid out on screen, worked out by line_layout when it's first shown.
+     * width is in columns. rows and breaks are for a screen layoutCols wide, which is 0
+     * until the layout has been worked out. breaks is only set when rows > 1. */
+    int width;
+    int layoutCols;
+    int rows;
+    LINE_BREAK *breaks;
+
+    /* What the highlighter found in the line, worked out by highlight_line when it's first
+     * shown. numSpans is -1 until then. */
+    int numSpans;
+    LINE_SPAN *spans;
+
     struct line *next;
     struct line *prev;
 };
 
 typedef struct line LINE;
 
+/* What a single note counts for in the statistics: its lines, UTF-8 characters and bytes,
+ * newlines included, and when it was written */
+typedef struct {
+    long lines;
+    long chars;
+    long bytes;
+    long time;
+} NOTE_STATS;
+
+/* Totals over every live note in a data file, the oldest and newest note's time, -1 when
+ * there are no notes, and how many notes fall in each bucket of the size histogram */
+typedef struct {
+    long notes;
+    long lines;
+    long chars;
+    long bytes;
+    long oldest;
+    long newest;
+    long sizes[STATS_BUCKETS];
+} STORE_STATS;
+
 /* List to hold parsed messages */
 struct message {
 
@@ -32,9 +93,48 @@ struct message {
     int messageNum;
     long numChars;
 
+    /* Stable internal id. Unlike messageNum it never changes once assigned */
+    int id;
+
+    /* Offset of this note's record in the data file, -1 if it hasn't been written yet */
+    long offset;
+
+    /* Tombstone flag, set when the note is deleted but its record not yet reclaimed */
+    bool deleted;
+
     /* Whether we need to save any changes */
     bool hasChanged;
 
+    /* Root only: the messageNums are stale and need to be recalculated */
+    bool numbersChanged;
+
+    /* Root only: the data file is missing or in the old format and must be rewritten in full */
+    bool needsRewrite;
+
+    /* Root only: next id to hand out */
+    int nextId;
+
+    /* Root only: generation of the data file when it was loaded. Rewrites bump it,
+     * which tells us the record offsets we remembered are no longer valid. */
+    int generation;
+
+    /* Root only: end of the committed records in the data file when we last read or wrote it */
+    long dataEnd;
+
+    /* Root only: commits of the data file when we last read or wrote it */
+    long commits;
+
+    /* Root only: last note in the list, so appending doesn't have to walk the whole list */
+    struct message *tail;
+
+    /* Root only: deleted notes whose tombstones have not been written yet */
+    struct message *graveyard;
+
+    /* What the note counts for in the data file's statistics, worked out as its lines are
+     * added so deleting it doesn't have to go over them again. The time is left at -1, as
+     * reading it takes mktime, which is slow. */
+    NOTE_STATS stats;
+
     char path[MAX_PATH_SIZE];
     char time[MAX_TIME_SIZE];
 
@@ -53,6 +153,16 @@ struct message {
     /* Bottom line of the current page */
     LINE *pageBot;
 
+    /* Index of the line at the top of the current page, counting from 0, and which of
+     * its display rows is at the top when it is wrapped */
+    int topLine;
+    int topRow;
+
+    /* Every line of the message in order, so any line can be reached in one step.
+     * Built the first time it's needed and thrown away when the lines change. */
+    LINE **lineIndex;
+    int indexedLines;
+
     struct message *next;
     struct message *prev;
     struct message *root;
@@ -61,6 +171,62 @@ struct message {
 
 typedef struct message MESSAGE;
 
+/* A span of time used to select notes, from inclusive and to exclusive */
+typedef struct {
+    long from;
+    long to;
+} TIME_RANGE;
+
+/* Header at the start of the data file. headerSize lets newer versions add fields
+ * without breaking older readers, which skip anything they don't know about. */
+typedef struct {
+    char magic[STORE_MAGIC_LEN];
+    int version;
+    int headerSize;
+    int nextId;
+
+    /* Bumped every time the file is rewritten */
+    int generation;
+
+    /* End of the committed records. Anything after it is a partly written append. */
+    long dataEnd;
+
+    /* Records before denseEnd have been compacted: sorted by id, verified and free of duplicates */
+    long denseEnd;
+
+    /* Bumped by every write, so a writer can tell whether anyone else has written since */
+    long commits;
+
+    /* Kept up to date by every write, so they never need the records to be read. Headers
+     * written before they were added are too short to hold them. */
+    STORE_STATS stats;
+
+    /* Bytes taken by deleted records before denseEnd, so compaction can tell whether that
+     * part is worth rewriting. Headers written before it was added are too short to hold it. */
+    long deadDense;
+} STORE_HEADER;
+
+/* Location and sizes of a note record in the data file */
+typedef struct {
+    int id;
+    int flags;
+    long offset;
+    long size;
+    long numChars;
+
+    /* Offset of the note body, numChars bytes of lines that each end in a newline */
+    long body;
+    char path[MAX_PATH_SIZE];
+    char time[MAX_TIME_SIZE];
+} RECORD;
+
+/* A row of the message window: the line on it, its index and which of its display rows it is */
+typedef struct {
+    LINE *line;
+    int index;
+    int sub;
+} DISPLAY_ROW;
+
 /* Terminal coordinates and scrollable message variables */
 typedef struct {
     int NCOLS;
@@ -68,6 +234,22 @@ typedef struct {
     int cursorRow;
     int cursorCol;
     MESSAGE *currMsg;
+
+    /* What is drawn on each row of the message window, so only rows that change are redrawn */
+    DISPLAY_ROW *rows;
+    int numRows;
+
+    /* Whether long lines wrap onto the next row, or are cut off and scrolled sideways */
+    bool wrap;
+
+    /* First column shown when lines aren't wrapped */
+    int leftCol;
+
+    /* Whether log levels, diffs, JSON and file:line references are coloured */
+    bool highlight;
+
+    /* Whether notes added by other terminotes are shown as they land, pinned to the bottom */
+    bool follow;
 } DISPLAY_DATA;
 
 
@@ -24,6 +24,7 @@
 #include <signal.h> // For sigaction
 char *path;
 const char *dataFile = "/.terminote.data";
+const char *notebookDir = "/.terminote.d";
 
 OPTIONS *opts = NULL;
 
@@ -36,7 +37,7 @@ int main( int argc, char **argv ) {
     } else {
         opts = options_new();
         nonInteractive_run( opts, argc, argv );
-        free( opts );
+        options_free( opts );
     }
 
     return EXIT_SUCCESS;
@@ -26,15 +26,20 @@ void initPosition( DISPLAY_DATA **disp ) {
     tmp->cursorRow = 0;
     tmp->cursorCol = 0;
     tmp->currMsg = NULL;
+    tmp->rows = NULL;
+    tmp->numRows = 0;
+    tmp->wrap = true;
+    tmp->leftCol = 0;
+    tmp->highlight = true;
+    tmp->follow = false;
     *disp = tmp;
 }
 
-bool RECIEVED_SIGWINCH = false;
 bool needsRefresh = false;
 
 /* Variables for ncurses */
 char *mainMenuStrings[] =
-        { "Delete", "Quit", "Help", ( char * ) NULL, };
+        { "Browse", "Delete", "Quit", "Help", ( char * ) NULL, };
 
 static ITEM **mainMenuItems;
 static MENU *footerMenu;
@@ -45,6 +50,28 @@ enum {
     TOP, MID, BOT
 };
 
+/* Marks a row of the message window whose contents we don't know */
+static LINE dirtyRow;
+
+/* The current search, run in the background */
+static SEARCH search;
+
+
+/* Loads the notes in the background while the UI is up */
+static LOADER loader;
+static bool loading = false;
+static bool shownNewest = false;
+
+/* Follows the data file for notes added by other terminotes, once the load is done */
+static FOLLOW follow;
+
+/* Set while the notes are being saved on the way out. The save changes the notes, so
+ * nothing but the top bar is drawn until it's done. */
+static atomic_bool saving = false;
+
+/* How often the spinner turns while saving */
+#define SPINNER_MS 100
+
 /* Get the size of the terminal screen */
 void getScrnSize( DISPLAY_DATA *disp ) {
     assert( disp != NULL );
@@ -53,6 +80,39 @@ void getScrnSize( DISPLAY_DATA *disp ) {
     disp->NROWS = wSize.ws_row;
 }
 
+/* How each kind of token the highlighter finds is shown */
+static attr_t highlightAttrs[HL_NUM_KINDS];
+
+/* The first colour pair used by the highlighter */
+#define HIGHLIGHT_PAIR 3
+
+/* Sets up the colours for highlighting, on the terminal's own background if it has one.
+ * Terminals without colour get bold and underline. */
+static void initHighlight() {
+    static const struct {
+        int kind;
+        short color;
+        attr_t attr;
+    } styles[] = {
+        { HL_ERROR, COLOR_RED, A_BOLD }, { HL_WARNING, COLOR_YELLOW, A_BOLD },
+        { HL_INFO, COLOR_GREEN, A_NORMAL }, { HL_DEBUG, COLOR_BLUE, A_NORMAL },
+        { HL_ADDED, COLOR_GREEN, A_NORMAL }, { HL_REMOVED, COLOR_RED, A_NORMAL },
+        { HL_HUNK, COLOR_CYAN, A_BOLD }, { HL_KEY, COLOR_BLUE, A_BOLD },
+        { HL_STRING, COLOR_GREEN, A_NORMAL }, { HL_NUMBER, COLOR_MAGENTA, A_NORMAL },
+        { HL_LITERAL, COLOR_YELLOW, A_NORMAL }, { HL_LOCATION, COLOR_MAGENTA, A_UNDERLINE },
+    };
+
+    short background = use_default_colors() == OK ? -1 : COLOR_BLACK;
+    for ( size_t i = 0; i < ARRAY_SIZE( styles ); i++ ) {
+        attr_t attr = styles[i].attr;
+        if ( has_colors() && init_pair( HIGHLIGHT_PAIR + i, styles[i].color, background ) == OK )
+            attr |= COLOR_PAIR( HIGHLIGHT_PAIR + i );
+        else if ( attr == A_NORMAL )
+            attr = A_BOLD;
+        highlightAttrs[styles[i].kind] = attr;
+    }
+}
+
 /* Setup ncurses */
 void initNcurses() {
     initscr();
@@ -63,12 +123,26 @@ void initNcurses() {
     keypad( stdscr, TRUE );
     start_color();
     init_pair( 1, COLOR_BLACK, COLOR_WHITE );
+    initHighlight();
+}
+
+/* Sets the number of rows in the message window and makes room to track each of them */
+static void setNumRows( DISPLAY_DATA *disp ) {
+    disp->numRows = disp->NROWS > 2 ? disp->NROWS - 2 : 1;
+    disp->rows = realloc( disp->rows, ( disp->numRows + 1 ) * sizeof(DISPLAY_ROW) );
+    if ( !disp->rows ) {
+        fprintf( stderr, "Error allocating memory in setNumRows\n" );
+        exit( 1 );
+    }
+    invalidateRows( disp );
 }
 
 void initWins( DISPLAY_DATA *disp ) {
     getScrnSize( disp );
+    setNumRows( disp );
+
     wins[TOP] = newwin( 1, disp->NCOLS, 0, 0 );
-    wins[MID] = newwin( disp->NROWS - 2, disp->NCOLS, 1, 0 );
+    wins[MID] = newwin( disp->numRows, disp->NCOLS, 1, 0 );
     wins[BOT] = newwin( 1, disp->NCOLS, disp->NROWS - 1, 0 );
 
     /* Turn colors on */
@@ -76,170 +150,503 @@ void initWins( DISPLAY_DATA *disp ) {
     wbkgd( wins[TOP], COLOR_PAIR(1) );
 
     keypad( wins[MID], true );
+
+    /* Let ncurses use the terminal's own line scrolling */
+    idlok( wins[MID], true );
+}
+
+/* Forget what is on each row of the message window, so the next printPage redraws them all */
+void invalidateRows( DISPLAY_DATA *disp ) {
+    for ( int i = 0; i < disp->numRows; i++ )
+        disp->rows[i].line = &dirtyRow;
+}
+
+/* Returns the width of the message window, which is never less than one column */
+static int screenCols( DISPLAY_DATA *disp ) {
+    return disp->NCOLS > 0 ? disp->NCOLS : 1;
+}
+
+/* Returns how many display rows line takes */
+static int rowsOf( DISPLAY_DATA *disp, LINE *line ) {
+    return disp->wrap ? line_layout( line, screenCols( disp ) ) : 1;
+}
+
+/* Moves index and sub on to the next display row of the message. Returns false if
+ * they are already on the last one. */
+static bool nextRow( DISPLAY_DATA *disp, int *index, int *sub ) {
+    LINE *line = line_at( disp->currMsg, *index );
+    if ( !line )
+        return false;
+
+    if ( *sub + 1 < rowsOf( disp, line ) ) {
+        ( *sub )++;
+        return true;
+    }
+    if ( !line_at( disp->currMsg, *index + 1 ) )
+        return false;
+
+    ( *index )++;
+    *sub = 0;
+    return true;
+}
+
+/* Moves index and sub back to the previous display row of the message. Returns false if
+ * they are already on the first one. */
+static bool prevRow( DISPLAY_DATA *disp, int *index, int *sub ) {
+    if ( *sub > 0 ) {
+        ( *sub )--;
+        return true;
+    }
+    if ( *index <= 0 )
+        return false;
+
+    ( *index )--;
+    *sub = rowsOf( disp, line_at( disp->currMsg, *index ) ) - 1;
+    return true;
+}
+
+/* Draws display row sub of line at the cursor of the message window. Wrapped lines show
+ * the part of the line on that row, otherwise the columns from leftCol on are shown. */
+static void renderRow( DISPLAY_DATA *disp, LINE *line, int sub ) {
+    int cols = screenCols( disp );
+    int byte, col, end, startCol;
+
+    line_layout( line, cols );
+    if ( disp->wrap ) {
+        line_rowStart( line, sub, &byte, &col );
+        end = sub + 1 < line->rows ? line->breaks[sub + 1].byte : line->lSize;
+        startCol = col;
+    } else {
+        /* Start from the row break nearest before leftCol and walk the rest of the way */
+        int r = disp->leftCol / cols < line->rows ? disp->leftCol / cols : line->rows - 1;
+        for ( line_rowStart( line, r, &byte, &col ); r > 0 && col > disp->leftCol; )
+            line_rowStart( line, --r, &byte, &col );
+        line_walk( line, &byte, &col, line->lSize, disp->leftCol );
+        end = line->lSize;
+        startCol = disp->leftCol;
+    }
+
+    /* The first highlighted span that isn't behind byte */
+    int span = 0, numSpans = 0;
+    if ( disp->highlight ) {
+        numSpans = highlight_line( line, highlight_isDiff( disp->currMsg ) );
+        span = highlight_find( line, byte );
+    }
+
+    /* The next match of the search at or after byte */
+    int termLen = strlen( search.term );
+    int from = byte > termLen ? byte - termLen + 1 : 0;
+    char *match = termLen ? strstr( line->text + from, search.term ) : NULL;
+
+    wchar_t text[cols + 1];
+    attr_t attrs[cols + 1];
+    int n = 0;
+
+    while ( byte < end && n < cols ) {
+        wchar_t wc;
+        int width;
+        int bytes = line_decode( line->text + byte, line->lSize - byte, col, &wc, &width );
+        if ( col + width - startCol > cols )
+            break;
+
+        while ( match && match - line->text + termLen <= byte )
+            match = strstr( match + termLen, search.term );
+        attr_t attr = match && match - line->text <= byte ? A_REVERSE : A_NORMAL;
+
+        while ( span < numSpans && line->spans[span].end <= byte )
+            span++;
+        if ( span < numSpans && line->spans[span].start <= byte )
+            attr |= highlightAttrs[line->spans[span].kind];
+
+        /* Tabs and wide characters cut off by leftCol are shown as spaces */
+        if ( line->text[byte] == '\t' || col < startCol ) {
+            for ( int i = col < startCol ? startCol : col; i < col + width && n < cols; i++ ) {
+                text[n] = ' ';
+                attrs[n++] = attr;
+            }
+        } else {
+            text[n] = wc;
+            attrs[n++] = attr;
+        }
+
+        col += width;
+        byte += bytes;
+    }
+
+    /* Write out runs of characters with the same attributes */
+    for ( int i = 0, j; i < n; i = j ) {
+        for ( j = i; j < n && attrs[j] == attrs[i]; j++ )
+            ;
+        wattrset( wins[MID], attrs[i] );
+        waddnwstr( wins[MID], text + i, j - i );
+    }
+    wattrset( wins[MID], A_NORMAL );
+}
+
+/* Draws display row sub of line, which is line index of the message, on row of the message
+ * window, unless it is already there. NULL draws a blank row. */
+void drawRow( DISPLAY_DATA *disp, int row, LINE *line, int index, int sub ) {
+    DISPLAY_ROW *cached = &disp->rows[row];
+    if ( cached->line == line && ( !line || cached->sub == sub ) )
+        return;
+
+    wmove( wins[MID], row, 0 );
+    wclrtoeol( wins[MID] );
+    if ( line )
+        renderRow( disp, line, sub );
+
+    cached->line = line;
+    cached->index = index;
+    cached->sub = sub;
+}
+
+/* Returns the row of the message window showing display row sub of line index, or -1 */
+int findRow( DISPLAY_DATA *disp, int index, int sub ) {
+    for ( int i = 0; i < disp->numRows && disp->rows[i].line; i++ )
+        if ( disp->rows[i].index == index && disp->rows[i].sub == sub )
+            return i;
+    return -1;
 }
 
 /* Setup and print the top window to screen */
 void showTopWin( DISPLAY_DATA *disp ) {
 
-    wclear( wins[TOP] );
+    werase( wins[TOP] );
+    list_refreshNumbers( disp->currMsg );
+
+    /* Say how far the background load has got */
+    char status[40] = "";
+    int percent;
+    if ( loading ) {
+        int state = loader_progress( &loader, &percent );
+        snprintf( status, sizeof( status ), " (%s %d%%)",
+                state == LOADER_INDEXING ? "indexing" : "loading", percent );
+    } else if ( disp->follow ) {
+        snprintf( status, sizeof( status ), " (following)" );
+    }
 
     /* If the we are not in the root node then update the top window with time, number and path info*/
     if ( disp->currMsg->messageNum != 0 ) {
         char noteStr[100];
-        snprintf( noteStr, 100, "Note #%d", disp->currMsg->messageNum );
+        snprintf( noteStr, 100, "Note #%d%s", disp->currMsg->messageNum, status );
         mvwprintw( wins[TOP], 0,
-                ( disp->NCOLS / 2 ) - ( strlen( noteStr ) / 2 ), noteStr );
-        mvwprintw( wins[TOP], 0, 0, disp->currMsg->path );
+                ( disp->NCOLS / 2 ) - ( strlen( noteStr ) / 2 ), "%s", noteStr );
+        mvwprintw( wins[TOP], 0, 0, "%s", disp->currMsg->path );
         mvwprintw( wins[TOP], 0,
-                ( disp->NCOLS - strlen( disp->currMsg->time ) ) - 2,
+                ( disp->NCOLS - strlen( disp->currMsg->time ) ) - 2, "%s",
                 disp->currMsg->time );
     } else {
         /* Otherwise just print the title and version */
-        char title[50];
-        sprintf( title, "Terminote %.1f", VERSION );
+        char title[100];
+        sprintf( title, "Terminote %.1f%s", VERSION, status );
         mvwprintw( wins[TOP], 0, ( disp->NCOLS / 2 ) - ( strlen( title ) / 2 ),
-                title );
+                "%s", title );
     }
-    wrefresh( wins[TOP] );
+    wnoutrefresh( wins[TOP] );
 }
 
-/* Print the current page */
-void printPage( DISPLAY_DATA *disp, int numRows ) {
-    LINE *tmp = disp->currMsg->pageTop;
-    assert( tmp != NULL );
-
-    for ( int i = 0; i < numRows && tmp->next; tmp = tmp->next, i++ ) {
-        mvwprintw( wins[MID], i, 0, "%s", tmp->text );
+/* Print the current page, starting at topLine. Only rows whose line has changed are drawn. */
+void printPage( DISPLAY_DATA *disp ) {
+    MESSAGE *msg = disp->currMsg;
+    int index = msg->topLine, sub = msg->topRow;
+    LINE *line = line_at( msg, index );
+
+    /* The top line may take fewer rows than it did, say after the screen got wider */
+    if ( line && sub >= rowsOf( disp, line ) )
+        sub = msg->topRow = rowsOf( disp, line ) - 1;
+
+    msg->pageTop = line;
+    msg->pageBot = NULL;
+    for ( int i = 0; i < disp->numRows; i++ ) {
+        if ( line ) {
+            drawRow( disp, i, line, index, sub );
+            msg->pageBot = line;
+            line = nextRow( disp, &index, &sub ) ? line_at( msg, index ) : NULL;
+        } else {
+            drawRow( disp, i, NULL, 0, 0 );
+        }
     }
-    disp->currMsg->pageBot = tmp;
-    wrefresh( wins[MID] );
+    wnoutrefresh( wins[MID] );
 }
 
-/* Print the start of the message */
-void printTop( DISPLAY_DATA *disp ) {
-    LINE *tmp = disp->currMsg->first;
-    wclear( wins[MID] );
+/* Scrolls the window moved rows and shifts the row cache to match, so only the rows
+ * coming into view have to be drawn */
+static void shiftRows( DISPLAY_DATA *disp, int moved ) {
+    if ( abs( moved ) >= disp->numRows )
+        return;
 
-    disp->currMsg->pageTop = tmp;
+    /* Scroll what's on the screen, then the rows that scrolled in are blank */
+    scrollok( wins[MID], true );
+    wscrl( wins[MID], moved );
+    scrollok( wins[MID], false );
 
-    for ( int i = 0; i < disp->NROWS - 2 && tmp->next; tmp = tmp->next, i++ ) {
-        mvwprintw( wins[MID], i, 0, "%s", tmp->text );
+    if ( moved > 0 ) {
+        memmove( disp->rows, disp->rows + moved,
+                ( disp->numRows - moved ) * sizeof(DISPLAY_ROW) );
+        for ( int i = disp->numRows - moved; i < disp->numRows; i++ )
+            disp->rows[i].line = NULL;
+    } else {
+        memmove( disp->rows - moved, disp->rows,
+                ( disp->numRows + moved ) * sizeof(DISPLAY_ROW) );
+        for ( int i = 0; i < -moved; i++ )
+            disp->rows[i].line = NULL;
     }
-    disp->currMsg->pageBot = tmp;
-    disp->currMsg->currentLine = tmp;
-    wrefresh( wins[MID] );
 }
 
-/* Print the bottom of the message */
-void printBot( DISPLAY_DATA *disp ) {
-    LINE *tmp = disp->currMsg->last;
-    wclear( wins[MID] );
+/* Makes display row sub of line index the first row on the page, moving it up if that
+ * would leave blank rows at the bottom */
+void scrollTo( DISPLAY_DATA *disp, int index, int sub ) {
+    MESSAGE *msg = disp->currMsg;
+    int count = line_count( msg );
+
+    if ( index >= count ) {
+        index = count - 1;
+        sub = 0;
+    }
+    if ( index < 0 )
+        index = sub = 0;
 
-    for ( int i = 0; i < disp->NROWS - 3 && tmp->prev; tmp = tmp->prev, ++i )
+    /* See how many rows there are below the new top */
+    int bottom = index, bottomSub = sub, i = 1;
+    for ( ; i < disp->numRows && nextRow( disp, &bottom, &bottomSub ); i++ )
+        ;
+    for ( ; i < disp->numRows && prevRow( disp, &index, &sub ); i++ )
         ;
 
-    disp->currMsg->pageTop = tmp;
+    msg->topLine = index;
+    msg->topRow = sub;
+    printPage( disp );
+}
 
-    for ( int i = 0; tmp->next; tmp = tmp->next, i++ ) {
-        mvwprintw( wins[MID], i, 0, "%s", tmp->text );
+/* Moves the page n display rows down, or up if n is negative. The window is scrolled so
+ * that only the rows coming into view are drawn. Returns how many rows it moved. */
+int scrollRows( DISPLAY_DATA *disp, int n ) {
+    MESSAGE *msg = disp->currMsg;
+    int index = msg->topLine, sub = msg->topRow, moved = 0;
+
+    if ( !line_at( msg, index ) )
+        return 0;
+
+    if ( n > 0 ) {
+        /* Stop once the last row of the message is on the bottom row */
+        int bottom = index, bottomSub = sub;
+        for ( int i = 1; i < disp->numRows && nextRow( disp, &bottom, &bottomSub ); i++ )
+            ;
+        for ( ; moved < n && nextRow( disp, &bottom, &bottomSub ); moved++ )
+            nextRow( disp, &index, &sub );
+    } else {
+        for ( ; moved > n && prevRow( disp, &index, &sub ); moved-- )
+            ;
     }
 
-    disp->currMsg->pageBot = disp->currMsg->last;
-    disp->currMsg->currentLine = disp->currMsg->last;
-    wrefresh( wins[MID] );
+    if ( moved == 0 )
+        return 0;
+
+    msg->topLine = index;
+    msg->topRow = sub;
+    shiftRows( disp, moved );
+    printPage( disp );
+    return moved;
 }
 
-/* Scrolls the page up  */
-void scrollUpPage( DISPLAY_DATA *disp, WINDOW *win ) {
+/* Print the start of the message */
+void printTop( DISPLAY_DATA *disp ) {
+    scrollTo( disp, 0, 0 );
+    disp->cursorRow = 0;
+}
 
-    /* If we are already at the top then print the page and return */
-    if ( disp->currMsg->currentLine == disp->currMsg->pageTop ) {
-        printPage( disp, disp->NROWS - 2 );
+/* Print the bottom of the message */
+void printBot( DISPLAY_DATA *disp ) {
+    MESSAGE *msg = disp->currMsg;
+    int index = line_count( msg ) - 1;
+    if ( index < 0 )
         return;
-    }
 
-    /* Start at the top of the page */
-    LINE *tmp = disp->currMsg->pageTop;
+    int sub = rowsOf( disp, line_at( msg, index ) ) - 1, row = 0;
+    for ( ; row < disp->numRows - 1 && prevRow( disp, &index, &sub ); row++ )
+        ;
+
+    msg->topLine = index;
+    msg->topRow = sub;
+    printPage( disp );
+    disp->cursorRow = row;
+}
 
-    /* Rewind nScroll lines */
-    for ( int i = 1; i < disp->NROWS - 2 && tmp->prev; tmp = tmp->prev, i++ )
+/* Scrolls the page up  */
+void scrollUpPage( DISPLAY_DATA *disp ) {
+    if ( scrollRows( disp, -( disp->numRows - 1 ) ) == 0 )
+        disp->cursorRow = 0;
+}
+
+/* Scrolls the page down */
+void scrollDownPage( DISPLAY_DATA *disp ) {
+    if ( scrollRows( disp, disp->numRows - 1 ) == 0 )
+        printBot( disp );
+}
+
+/* Shows display row sub of line index, in the middle of the page if it isn't already on
+ * it, and returns the row of the message window it is on */
+int revealRow( DISPLAY_DATA *disp, int index, int sub ) {
+    int row = findRow( disp, index, sub );
+    if ( row >= 0 )
+        return row;
+
+    for ( int i = 0; i < disp->numRows / 2 && prevRow( disp, &index, &sub ); i++ )
         ;
+    scrollTo( disp, index, sub );
+    return findRow( disp, index, sub ) >= 0 ? findRow( disp, index, sub ) : 0;
+}
 
-    wclear( wins[MID] );
-    disp->currMsg->pageTop = tmp;
+/* Moves to line n of the message, counting from 1, and puts the cursor on it */
+void gotoLine( DISPLAY_DATA *disp, int n ) {
+    int count = line_count( disp->currMsg );
+    if ( count == 0 )
+        return;
+    if ( n > count )
+        n = count;
+    if ( n < 1 )
+        n = 1;
+
+    /* Put the line in the middle of the page unless it's near either end */
+    int index = n - 1, sub = 0;
+    for ( int i = 0; i < disp->numRows / 2 && prevRow( disp, &index, &sub ); i++ )
+        ;
+    scrollTo( disp, index, sub );
 
-    /* Print the lines to the screen */
-    for ( int i = 0; i < disp->NROWS - 2 && tmp->next; tmp = tmp->next, i++ )
-        mvwprintw( wins[MID], i, 0, "%s", tmp->text );
+    int row = findRow( disp, n - 1, 0 );
+    disp->cursorRow = row >= 0 ? row : 0;
+    disp->cursorCol = 0;
+}
 
-    /* Update the pageBot pointer */
-    disp->currMsg->pageBot = tmp;
-    disp->currMsg->currentLine = tmp;
-    wrefresh( win );
+/* Moves to the line percent of the way through the message */
+void gotoPercent( DISPLAY_DATA *disp, int percent ) {
+    long count = line_count( disp->currMsg );
+    gotoLine( disp, 1 + ( count - 1 ) * percent / 100 );
 }
 
-/* Scrolls the page down */
-void scrollDownPage( DISPLAY_DATA *disp, WINDOW *win ) {
+/* Sets index and byte to the line and byte offset under the cursor */
+void cursorPosition( DISPLAY_DATA *disp, int *index, int *byte ) {
+    DISPLAY_ROW *row = &disp->rows[disp->cursorRow];
+    int col;
 
-    /* If the entire message will fit on the screen without scrolling, return */
-    if ( disp->currMsg->numLines <= disp->NROWS - 2 ) {
+    *index = disp->currMsg->topLine;
+    *byte = 0;
+    if ( !row->line || row->line == &dirtyRow )
         return;
+
+    *index = row->index;
+    if ( disp->wrap ) {
+        line_rowStart( row->line, row->sub, byte, &col );
+        line_walk( row->line, byte, &col, row->line->lSize, col + disp->cursorCol );
+    } else {
+        col = 0;
+        line_walk( row->line, byte, &col, row->line->lSize, disp->leftCol + disp->cursorCol );
     }
+}
 
-    /* If we are already at the bottom just return */
-    if ( disp->currMsg->currentLine == disp->currMsg->last ) {
-        return;
+/* Shows lines whole, wrapping them onto the next rows, or cuts them off at the edge of the
+ * screen so they can be scrolled sideways. Keeps the top line where it was. */
+void toggleWrap( DISPLAY_DATA *disp ) {
+    disp->wrap = !disp->wrap;
+    disp->leftCol = 0;
+    disp->cursorRow = disp->cursorCol = 0;
+    invalidateRows( disp );
+    scrollTo( disp, disp->currMsg->topLine, 0 );
+}
+
+/* Turns the colouring of log levels, diffs, JSON and file:line references on or off */
+void toggleHighlight( DISPLAY_DATA *disp ) {
+    disp->highlight = !disp->highlight;
+    invalidateRows( disp );
+    printPage( disp );
+}
+
+/* Starts or stops following the data file like tail -f. While following, the newest note
+ * is shown with its bottom on the screen, and notes other terminotes add appear as they land. */
+void toggleFollow( DISPLAY_DATA *disp ) {
+    if ( disp->follow ) {
+        event_watch( -1, EVENT_FOLLOW );
+        follow_stop( &follow );
+        disp->follow = false;
+    } else if ( follow_watch( &follow ) ) {
+        event_watch( follow.fd, EVENT_FOLLOW );
+        disp->follow = true;
+        checkFollow( disp );
+    } else {
+        flash();
     }
+    showTopWin( disp );
+}
 
-    /* Start at the bottom of the page */
-    LINE *tmp = disp->currMsg->pageBot;
+/* Scrolls unwrapped lines sideways by cols columns, or back if cols is negative */
+void scrollColumns( DISPLAY_DATA *disp, int cols ) {
+    int leftCol = disp->leftCol + cols;
+    if ( leftCol < 0 )
+        leftCol = 0;
+    if ( leftCol == disp->leftCol )
+        return;
 
-    /* Update the pageTop pointer */
-    disp->currMsg->pageTop = tmp;
+    disp->cursorCol -= leftCol - disp->leftCol;
+    disp->leftCol = leftCol;
+    invalidateRows( disp );
+    printPage( disp );
+}
 
-    wclear( wins[MID] );
+/* Shows prompt in the bottom window and reads a line of input into buffer */
+void promptInput( const char *prompt, char *buffer, int size ) {
+    werase( wins[BOT] );
+    mvwprintw( wins[BOT], 0, 0, "%s", prompt );
+    echo();
+    wgetnstr( wins[BOT], buffer, size - 1 );
+    noecho();
+    showBotWin();
+}
 
-    /* Print nScroll lines to the screen */
-    for ( int i = 0; i < ( disp->NROWS - 2 ) && tmp->next;
-            tmp = tmp->next, i++ ) {
-        mvwprintw( wins[MID], i, 0, "%s", tmp->text );
+/* Asks for a line number, or a percentage such as 50%, and goes there */
+void promptGoto( DISPLAY_DATA *disp ) {
+    char input[32];
+    promptInput( "Go to line (or N%): ", input, sizeof( input ) );
 
-        /* Update the pointers */
-        disp->currMsg->pageBot = tmp;
-        disp->currMsg->currentLine = tmp;
-    }
+    char *end;
+    long n = strtol( input, &end, 10 );
+    if ( end == input || n < 0 || n > INT_MAX )
+        return;
 
-    wrefresh( win );
+    if ( *end == '%' )
+        gotoPercent( disp, n > 100 ? 100 : n );
+    else if ( *end == '\0' )
+        gotoLine( disp, n );
 }
 
 /* Setup and print the middle window to screen */
 void showMidWin( DISPLAY_DATA *disp ) {
-    wclear( wins[MID] );
+    werase( wins[MID] );
+    invalidateRows( disp );
 
     if ( disp->currMsg->messageNum == 0
             || disp->currMsg->root->totalMessages < 1 ) {
         char str[30];
-        sprintf( str, "You had %d stored notes.",
-                disp->currMsg->root->totalMessages );
+        if ( loading )
+            sprintf( str, "Loading your notes..." );
+        else
+            sprintf( str, "You had %d stored notes.",
+                    disp->currMsg->root->totalMessages );
         mvwprintw( wins[MID], 0, ( disp->NCOLS / 2 ) - ( strlen( str ) / 2 ),
-                str );
-        wrefresh( wins[MID] );
+                "%s", str );
+        wnoutrefresh( wins[MID] );
         return;
     }
 
-    /* Position the cursor at the start of the message */
-    wmove( wins[MID], 0, 0 );
-
     /* Print the message to the screen */
-    printPage( disp, disp->NROWS - 2 );
+    printPage( disp );
 }
 
 /* Setup and print the bottom window to screen */
 void showBotWin() {
-    wclear( wins[BOT] );
+    werase( wins[BOT] );
     wattron( wins[BOT], COLOR_PAIR(2) );
     wbkgd( wins[BOT], COLOR_PAIR(2) );
-    wrefresh( wins[BOT] );
+    wnoutrefresh( wins[BOT] );
 }
 
 /* Show the windows */
@@ -296,16 +703,74 @@ void hideMainMenu() {
     wrefresh( wins[BOT] );
 }
 
-/* Resize the terminal screen */
+/* Resize the terminal screen, unless ncurses has already done it. Resizing pushes a
+ * KEY_RESIZE, so doing it again would have us resizing forever. */
 void resizeScreen( DISPLAY_DATA *disp ) {
     getScrnSize( disp );
-    resizeterm( disp->NROWS, disp->NCOLS );
+    if ( is_term_resized( disp->NROWS, disp->NCOLS ) )
+        resizeterm( disp->NROWS, disp->NCOLS );
+}
+
+/* Fits the windows to the new size of the terminal and redraws them. The page keeps
+ * starting at the same place in its top line, and the cursor stays on the same character
+ * if it is still on the page. Lines are only laid out again as they come into view. */
+void resizeWins( DISPLAY_DATA *disp ) {
+    MESSAGE *msg = disp->currMsg;
+    LINE *top = line_at( msg, msg->topLine );
+    int topByte = 0, col, cursorIndex, cursorByte;
+
+    /* Remember where the page and the cursor are in the text, not on the screen */
+    if ( top && disp->wrap ) {
+        line_layout( top, screenCols( disp ) );
+        line_rowStart( top, msg->topRow, &topByte, &col );
+    }
+    cursorPosition( disp, &cursorIndex, &cursorByte );
+
+    /* resizeterm moves windows that no longer fit, so put them back where they belong */
+    resizeScreen( disp );
+    setNumRows( disp );
+    wresize( wins[TOP], 1, disp->NCOLS );
+    wresize( wins[MID], disp->numRows, disp->NCOLS );
+    mvwin( wins[MID], 1, 0 );
+    wresize( wins[BOT], 1, disp->NCOLS );
+    mvwin( wins[BOT], disp->NROWS - 1, 0 );
+
+    if ( top && disp->wrap ) {
+        line_layout( top, screenCols( disp ) );
+        msg->topRow = line_rowOf( top, topByte );
+    }
+
+    showWins( disp );
+    if ( top )
+        scrollTo( disp, msg->topLine, msg->topRow );
+
+    /* Put the cursor back on the character it was on */
+    LINE *line = line_at( msg, cursorIndex );
+    int sub = 0, row = -1, byte;
+    if ( line ) {
+        line_layout( line, screenCols( disp ) );
+        if ( disp->wrap )
+            sub = line_rowOf( line, cursorByte );
+        row = findRow( disp, cursorIndex, sub );
+    }
+    if ( row < 0 ) {
+        disp->cursorRow = disp->cursorCol = 0;
+        return;
+    }
+
+    line_rowStart( line, sub, &byte, &col );
+    int rowCol = disp->wrap ? col : disp->leftCol;
+    line_walk( line, &byte, &col, cursorByte, INT_MAX );
+    disp->cursorRow = row;
+    disp->cursorCol = col - rowCol;
+    if ( disp->cursorCol < 0 || disp->cursorCol >= disp->NCOLS )
+        disp->cursorCol = 0;
 }
 
-/* Sets the RECIEVED_SIGWINCH flag to true so we can deal with resizing the screen */
+/* Wakes the event loop to deal with resizing the screen */
 void hndSIGWINCH( int sig ) {
     if ( sig == SIGWINCH ) {
-        RECIEVED_SIGWINCH = true;
+        event_post( EVENT_RESIZE );
     }
 }
 
@@ -313,30 +778,367 @@ void hndSIGWINCH( int sig ) {
 void initSigaction() {
     memset( &sa, '\0', sizeof( sa ) );
     sa.sa_handler = hndSIGWINCH;
+
+    /* Let reads of the terminal carry on, the event loop hears about the resize anyway */
+    sa.sa_flags = SA_RESTART;
+    sigaction( SIGWINCH, &sa, NULL );
 }
 
 /* Prints the help message */
 void printHelp(DISPLAY_DATA *disp) {
-    wclear(wins[MID]);
+    werase(wins[MID]);
+    invalidateRows( disp );
     wprintw( wins[MID], "\nTerminote Help:\n\n"
             " Movement:\n"
             " <a> selects previous note\n"
             " <d> selects the next note\n"
+            " <l> lists the notes to filter, sort and pick from\n"
+            " <p> picks a note by fuzzy search, listing the best matches as you type\n"
             " <w> jumps to the top of the page\n"
             " <e> jumps to the bottom of the page\n"
+            " <g> goes to a line number, or a percentage such as 50%%\n"
+            " PgUp/PgDn and <space> scroll a page at a time\n"
+            " <z> switches between wrapping long lines and scrolling them sideways\n"
+            " <c> turns the colouring of logs, diffs, JSON and file:line references on and off\n"
+            " <f> follows new notes as they are added, like tail -f, until pressed again\n"
+            " </> searches every note as you type, <n> and <N> go to the next and previous match\n"
             " Arrows keys scroll and move the cursor\n\n"
             " Cntrl-F opens the menu");
-    wrefresh(wins[MID]);
+    wnoutrefresh(wins[MID]);
+}
+
+/* Shows the note and line of match, with the cursor on it */
+void showMatch( DISPLAY_DATA *disp, SEARCH_MATCH *match ) {
+    if ( match->msg != disp->currMsg ) {
+        disp->currMsg = match->msg;
+        showWins( disp );
+    }
+
+    LINE *line = line_at( disp->currMsg, match->line );
+    if ( !line )
+        return;
+
+    /* Work out which row and column the match starts at */
+    int byte, col, sub = 0;
+    line_layout( line, screenCols( disp ) );
+    if ( disp->wrap )
+        sub = line_rowOf( line, match->col );
+    line_rowStart( line, sub, &byte, &col );
+    int rowCol = col;
+    line_walk( line, &byte, &col, match->col, INT_MAX );
+
+    /* Scroll sideways if the match is off the edge of the screen */
+    if ( !disp->wrap && ( col < disp->leftCol || col >= disp->leftCol + disp->NCOLS ) )
+        scrollColumns( disp, col - disp->NCOLS / 2 - disp->leftCol );
+
+    disp->cursorRow = revealRow( disp, match->line, sub );
+    disp->cursorCol = col - ( disp->wrap ? rowCol : disp->leftCol );
+    if ( disp->cursorCol >= disp->NCOLS )
+        disp->cursorCol = disp->NCOLS - 1;
+}
+
+/* Shows the search prompt and how many matches have been found so far */
+static void showSearchPrompt( DISPLAY_DATA *disp, const char *term ) {
+    bool done;
+    int found = search_progress( &search, &done );
+    char status[40] = "";
+    if ( *term )
+        snprintf( status, sizeof( status ), "%d matches%s", found, done ? "" : "..." );
+
+    werase( wins[BOT] );
+    mvwprintw( wins[BOT], 0, disp->NCOLS - strlen( status ) - 1, "%s", status );
+    mvwprintw( wins[BOT], 0, 0, "/%s", term );
+
+    /* Leave the terminal cursor at the end of what's been typed */
+    wnoutrefresh( wins[MID] );
+    wnoutrefresh( wins[BOT] );
+    doupdate();
+}
+
+/* Reads a search term a key at a time, searching every note in the background as it is
+ * typed and jumping to the first match after the cursor */
+void doSearch( DISPLAY_DATA *disp ) {
+    MESSAGE *origin = disp->currMsg;
+    int originTop = origin->topLine, originTopRow = origin->topRow;
+    int originRow = disp->cursorRow, originCol = disp->cursorCol;
+    int originLeft = disp->leftCol, originLine, originByte;
+    char term[MAX_SEARCH_SIZE] = "";
+    int len = 0;
+    bool jumped = true;
+
+    search_clear( &search );
+    cursorPosition( disp, &originLine, &originByte );
+
+    for ( ;; ) {
+        /* Jump to the first match after where we started as soon as it turns up */
+        SEARCH_MATCH match;
+        if ( !jumped && search_find( &search, origin->messageNum, originLine, originByte - 1,
+                false, false, &match ) ) {
+            showMatch( disp, &match );
+            jumped = true;
+        }
+        showSearchPrompt( disp, term );
+
+        /* Wake up for new matches as well as keys, so the count keeps up */
+        int ch, event = event_wait( wins[BOT], &ch );
+        if ( event != EVENT_KEY ) {
+            handleEvent( disp, event );
+            continue;
+        }
+
+        if ( ch == '\r' || ch == '\n' || ch == KEY_ENTER )
+            break;
+
+        if ( ch == 27 || ch == 7 ) {
+            /* Escape or Cntrl-G gives up and goes back to where we started */
+            search_clear( &search );
+            term[0] = '\0';
+        } else if ( ch == KEY_BACKSPACE || ch == 127 || ch == 8 ) {
+            if ( len == 0 )
+                continue;
+            term[--len] = '\0';
+        } else if ( isprint( ch ) && len < MAX_SEARCH_SIZE - 1 ) {
+            term[len++] = ch;
+            term[len] = '\0';
+        } else {
+            continue;
+        }
+
+        /* Start again from where we were with the new term. This cancels the old search. */
+        search_start( &search, origin->root, term );
+        jumped = false;
+
+        if ( disp->currMsg != origin ) {
+            disp->currMsg = origin;
+            showWins( disp );
+        }
+        origin->topLine = originTop;
+        origin->topRow = originTopRow;
+        disp->leftCol = originLeft;
+        disp->cursorRow = originRow;
+        disp->cursorCol = originCol;
+
+        /* Redraw the page so the highlighting follows the new term */
+        invalidateRows( disp );
+        if ( disp->currMsg->messageNum != 0 )
+            printPage( disp );
+
+        if ( !*term && ( ch == 27 || ch == 7 ) )
+            break;
+    }
+
+    showBotWin();
+}
+
+/* Moves to the next match of the current search, or the previous one if backward is set */
+void nextMatch( DISPLAY_DATA *disp, bool backward ) {
+    if ( !*search.term )
+        return;
+
+    SEARCH_MATCH match;
+    int index, byte;
+    cursorPosition( disp, &index, &byte );
+    if ( search_find( &search, disp->currMsg->messageNum, index, byte, backward, true, &match ) )
+        showMatch( disp, &match );
+}
+
+/* Shows the note browser and switches to the note picked in it. With fuzzy set it starts
+ * with a fuzzy search. */
+void showBrowser( DISPLAY_DATA *disp, bool fuzzy ) {
+    MESSAGE *chosen = browser_run( disp->currMsg->root, disp->currMsg, fuzzy );
+    if ( chosen && chosen != disp->currMsg ) {
+        disp->currMsg = chosen;
+        clearPosition( disp );
+    }
+
+    /* The browser covered the whole screen */
+    showWins( disp );
+}
+
+/* Picks up whatever the background load has finished since we last looked */
+void checkLoader( DISPLAY_DATA *disp ) {
+    if ( !loading )
+        return;
+
+    MESSAGE *root = disp->currMsg->root;
+    int state = loader_progress( &loader, NULL );
+
+    if ( state == LOADER_FAILED ) {
+        endwin();
+        fprintf( stderr, "Error reading file, it may be corrupted. Run with the -R flag to "
+                "delete the corrupted file. Sorry.\n" );
+        exit( 1 );
+    }
+
+    if ( state == LOADER_DONE || ( state == LOADER_LOADING && !shownNewest ) ) {
+        /* The notes are about to change under the search, so stop it and start it again after */
+        char term[MAX_SEARCH_SIZE];
+        snprintf( term, sizeof( term ), "%s", search.term );
+        search_stop( &search );
+
+        loader_takeNewest( &loader, root );
+        if ( loader_finish( &loader, root ) ) {
+            loading = false;
+
+            /* Follow on from where the load ended, catching up if they're already following */
+            int fd = follow.fd;
+            follow_init( &follow, root );
+            follow.fd = fd;
+        }
+
+        if ( *term )
+            search_start( &search, root, term );
+
+        /* Show the newest note as soon as we have it, unless they've moved on already */
+        if ( !shownNewest && disp->currMsg == root && root->tail ) {
+            disp->currMsg = root->tail;
+            clearPosition( disp );
+            needsRefresh = true;
+        }
+        shownNewest = true;
+        showMidWinIfRoot( disp );
+
+        if ( !loading && disp->follow )
+            checkFollow( disp );
+    }
+
+    if ( !needsRefresh )
+        showTopWin( disp );
+}
+
+/* Adds the notes other terminotes have written since we last looked and, when following,
+ * moves to the bottom of the newest one */
+void checkFollow( DISPLAY_DATA *disp ) {
+    /* The notes are still coming in, the load picks up everything written before it's done */
+    if ( loading )
+        return;
+
+    MESSAGE *root = disp->currMsg->root;
+    char term[MAX_SEARCH_SIZE];
+    snprintf( term, sizeof( term ), "%s", search.term );
+    search_stop( &search );
+
+    follow_read( &follow, root );
+    if ( *term )
+        search_start( &search, root, term );
+
+    if ( disp->follow && root->tail ) {
+        if ( disp->currMsg != root->tail ) {
+            disp->currMsg = root->tail;
+            clearPosition( disp );
+            showWins( disp );
+        }
+        printBot( disp );
+    }
+    showTopWin( disp );
+}
+
+/* Redraws the middle window if it's showing the root screen, whose text depends on the load */
+void showMidWinIfRoot( DISPLAY_DATA *disp ) {
+    if ( disp->currMsg->messageNum == 0 )
+        showMidWin( disp );
+}
+
+/* Shows the save on the way out in the top window. Only the size of the screen is used, as
+ * the notes are changing under us. */
+static void showSavingWin( DISPLAY_DATA *disp ) {
+    char title[100];
+    snprintf( title, sizeof( title ), "Terminote %.1f (saving %c)", VERSION,
+            "|/-\\"[time( NULL ) % 4] );
+    werase( wins[TOP] );
+    mvwprintw( wins[TOP], 0, ( disp->NCOLS / 2 ) - ( strlen( title ) / 2 ), "%s", title );
+    wnoutrefresh( wins[TOP] );
+}
+
+/* Saves the notes in the background so the screen keeps updating */
+static void *saveNotes( void *arg ) {
+    list_save( arg );
+    saving = false;
+    event_post( EVENT_SAVED );
+    return NULL;
+}
+
+/* Deals with anything but a key that woke the event loop */
+void handleEvent( DISPLAY_DATA *disp, int event ) {
+    switch ( event ) {
+    case EVENT_RESIZE:
+        resizeWins( disp );
+        break;
+    case EVENT_LOADER:
+        checkLoader( disp );
+        break;
+    case EVENT_FOLLOW:
+        if ( follow_changed( &follow ) )
+            checkFollow( disp );
+        break;
+    case EVENT_HANGUP:
+        quit( disp );
+        break;
+    }
+}
+
+/* Waits for the loader or the save on the way out, keeping the screen up to date.
+ * Keys are ignored. While saving, a resize only fits the top window to the screen, as
+ * redrawing the rest would read the notes the save is changing. Returns the event that
+ * woke us. */
+static int waitQuitting( DISPLAY_DATA *disp ) {
+    int value, event = event_wait( wins[MID], &value );
+    if ( saving ) {
+        if ( event == EVENT_RESIZE ) {
+            resizeScreen( disp );
+            wresize( wins[TOP], 1, disp->NCOLS );
+        }
+    } else if ( event == EVENT_RESIZE || event == EVENT_LOADER ) {
+        handleEvent( disp, event );
+    }
+    return event;
 }
 
 /* Free all memory and quit */
-void quit( MESSAGE *msg ) {
+void quit( DISPLAY_DATA *disp ) {
+    MESSAGE *msg = disp->currMsg->root;
+
     int n = ARRAY_SIZE(mainMenuStrings);
     for ( int i = 0; i < n; ++i )
         free_item( mainMenuItems[i] );
     free_menu( footerMenu );
+    search_clear( &search );
+
+    /* Our own save would wake us up */
+    event_watch( -1, EVENT_FOLLOW );
+    follow_stop( &follow );
+
+    if ( loading ) {
+        if ( msg->hasChanged ) {
+            /* Saving only part of the notes could lose the rest, so let the load finish */
+            while ( loading ) {
+                checkLoader( disp );
+                doupdate();
+                waitQuitting( disp );
+            }
+        } else {
+            /* Nothing to save, so don't bother reading the rest */
+            loader_cancel( &loader );
+            loading = false;
+        }
+    }
+
+    pthread_t saver;
+    saving = true;
+    if ( pthread_create( &saver, NULL, saveNotes, msg ) == 0 ) {
+        event_setTimer( TIMER_SPINNER, SPINNER_MS );
+        while ( saving ) {
+            showSavingWin( disp );
+            doupdate();
+            if ( waitQuitting( disp ) == EVENT_TIMER )
+                event_setTimer( TIMER_SPINNER, SPINNER_MS );
+        }
+        pthread_join( saver, NULL );
+    } else {
+        saveNotes( msg );
+    }
+
     endwin();
-    list_save( msg );
     list_destroy( &msg );
     exit( 0 );
 }
@@ -366,11 +1168,10 @@ void doMenu( DISPLAY_DATA *disp ) {
         case 13: /* Enter */
             currItem = current_item( footerMenu );
             if ( !strcmp( item_name( currItem ), "Quit" ) ) {
-                quit( disp->currMsg );
+                quit( disp );
             } else if ( !strcmp( item_name( currItem ), "Browse" ) ) {
                 hideMainMenu();
-                list_firstNode( &disp->currMsg );
-                showWins( disp );
+                showBrowser( disp, false );
                 keepGoing = false;
                 break;
             } else if ( !strcmp( item_name( currItem ), "Help" ) ) {
@@ -379,8 +1180,12 @@ void doMenu( DISPLAY_DATA *disp ) {
                 keepGoing = false;
                 break;
             } else if ( !strcmp( item_name( currItem ), "Delete" ) ) {
-                list_deleteNode( disp->currMsg, disp->currMsg->messageNum );
-                disp->currMsg->root->hasChanged = true;
+                MESSAGE *root = disp->currMsg->root;
+
+                /* The search may be reading the note, and its matches would be stale */
+                search_clear( &search );
+                list_deleteMessage( disp->currMsg );
+                disp->currMsg = root;
                 list_firstNode( &disp->currMsg );
                 hideMainMenu();
                 showWins( disp );
@@ -405,46 +1210,60 @@ void clearPosition( DISPLAY_DATA *disp ) {
     disp->NROWS = 0;
     disp->cursorRow = 0;
     disp->cursorCol = 0;
+    disp->leftCol = 0;
 }
 
 /* run main GUI loop */
 void run() {
 
-    /* Load the list */
+    /* Background threads wake the event loop through this, so it must come first */
+    event_init();
+
+    /* Load the list in the background if there is one, so the screen comes up straight away */
     MESSAGE *msg = NULL;
     list_init( &msg );
-    list_load( msg );
+    follow_init( &follow, msg );
+    if ( file_exists( path ) ) {
+        loader_start( &loader );
+        loading = true;
+    } else {
+        list_load( msg );
+    }
 
     /* Set up the POSITION struct */
     DISPLAY_DATA *disp = NULL;
     initPosition( &disp );
     disp->currMsg = msg;
 
-    /* Set up Ncurses */
+    /* Set up Ncurses, in the user's locale so UTF-8 notes are shown properly */
+    setlocale( LC_ALL, "" );
     initNcurses();
     initMainMenu();
     initSigaction();
+    search_init( &search );
     initWins( disp );
 
     /* Print everything to the screen */
     showWins( disp );
+    doupdate();
 
     disp->currMsg->currentLine = msg->first;
 
-    int ch;
-    while ( ( ch = wgetch( wins[MID] ) ) ) {
-
-        sigaction( SIGWINCH, &sa, NULL );
-
-        if ( RECIEVED_SIGWINCH ) {
-            resizeScreen( disp );
-            initWins( disp );
-            showWins( disp );
-            RECIEVED_SIGWINCH = false;
+    /* Sleep until there's a key, a resize or news from the loader */
+    for ( ;; ) {
+        int ch, event = event_wait( wins[MID], &ch );
+        if ( event != EVENT_KEY ) {
+            handleEvent( disp, event );
+            ch = ERR;
         }
 
         switch ( ch ) {
 
+        /* ncurses saw the resize itself, before our handler was installed */
+        case KEY_RESIZE:
+            resizeWins( disp );
+            break;
+
         /* Change to next note in list struct */
         case 'd':
             clearPosition( disp );
@@ -473,19 +1292,11 @@ void run() {
             if ( disp->currMsg->messageNum == 0 )
                 break;
 
-            if ( disp->cursorRow > 0 ) {
+            /* Move the cursor up, or scroll a row once it reaches the top */
+            if ( disp->cursorRow > 0 )
                 disp->cursorRow--;
-                wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-                wrefresh( wins[MID] );
-                break;
-            }
-
-            wins[MID] = newwin( disp->NROWS - 2, disp->NCOLS, 1, 0 );
-            keypad( wins[MID], true );
-            scrollUpPage( disp, wins[MID] );
-            disp->cursorRow = ( disp->NROWS / 2 ) - 1;
-            wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-            wrefresh( wins[MID] );
+            else
+                scrollRows( disp, -1 );
             break;
 
             /* Scroll down in the message */
@@ -495,43 +1306,102 @@ void run() {
             if ( disp->currMsg->messageNum == 0 )
                 break;
 
-            if ( disp->cursorRow <= disp->NROWS - 3 ) {
+            /* Move the cursor down, or scroll a row once it reaches the bottom */
+            if ( disp->cursorRow < disp->numRows - 1 && disp->rows[disp->cursorRow + 1].line )
                 disp->cursorRow++;
-                wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-                wrefresh( wins[MID] );
-                break;
-            } else {
-                disp->cursorRow = ( disp->NROWS / 2 ) - 1;
-                scrollDownPage( disp, wins[MID] );
-                wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-                break;
-            }
+            else
+                scrollRows( disp, 1 );
             break;
 
         case KEY_LEFT:
-            if ( disp->cursorCol <= 0 ) {
-                disp->cursorRow--;
-                disp->cursorCol = disp->NCOLS;
+            if ( disp->cursorCol <= 0 && !disp->wrap ) {
+                scrollColumns( disp, -( disp->NCOLS / 2 ) );
+            } else if ( disp->cursorCol <= 0 ) {
+                if ( disp->cursorRow > 0 ) {
+                    disp->cursorRow--;
+                    disp->cursorCol = disp->NCOLS - 1;
+                }
             } else {
                 disp->cursorCol--;
             }
-            wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-            wrefresh( wins[MID] );
-            keypad( wins[MID], true );
             break;
 
         case KEY_RIGHT:
-            if ( disp->cursorCol >= disp->NCOLS ) {
-                disp->cursorRow++;
-                disp->cursorCol = 0;
+            if ( disp->cursorCol >= disp->NCOLS - 1 && !disp->wrap ) {
+                scrollColumns( disp, disp->NCOLS / 2 );
+            } else if ( disp->cursorCol >= disp->NCOLS - 1 ) {
+                if ( disp->cursorRow < disp->numRows - 1 ) {
+                    disp->cursorRow++;
+                    disp->cursorCol = 0;
+                }
             } else {
                 disp->cursorCol++;
             }
-            wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-            wrefresh( wins[MID] );
-            keypad( wins[MID], true );
             break;
 
+        case KEY_PPAGE:
+            if ( disp->currMsg->messageNum == 0 )
+                break;
+            scrollUpPage( disp );
+            break;
+
+        case KEY_NPAGE:
+        case ' ':
+            if ( disp->currMsg->messageNum == 0 )
+                break;
+            scrollDownPage( disp );
+            break;
+
+            /* List the notes to pick one */
+        case 'l':
+            showBrowser( disp, false );
+            break;
+
+            /* Pick a note by fuzzy search */
+        case 'p':
+            showBrowser( disp, true );
+            break;
+
+            /* Search every note */
+        case '/':
+            doSearch( disp );
+            break;
+
+        case 'n':
+            nextMatch( disp, false );
+            break;
+
+        case 'N':
+            nextMatch( disp, true );
+            break;
+
+            /* Switch between wrapping long lines and scrolling them sideways */
+        case 'z':
+            if ( disp->currMsg->messageNum == 0 )
+                break;
+            toggleWrap( disp );
+            break;
+
+            /* Turn highlighting on or off */
+        case 'c':
+            if ( disp->currMsg->messageNum == 0 )
+                break;
+            toggleHighlight( disp );
+            break;
+
+            /* Follow the notes as they are added, like tail -f */
+        case 'f':
+            toggleFollow( disp );
+            break;
+
+            /* Go to a line number or a percentage of the way through */
+        case 'g':
+            if ( disp->currMsg->messageNum == 0 )
+                break;
+            promptGoto( disp );
+            break;
+
+        case KEY_HOME:
         case 'w':
             /* If we are in the root node, break to avoid a segfault */
             if ( disp->currMsg->messageNum == 0 )
@@ -540,36 +1410,38 @@ void run() {
             disp->cursorCol = 0;
             disp->cursorRow = 0;
             printTop( disp );
-            wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-            wrefresh( wins[MID] );
             break;
 
+        case KEY_END:
         case 'e':
             /* If we are in the root node, break to avoid a segfault */
             if ( disp->currMsg->messageNum == 0 )
                 break;
 
-            disp->cursorRow = disp->NROWS - 3;
             printBot( disp );
-            wrefresh( wins[MID] );
             break;
 
             /* Free all memory and exit */
         case 'q':
-            quit( msg );
+            quit( disp );
             break;
 
         default:
             break;
         }
 
+        checkLoader( disp );
+
         if ( needsRefresh ) {
             showWins( disp );
-            wmove( wins[MID], disp->cursorRow, disp->cursorCol );
-            wrefresh( wins[MID] );
             needsRefresh = false;
         }
 
+        /* Everything above only marked what changed, send it to the terminal in one go */
+        wmove( wins[MID], disp->cursorRow, disp->cursorCol );
+        wnoutrefresh( wins[MID] );
+        doupdate();
+
     }
 
 }
@@ -8,12 +8,20 @@
 #ifndef UI_H_
 #define UI_H_
 
-#define _POSIX_SOURCE // You need this here to get rid of the waring with sigaction
+#define _XOPEN_SOURCE 700 // For sigaction and SA_RESTART
+#define NCURSES_WIDECHAR 1 // For the wide character functions in ncursesw
 #include "helperFunctions.h"
 #include "linkedList.h"
 #include "options.h"
 #include "defines.h"
 #include "nonInteractive.h"
+#include "line.h"
+#include "search.h"
+#include "browser.h"
+#include "loader.h"
+#include "highlight.h"
+#include "event.h"
+#include "follow.h"
 
 #include "ncurses.h"
 #include "menu.h"
@@ -21,6 +29,10 @@
 
 #include <sys/ioctl.h> // For terminal size
 #include <signal.h> // For sigaction
+#include <limits.h>
+#include <ctype.h>
+#include <locale.h>
+#include <stdatomic.h>
 
 /* Allocate and initialize a POSITION struct */
 void initPosition( DISPLAY_DATA **disp );
@@ -33,11 +45,25 @@ void initNcurses();
 
 void initWins( DISPLAY_DATA *disp );
 
+/* Forget what is on each row of the message window, so the next printPage redraws them all */
+void invalidateRows( DISPLAY_DATA *disp );
+
+/* Draws display row sub of line, which is line index of the message, on row of the message
+ * window, unless it is already there. NULL draws a blank row. */
+void drawRow( DISPLAY_DATA *disp, int row, LINE *line, int index, int sub );
+
+/* Returns the row of the message window showing display row sub of line index, or -1 */
+int findRow( DISPLAY_DATA *disp, int index, int sub );
+
 /* Setup and print the top window to screen */
 void showTopWin( DISPLAY_DATA *disp );
 
-/* Print the current page */
-void printPage( DISPLAY_DATA *disp, int numRows );
+/* Print the current page, starting at topLine. Only rows whose line has changed are drawn. */
+void printPage( DISPLAY_DATA *disp );
+
+/* Makes display row sub of line index the first row on the page, moving it up if that
+ * would leave blank rows at the bottom */
+void scrollTo( DISPLAY_DATA *disp, int index, int sub );
 
 /* Print the start of the message */
 void printTop( DISPLAY_DATA *disp );
@@ -45,11 +71,48 @@ void printTop( DISPLAY_DATA *disp );
 /* Print the bottom of the message */
 void printBot( DISPLAY_DATA *disp );
 
+/* Moves the page n display rows down, or up if n is negative. The window is scrolled so
+ * that only the rows coming into view are drawn. Returns how many rows it moved. */
+int scrollRows( DISPLAY_DATA *disp, int n );
+
 /* Scrolls the page up  */
-void scrollUpPage( DISPLAY_DATA *disp, WINDOW *win );
+void scrollUpPage( DISPLAY_DATA *disp );
 
 /* Scrolls the page down */
-void scrollDownPage( DISPLAY_DATA *disp, WINDOW *win );
+void scrollDownPage( DISPLAY_DATA *disp );
+
+/* Shows display row sub of line index, in the middle of the page if it isn't already on
+ * it, and returns the row of the message window it is on */
+int revealRow( DISPLAY_DATA *disp, int index, int sub );
+
+/* Moves to line n of the message, counting from 1, and puts the cursor on it */
+void gotoLine( DISPLAY_DATA *disp, int n );
+
+/* Moves to the line percent of the way through the message */
+void gotoPercent( DISPLAY_DATA *disp, int percent );
+
+/* Sets index and byte to the line and byte offset under the cursor */
+void cursorPosition( DISPLAY_DATA *disp, int *index, int *byte );
+
+/* Shows lines whole, wrapping them onto the next rows, or cuts them off at the edge of the
+ * screen so they can be scrolled sideways. Keeps the top line where it was. */
+void toggleWrap( DISPLAY_DATA *disp );
+
+/* Turns the colouring of log levels, diffs, JSON and file:line references on or off */
+void toggleHighlight( DISPLAY_DATA *disp );
+
+/* Starts or stops following the data file like tail -f. While following, the newest note
+ * is shown with its bottom on the screen, and notes other terminotes add appear as they land. */
+void toggleFollow( DISPLAY_DATA *disp );
+
+/* Scrolls unwrapped lines sideways by cols columns, or back if cols is negative */
+void scrollColumns( DISPLAY_DATA *disp, int cols );
+
+/* Shows prompt in the bottom window and reads a line of input into buffer */
+void promptInput( const char *prompt, char *buffer, int size );
+
+/* Asks for a line number, or a percentage such as 50%, and goes there */
+void promptGoto( DISPLAY_DATA *disp );
 
 /* Setup and print the middle window to screen */
 void showMidWin( DISPLAY_DATA *disp );
@@ -72,10 +135,16 @@ void showMainMenu( DISPLAY_DATA *disp );
 /* Hide the menu at the bottom of the screen */
 void hideMainMenu();
 
-/* Resize the terminal screen */
+/* Resize the terminal screen, unless ncurses has already done it. Resizing pushes a
+ * KEY_RESIZE, so doing it again would have us resizing forever. */
 void resizeScreen( DISPLAY_DATA *disp );
 
-/* Sets the RECIEVED_SIGWINCH flag to true so we can deal with resizing the screen */
+/* Fits the windows to the new size of the terminal and redraws them. The page keeps
+ * starting at the same place in its top line, and the cursor stays on the same character
+ * if it is still on the page. Lines are only laid out again as they come into view. */
+void resizeWins( DISPLAY_DATA *disp );
+
+/* Wakes the event loop to deal with resizing the screen */
 void hndSIGWINCH( int sig );
 
 /* Set up the SIGWINCH handler */
@@ -84,8 +153,35 @@ void initSigaction();
 /* Prints the help message */
 void printHelp(DISPLAY_DATA *disp);
 
+/* Shows the note and line of match, with the cursor on it */
+void showMatch( DISPLAY_DATA *disp, SEARCH_MATCH *match );
+
+/* Reads a search term a key at a time, searching every note in the background as it is
+ * typed and jumping to the first match after the cursor */
+void doSearch( DISPLAY_DATA *disp );
+
+/* Moves to the next match of the current search, or the previous one if backward is set */
+void nextMatch( DISPLAY_DATA *disp, bool backward );
+
+/* Shows the note browser and switches to the note picked in it. With fuzzy set it starts
+ * with a fuzzy search. */
+void showBrowser( DISPLAY_DATA *disp, bool fuzzy );
+
+/* Picks up whatever the background load has finished since we last looked */
+void checkLoader( DISPLAY_DATA *disp );
+
+/* Adds the notes other terminotes have written since we last looked and, when following,
+ * moves to the bottom of the newest one */
+void checkFollow( DISPLAY_DATA *disp );
+
+/* Redraws the middle window if it's showing the root screen, whose text depends on the load */
+void showMidWinIfRoot( DISPLAY_DATA *disp );
+
 /* Free all memory and quit */
-void quit( MESSAGE *msg );
+void quit( DISPLAY_DATA *disp );
+
+/* Deals with anything but a key that woke the event loop */
+void handleEvent( DISPLAY_DATA *disp, int event );
 
 /* Select and execute options from the menu */
 void doMenu( DISPLAY_DATA *disp );